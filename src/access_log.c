@@ -0,0 +1,207 @@
+// Access log rings and writer thread (see access_log.h).
+#include "access_log.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "router.h"
+
+#define WRITE_BATCH 65536           // formatted bytes collected before one write()
+#define LINE_MAX 256                // longest formatted record
+#define IDLE_SLEEP_MS 20            // how long the writer naps when every ring is empty
+
+// head and tail on separate cache lines: the worker only writes head, the
+// writer thread only writes tail.
+struct AccessRing {
+    _Alignas(64) _Atomic uint64_t head;     // records pushed (producer)
+    uint64_t cached_tail;                   // producer's last look at tail: refreshed only when full
+    _Alignas(64) _Atomic uint64_t tail;     // records consumed (writer thread)
+    _Alignas(64) AccessRecord records[ACCESS_RING_SIZE];
+};
+
+struct AccessLog {
+    int fd;
+    int own_fd;                     // 0 for standard output
+    char *path;
+    atomic_int reopen;              // access_log_reopen() was called
+    int nrings;
+    AccessRing *rings;
+    long long wall_offset_ns;       // realtime - monotonic at startup: records carry monotonic times
+    atomic_int stop;
+    pthread_t thread;
+    char buf[WRITE_BATCH + LINE_MAX];
+    size_t len;
+    time_t stamp_sec;               // second formatted in 'stamp'
+    char stamp[24];                 // "2026-10-14T05:45:13."
+};
+
+int access_log_push(AccessRing *r, const AccessRecord *rec) {
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - r->cached_tail >= ACCESS_RING_SIZE) {
+        r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head - r->cached_tail >= ACCESS_RING_SIZE) return 0;
+    }
+    r->records[head & (ACCESS_RING_SIZE - 1)] = *rec;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);   // publishes the record
+    return 1;
+}
+
+static void flush(AccessLog *log) {
+    size_t off = 0;
+    while (off < log->len) {
+        ssize_t n = write(log->fd, log->buf + off, log->len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;                  // disk full, closed pipe: lose this batch, not the server
+        off += (size_t)n;
+    }
+    log->len = 0;
+}
+
+static const char *method_name(unsigned m) {
+    switch (m) {
+    case METHOD_GET: return "GET";
+    case METHOD_HEAD: return "HEAD";
+    case METHOD_POST: return "POST";
+    case METHOD_PUT: return "PUT";
+    case METHOD_DELETE: return "DELETE";
+    case METHOD_OPTIONS: return "OPTIONS";
+    default: return "-";
+    }
+}
+
+// {"time":"2026-10-14T05:45:13.123Z","client":"127.0.0.1","method":"GET",
+//  "route":"geo","status":200,"bytes":301,"durationUs":12.5}
+static void format_record(AccessLog *log, const AccessRecord *r) {
+    long long wall = r->mono_ns + log->wall_offset_ns;
+    time_t sec = (time_t)(wall / 1000000000);
+    if (sec != log->stamp_sec) {            // records come in time order: one gmtime per second
+        struct tm tm;
+        gmtime_r(&sec, &tm);
+        strftime(log->stamp, sizeof(log->stamp), "%Y-%m-%dT%H:%M:%S.", &tm);
+        log->stamp_sec = sec;
+    }
+    char client[INET6_ADDRSTRLEN] = "-";
+    inet_ntop(r->family == AF_INET6 ? AF_INET6 : AF_INET, r->addr, client, sizeof(client));
+    int n = snprintf(log->buf + log->len, LINE_MAX,
+                     "{\"time\":\"%s%03dZ\",\"client\":\"%s\",\"method\":\"%s\",\"route\":\"%s\","
+                     "\"status\":%u,\"bytes\":%u,\"durationUs\":%.1f}\n",
+                     log->stamp, (int)(wall / 1000000 % 1000), client, method_name(r->method),
+                     route_name(r->route < ROUTE_COUNT ? (RouteId)r->route : ROUTE_OTHER),
+                     r->status, r->bytes, (double)r->duration_ns / 1000.0);
+    if (n > 0 && n < LINE_MAX) log->len += (size_t)n;
+    if (log->len >= WRITE_BATCH) flush(log);
+}
+
+// Format what every ring holds right now. Returns the number of records.
+static size_t drain(AccessLog *log) {
+    size_t total = 0;
+    for (int i = 0; i < log->nrings; i++) {
+        AccessRing *r = &log->rings[i];
+        uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        for (uint64_t t = tail; t < head; t++) format_record(log, &r->records[t & (ACCESS_RING_SIZE - 1)]);
+        atomic_store_explicit(&r->tail, head, memory_order_release);    // slots may be reused now
+        total += head - tail;
+    }
+    return total;
+}
+
+static int open_file(const char *path) {
+    return open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+static void *writer_run(void *arg) {
+    AccessLog *log = arg;
+    while (!atomic_load_explicit(&log->stop, memory_order_acquire)) {
+        if (atomic_exchange_explicit(&log->reopen, 0, memory_order_acquire)) {
+            flush(log);                     // what was formatted belongs to the old file
+            int fd = open_file(log->path);
+            if (fd >= 0) {
+                close(log->fd);
+                log->fd = fd;
+            }                               // else keep writing to the old one
+        }
+        if (drain(log) == 0) {
+            flush(log);                     // quiet moment: write out the partial batch
+            struct timespec ts = { 0, IDLE_SLEEP_MS * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+    drain(log);
+    flush(log);
+    return NULL;
+}
+
+static long long clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+AccessLog *access_log_open(const char *path, int rings, const char **err) {
+    AccessLog *log = calloc(1, sizeof(*log));
+    if (!log) { *err = "out of memory"; return NULL; }
+    log->rings = aligned_alloc(64, (size_t)rings * sizeof(AccessRing));
+    if (!log->rings) { free(log); *err = "out of memory"; return NULL; }
+    for (int i = 0; i < rings; i++) {
+        atomic_init(&log->rings[i].head, 0);
+        atomic_init(&log->rings[i].tail, 0);
+        log->rings[i].cached_tail = 0;
+    }
+    log->nrings = rings;
+    if (strcmp(path, "-") == 0) {
+        log->fd = STDOUT_FILENO;
+    } else {
+        log->fd = open_file(path);
+        log->own_fd = 1;
+    }
+    log->path = strdup(path);
+    if (log->fd < 0 || !log->path) {
+        *err = log->fd < 0 ? strerror(errno) : "out of memory";
+        if (log->fd >= 0 && log->own_fd) close(log->fd);
+        free(log->path);
+        free(log->rings);
+        free(log);
+        return NULL;
+    }
+    log->wall_offset_ns = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+    log->stamp_sec = -1;
+    atomic_init(&log->stop, 0);
+    atomic_init(&log->reopen, 0);
+    if (pthread_create(&log->thread, NULL, writer_run, log) != 0) {
+        *err = "cannot start the writer thread";
+        if (log->own_fd) close(log->fd);
+        free(log->path);
+        free(log->rings);
+        free(log);
+        return NULL;
+    }
+    return log;
+}
+
+AccessRing *access_log_ring(AccessLog *log, int i) {
+    return &log->rings[i];
+}
+
+void access_log_reopen(AccessLog *log) {
+    if (log && log->own_fd) atomic_store_explicit(&log->reopen, 1, memory_order_release);
+}
+
+void access_log_close(AccessLog *log) {
+    if (!log) return;
+    atomic_store_explicit(&log->stop, 1, memory_order_release);
+    pthread_join(log->thread, NULL);
+    if (log->own_fd) close(log->fd);
+    free(log->path);
+    free(log->rings);
+    free(log);
+}
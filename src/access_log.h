@@ -0,0 +1,47 @@
+// Access log off the request path. Every worker pushes one fixed-size
+// binary record per response into its own single-producer/single-consumer
+// ring; a background thread drains all rings, formats the records as JSON
+// lines and writes them in large batches. Pushing is a copy and a release
+// store; a full ring drops the record (the caller counts it) rather than
+// ever making a request wait for the disk.
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ACCESS_RING_SIZE 8192       // records buffered per worker (power of two)
+
+// One response. 48 bytes, no pointers: the log thread may read it any time.
+typedef struct {
+    int64_t mono_ns;                // monotonic time the response was queued
+    uint64_t duration_ns;           // request read → response queued
+    uint32_t bytes;                 // response bytes queued (headers + body as sent)
+    uint16_t status;
+    uint8_t route;                  // RouteId
+    uint8_t method;                 // HttpMethod
+    uint8_t family;                 // AF_INET or AF_INET6
+    uint8_t addr[16];               // client address (IPv4: the first 4 bytes)
+} AccessRecord;
+
+typedef struct AccessLog AccessLog;
+typedef struct AccessRing AccessRing;
+
+// Open 'path' for appending ("-" = standard output) with 'rings' rings and
+// start the writer thread. NULL on failure, with the reason in *err.
+AccessLog *access_log_open(const char *path, int rings, const char **err);
+
+// Ring 'i' (0..rings-1): only one thread may push to it.
+AccessRing *access_log_ring(AccessLog *log, int i);
+
+// Queue a record. Returns 0 if the ring was full and the record is dropped.
+int access_log_push(AccessRing *r, const AccessRecord *rec);
+
+// Ask the writer thread to reopen the file by its name (after log rotation
+// moved it away). Safe from any thread; no-op for standard output or NULL.
+void access_log_reopen(AccessLog *log);
+
+// Write everything still queued, stop the thread, close the file.
+void access_log_close(AccessLog *log);
+
+#endif
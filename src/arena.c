@@ -0,0 +1,42 @@
+// Arena allocator (see arena.h).
+#include "arena.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ARENA_ALIGN 8
+
+void arena_init(Arena *a, void *buf, size_t cap) {
+    a->base = buf;
+    a->cap = cap;
+    a->used = 0;
+}
+
+void *arena_alloc(Arena *a, size_t n) {
+    size_t start = (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (start > a->cap || n > a->cap - start) return NULL;
+    a->used = start + n;
+    return a->base + start;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t n) {
+    char *out = arena_alloc(a, n + 1);
+    if (!out) return NULL;
+    memcpy(out, s, n);
+    out[n] = '\0';
+    return out;
+}
+
+char *arena_printf(Arena *a, size_t *len, const char *fmt, ...) {
+    size_t start = (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (start >= a->cap) return NULL;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(a->base + start, a->cap - start, fmt, ap);   // format in place, no copy
+    va_end(ap);
+    if (n < 0 || (size_t)n >= a->cap - start) return NULL;           // truncated: not enough room
+    a->used = start + (size_t)n + 1;
+    if (len) *len = (size_t)n;
+    return a->base + start;
+}
@@ -0,0 +1,32 @@
+// Arena (bump) allocator over a caller-provided buffer.
+// Allocation just moves a pointer forward; nothing is freed individually.
+// arena_reset() releases everything at once, so request-scoped data (decoded
+// query values, response bodies) costs no malloc/free at all.
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct {
+    char *base;     // start of the buffer
+    size_t cap;     // its size in bytes
+    size_t used;    // bytes handed out so far
+} Arena;
+
+void arena_init(Arena *a, void *buf, size_t cap);
+
+// Forget every allocation (the memory is reused by the next ones).
+static inline void arena_reset(Arena *a) { a->used = 0; }
+
+// n bytes aligned for any basic type, or NULL if the arena is full.
+void *arena_alloc(Arena *a, size_t n);
+
+// NUL-terminated copy of s[0..n), or NULL if the arena is full.
+char *arena_strndup(Arena *a, const char *s, size_t n);
+
+// printf into the arena. Returns the string (length in *len if not NULL), or
+// NULL if the result does not fit in the space left.
+char *arena_printf(Arena *a, size_t *len, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif
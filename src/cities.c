@@ -0,0 +1,374 @@
+// City database builder and name index.
+// Layout: an array of 32-byte CityRecord, one string pool with display names
+// and normalized keys, and an open-addressing (linear probing) hash table.
+// The table is kept at most half full, so a lookup is one hash plus, on
+// average, a single probe and a single memcmp.
+// Coordinates are indexed by a static k-d tree stored as a plain array
+// (no child pointers), built once by recursive median selection.
+#include "cities.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define EARTH_RADIUS_KM 6371.0088
+#define DEG_TO_RAD (3.14159265358979323846 / 180.0)
+
+// ASCII folding for U+00C0..U+017F (Latin-1 Supplement + Latin Extended-A),
+// indexed by code point - 0xC0. NULL = keep the character as it is.
+static const char *const LATIN_FOLD[0x180 - 0xC0] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i", // U+00C0
+    "d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u", "u", "y", "th", "ss", // U+00D0
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i", // U+00E0
+    "d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u", "u", "y", "th", "y", // U+00F0
+    "a", "a", "a", "a", "a", "a", "c", "c", "c", "c", "c", "c", "c", "c", "d", "d", // U+0100
+    "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g", // U+0110
+    "g", "g", "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i", // U+0120
+    "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l", // U+0130
+    "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o", // U+0140
+    "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r", "s", "s", "s", "s", "s", "s", // U+0150
+    "s", "s", "t", "t", "t", "t", "t", "t", "u", "u", "u", "u", "u", "u", "u", "u", // U+0160
+    "u", "u", "u", "u", "w", "w", "y", "y", "y", "z", "z", "z", "z", "z", "z", "s", // U+0170
+};
+
+int city_normalize(const char *name, size_t len, char *out, size_t outlen) {
+    const unsigned char *p = (const unsigned char *)name;
+    const unsigned char *end = p + len;
+    while (p < end && *p == ' ') p++;                 // trim leading spaces
+    while (end > p && end[-1] == ' ') end--;          // ...and trailing ones
+    size_t o = 0;
+    while (p < end) {
+        const char *fold = NULL;
+        size_t in = 1;                                // input bytes consumed
+        if (*p < 0x80) {
+            char ch = (char)((*p >= 'A' && *p <= 'Z') ? *p + ('a' - 'A') : *p);
+            if (o + 1 >= outlen) return -1;
+            out[o++] = ch;
+            p++;
+            continue;
+        }
+        // Two-byte UTF-8 sequence for U+00C0..U+017F: C3 80..C5 BF
+        if (p + 1 < end && *p >= 0xC3 && *p <= 0xC5 && (p[1] & 0xC0) == 0x80) {
+            unsigned cp = ((unsigned)(*p & 0x1F) << 6) | (p[1] & 0x3F);
+            if (cp >= 0xC0) fold = LATIN_FOLD[cp - 0xC0];
+            in = 2;
+        }
+        if (fold) {
+            size_t flen = strlen(fold);
+            if (o + flen >= outlen) return -1;
+            memcpy(out + o, fold, flen);
+            o += flen;
+        } else {                                      // other characters are copied byte for byte
+            if (o + in >= outlen) return -1;
+            memcpy(out + o, p, in);
+            o += in;
+        }
+        p += in;
+    }
+    out[o] = '\0';
+    return (int)o;
+}
+
+// FNV-1a: short keys, good spread, no dependencies.
+static uint32_t hash_key(const char *key, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void city_db_free(CityDb *db) {
+    if (db->map) {                                    // arrays live inside the mapping
+        munmap(db->map, db->map_len);
+    } else {
+        free(db->records);
+        free(db->pool);
+        free(db->slots);
+        free(db->kd);
+    }
+    memset(db, 0, sizeof(*db));
+}
+
+// Append a NUL-terminated string to the pool and return its offset.
+static uint32_t pool_add(CityDb *db, const char *s, size_t len) {
+    uint32_t off = (uint32_t)db->pool_len;
+    memcpy(db->pool + db->pool_len, s, len);
+    db->pool[db->pool_len + len] = '\0';
+    db->pool_len += len + 1;
+    return off;
+}
+
+// lat/lon in degrees → point on the unit sphere
+static void to_unit_vector(double lat, double lon, float out[3]) {
+    double la = lat * DEG_TO_RAD, lo = lon * DEG_TO_RAD;
+    out[0] = (float)(cos(la) * cos(lo));
+    out[1] = (float)(cos(la) * sin(lo));
+    out[2] = (float)sin(la);
+}
+
+// Reorder nodes[lo, hi) so the median along 'axis' sits at (lo + hi) / 2,
+// smaller values before it and larger ones after it (quickselect).
+static void kd_select(CityKdNode *nodes, size_t lo, size_t hi, int axis) {
+    size_t k = (lo + hi) / 2;
+    while (hi - lo > 1) {
+        float pivot = nodes[lo + (hi - lo) / 2].xyz[axis];
+        size_t i = lo, j = hi - 1;
+        while (i <= j) {                              // Hoare partition around 'pivot'
+            while (nodes[i].xyz[axis] < pivot) i++;
+            while (nodes[j].xyz[axis] > pivot) j--;
+            if (i <= j) {
+                CityKdNode t = nodes[i]; nodes[i] = nodes[j]; nodes[j] = t;
+                i++;
+                if (j == 0) break;
+                j--;
+            }
+        }
+        if (k <= j) hi = j + 1;                       // median is in the left part
+        else if (k >= i) lo = i;                      // ...or in the right part
+        else return;                                  // ...or between them: done
+    }
+}
+
+static void kd_build(CityKdNode *nodes, size_t lo, size_t hi, int depth) {
+    if (hi - lo < 2) return;
+    int axis = depth % 3;
+    kd_select(nodes, lo, hi, axis);
+    size_t mid = (lo + hi) / 2;
+    kd_build(nodes, lo, mid, depth + 1);
+    kd_build(nodes, mid + 1, hi, depth + 1);
+}
+
+int city_db_build(CityDb *db, const City *cities, size_t n) {
+    memset(db, 0, sizeof(*db));
+    // A key is never longer than its name (every folded 2-byte UTF-8 letter
+    // becomes at most 2 ASCII letters), so twice the name bytes is enough.
+    size_t pool_cap = 0;
+    for (size_t i = 0; i < n; i++) pool_cap += 2 * (strlen(cities[i].city) + 1);
+    uint32_t slots = 16;
+    while (slots < 2 * n) slots <<= 1;                // load factor <= 0.5
+
+    db->records = calloc(n ? n : 1, sizeof(CityRecord));
+    db->pool = malloc(pool_cap ? pool_cap : 1);
+    db->slots = calloc(slots, sizeof(CitySlot));
+    if (!db->records || !db->pool || !db->slots) { city_db_free(db); return -1; }
+    db->mask = slots - 1;
+
+    char key[CITY_KEY_MAX];
+    for (size_t i = 0; i < n; i++) {
+        const City *src = &cities[i];
+        size_t nlen = strlen(src->city);
+        int klen = city_normalize(src->city, nlen, key, sizeof(key));
+        if (klen <= 0) continue;                      // unindexable (empty or absurdly long) name
+        uint32_t idx = (uint32_t)db->count++;
+        CityRecord *r = &db->records[idx];
+        r->lat = src->lat;
+        r->lon = src->lon;
+        r->population = src->population;
+        strncpy(r->country, src->country, sizeof(r->country) - 1);
+        r->name = pool_add(db, src->city, nlen);
+        r->key = pool_add(db, key, (size_t)klen);
+
+        // Insert into the name index. Several places can share a name
+        // ("Springfield"): the index points at the most populous one, the
+        // others stay reachable by coordinates.
+        uint32_t h = hash_key(key, (size_t)klen);
+        uint32_t at = h & db->mask;
+        while (db->slots[at].city) {
+            const CityRecord *other = &db->records[db->slots[at].city - 1];
+            if (db->slots[at].hash == h && strcmp(db->pool + other->key, key) == 0) break;
+            at = (at + 1) & db->mask;
+        }
+        if (db->slots[at].city && db->records[db->slots[at].city - 1].population >= r->population) {
+            continue;                                 // the earlier, bigger city keeps the name
+        }
+        db->slots[at].hash = h;
+        db->slots[at].city = idx + 1;
+    }
+
+    // Spatial index over all records
+    db->kd = malloc((db->count ? db->count : 1) * sizeof(CityKdNode));
+    if (!db->kd) { city_db_free(db); return -1; }
+    for (size_t i = 0; i < db->count; i++) {
+        to_unit_vector(db->records[i].lat, db->records[i].lon, db->kd[i].xyz);
+        db->kd[i].city = (uint32_t)i;
+    }
+    db->kd_count = db->count;
+    kd_build(db->kd, 0, db->kd_count, 0);
+    return 0;
+}
+
+const CityRecord *city_db_find_name(const CityDb *db, const char *name, size_t len) {
+    char key[CITY_KEY_MAX];
+    int klen = city_normalize(name, len, key, sizeof(key));
+    if (klen <= 0 || !db->slots) return NULL;
+    uint32_t h = hash_key(key, (size_t)klen);
+    for (uint32_t at = h & db->mask; db->slots[at].city; at = (at + 1) & db->mask) {
+        if (db->slots[at].hash != h) continue;        // cheap reject without touching the record
+        const CityRecord *r = &db->records[db->slots[at].city - 1];
+        if (memcmp(db->pool + r->key, key, (size_t)klen + 1) == 0) return r;
+    }
+    return NULL;
+}
+
+// Nearest-neighbour search state shared by the recursion
+typedef struct {
+    const CityKdNode *nodes;
+    float q[3];            // query point on the unit sphere
+    float best_d2;         // squared chord distance to beat
+    int best;              // kd node index of the best match, -1 = none yet
+} KdSearch;
+
+// Descend the near side in a loop and recurse only into far sides that
+// might still contain something closer than the best match so far.
+static void kd_search(KdSearch *s, size_t lo, size_t hi, int depth) {
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const CityKdNode *n = &s->nodes[mid];
+        float dx = n->xyz[0] - s->q[0], dy = n->xyz[1] - s->q[1], dz = n->xyz[2] - s->q[2];
+        float d2 = dx * dx + dy * dy + dz * dz;
+        if (d2 < s->best_d2) { s->best_d2 = d2; s->best = (int)mid; }
+        int axis = depth % 3;
+        float diff = s->q[axis] - n->xyz[axis];
+        depth++;
+        // Visit the side containing the query first; the other side can only
+        // hold a closer city if the splitting plane is closer than the best.
+        if (diff < 0) {
+            if (diff * diff < s->best_d2) kd_search(s, mid + 1, hi, depth);
+            hi = mid;
+        } else {
+            if (diff * diff < s->best_d2) kd_search(s, lo, mid, depth);
+            lo = mid + 1;
+        }
+    }
+}
+
+const CityRecord *city_db_nearest(const CityDb *db, double lat, double lon, double radius_km, double *dist_km) {
+    if (!db->kd_count || radius_km <= 0) return NULL;
+    double angle = radius_km / EARTH_RADIUS_KM;       // radius as an angle (radians)
+    if (angle > 3.14159265358979323846) angle = 3.14159265358979323846;
+    double chord = 2.0 * sin(angle / 2.0);            // ...and as a straight line through the globe
+    KdSearch s = { db->kd, {0, 0, 0}, (float)(chord * chord), -1 };
+    to_unit_vector(lat, lon, s.q);
+    kd_search(&s, 0, db->kd_count, 0);
+    if (s.best < 0) return NULL;
+    const CityRecord *r = &db->records[db->kd[s.best].city];
+    if (dist_km) {                                    // exact distance via the haversine formula
+        double p1 = lat * DEG_TO_RAD, p2 = r->lat * DEG_TO_RAD;
+        double dp = p2 - p1, dl = (r->lon - lon) * DEG_TO_RAD;
+        double a = sin(dp / 2) * sin(dp / 2) + cos(p1) * cos(p2) * sin(dl / 2) * sin(dl / 2);
+        *dist_km = 2.0 * EARTH_RADIUS_KM * asin(sqrt(a > 1.0 ? 1.0 : a));
+    }
+    return r;
+}
+
+// Round up to the next multiple of 64 (one cache line)
+static uint64_t align64(uint64_t n) {
+    return (n + 63) & ~(uint64_t)63;
+}
+
+// Write 'len' bytes at 'off', padding the gap since the previous section with zeros.
+static int write_section(FILE *f, uint64_t *pos, uint64_t off, const void *data, size_t len) {
+    static const char zeros[64];
+    while (*pos < off) {
+        size_t pad = (size_t)(off - *pos < sizeof(zeros) ? off - *pos : sizeof(zeros));
+        if (fwrite(zeros, 1, pad, f) != pad) return -1;
+        *pos += pad;
+    }
+    if (len && fwrite(data, 1, len, f) != len) return -1;
+    *pos += len;
+    return 0;
+}
+
+int city_db_write(const CityDb *db, const char *path) {
+    CityFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CITY_FILE_MAGIC, sizeof(h.magic));
+    h.endian = CITY_FILE_ENDIAN;
+    h.mask = db->mask;
+    h.count = db->count;
+    h.pool_len = db->pool_len;
+    h.kd_count = db->kd_count;
+    h.records_off = align64(sizeof(h));
+    h.pool_off = align64(h.records_off + h.count * sizeof(CityRecord));
+    h.slots_off = align64(h.pool_off + h.pool_len);
+    h.kd_off = align64(h.slots_off + ((uint64_t)h.mask + 1) * sizeof(CitySlot));
+    h.file_size = h.kd_off + h.kd_count * sizeof(CityKdNode);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    uint64_t pos = 0;
+    int rc = write_section(f, &pos, 0, &h, sizeof(h));
+    if (rc == 0) rc = write_section(f, &pos, h.records_off, db->records, h.count * sizeof(CityRecord));
+    if (rc == 0) rc = write_section(f, &pos, h.pool_off, db->pool, h.pool_len);
+    if (rc == 0) rc = write_section(f, &pos, h.slots_off, db->slots, ((size_t)h.mask + 1) * sizeof(CitySlot));
+    if (rc == 0) rc = write_section(f, &pos, h.kd_off, db->kd, h.kd_count * sizeof(CityKdNode));
+    if (fclose(f) != 0) rc = -1;
+    return rc;
+}
+
+// Does [off, off + len) fit inside a file of 'size' bytes?
+static int section_ok(uint64_t off, uint64_t len, uint64_t size) {
+    return off % 64 == 0 && off <= size && len <= size - off;
+}
+
+int city_db_open(CityDb *db, const char *path, const char **err) {
+    memset(db, 0, sizeof(*db));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { *err = strerror(errno); return -1; }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CityFileHeader)) {
+        close(fd);
+        *err = "file too small";
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);                                        // the mapping stays valid without the fd
+    if (map == MAP_FAILED) { *err = strerror(errno); return -1; }
+
+    const CityFileHeader *h = map;
+    const char *base = map;
+    *err = NULL;
+    if (memcmp(h->magic, CITY_FILE_MAGIC, sizeof(h->magic)) != 0) *err = "bad magic (not a city file)";
+    else if (h->endian != CITY_FILE_ENDIAN) *err = "written on a machine with a different byte order";
+    else if (h->file_size != size) *err = "truncated file";
+    else if (((uint64_t)h->mask & ((uint64_t)h->mask + 1)) != 0 || h->count >= h->mask) *err = "bad hash index size";
+    else if (h->kd_count != h->count) *err = "bad k-d tree size";
+    else if (!section_ok(h->records_off, h->count * sizeof(CityRecord), size)
+             || !section_ok(h->pool_off, h->pool_len, size)
+             || !section_ok(h->slots_off, ((uint64_t)h->mask + 1) * sizeof(CitySlot), size)
+             || !section_ok(h->kd_off, h->kd_count * sizeof(CityKdNode), size)) *err = "bad section offsets";
+    else if (h->pool_len == 0 || base[h->pool_off + h->pool_len - 1] != '\0') *err = "bad string pool";
+    if (*err) { munmap(map, size); return -1; }
+
+    db->records = (CityRecord *)(void *)(base + h->records_off);
+    db->count = (size_t)h->count;
+    db->pool = (char *)(base + h->pool_off);
+    db->pool_len = (size_t)h->pool_len;
+    db->slots = (CitySlot *)(void *)(base + h->slots_off);
+    db->mask = h->mask;
+    db->kd = (CityKdNode *)(void *)(base + h->kd_off);
+    db->kd_count = (size_t)h->kd_count;
+    db->map = map;
+    db->map_len = size;
+
+    // Every stored offset/index must stay inside its section, otherwise a
+    // damaged file could make lookups read outside the mapping.
+    for (size_t i = 0; i < db->count && !*err; i++) {
+        if (db->records[i].name >= db->pool_len || db->records[i].key >= db->pool_len) *err = "bad record";
+        if (db->kd[i].city >= db->count) *err = "bad k-d tree node";
+    }
+    for (size_t i = 0; i <= db->mask && !*err; i++) {
+        if (db->slots[i].city > db->count) *err = "bad hash slot";
+    }
+    if (*err) { city_db_free(db); return -1; }
+    return 0;
+}
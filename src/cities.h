@@ -0,0 +1,118 @@
+// City database: compact fixed-size records, one string pool, an
+// open-addressing hash index on the normalized city name, and a static
+// k-d tree for nearest-city-by-coordinates queries.
+// Built once at startup and read-only afterwards, so every worker thread can
+// use it without locks.
+#ifndef CITIES_H
+#define CITIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One city as given by a data source (e.g., the compiled-in demo list).
+typedef struct {
+    const char *city;      // City display name, e.g., "Malmo" (UTF-8)
+    const char *country;   // Two-letter country code, e.g., "SE"
+    double lat;            // Latitude (decimal degrees)
+    double lon;            // Longitude (decimal degrees)
+    uint32_t population;   // breaks ties between cities with the same name (0 = unknown)
+} City;
+
+// Stored form of a city: 32 bytes, no pointers (offsets into the string pool),
+// so two records share one cache line and the table can be written to disk.
+typedef struct {
+    double lat;
+    double lon;
+    uint32_t name;         // offset of the display name in the string pool
+    uint32_t key;          // offset of the normalized name (hash key) in the pool
+    uint32_t population;
+    char country[4];       // "SE\0\0"
+} CityRecord;
+
+// Hash index slot: the full hash lets probes skip most string compares.
+typedef struct {
+    uint32_t hash;
+    uint32_t city;         // record index + 1 (0 = empty slot)
+} CitySlot;
+
+// k-d tree node: the city's position as a point on the unit sphere.
+// Straight-line (chord) distance between such points grows monotonically
+// with great-circle distance, so an ordinary 3-D k-d tree finds the nearest
+// city on the globe — no special cases at the poles or the date line.
+typedef struct {
+    float xyz[3];
+    uint32_t city;         // record index
+} CityKdNode;
+
+typedef struct {
+    CityRecord *records;   // 'count' records
+    size_t count;
+    char *pool;            // NUL-terminated strings referenced by the records
+    size_t pool_len;
+    CitySlot *slots;       // hash index, 'mask + 1' slots (a power of two)
+    uint32_t mask;
+    CityKdNode *kd;        // implicit balanced tree: the root of [lo, hi) is at (lo + hi) / 2
+    size_t kd_count;
+    void *map;             // set when the arrays above point into an mmap()ed city file
+    size_t map_len;
+} CityDb;
+
+// On-disk city file ("mkcities" writes it, city_db_open() maps it):
+// this header, then the records, string pool, hash slots and k-d nodes exactly
+// as they are laid out in memory, each section 64-byte aligned.
+#define CITY_FILE_MAGIC "WXCITY01"
+#define CITY_FILE_ENDIAN 0x01020304u   // written in host order: detects foreign byte order
+
+typedef struct {
+    char magic[8];
+    uint32_t endian;
+    uint32_t mask;         // hash index mask (slots = mask + 1)
+    uint64_t count;        // records
+    uint64_t pool_len;     // string pool bytes
+    uint64_t kd_count;     // k-d tree nodes
+    uint64_t records_off;  // section offsets from the start of the file
+    uint64_t pool_off;
+    uint64_t slots_off;
+    uint64_t kd_off;
+    uint64_t file_size;
+} CityFileHeader;
+
+// Longest normalized name we index (longer lookups simply miss).
+#define CITY_KEY_MAX 256
+
+// Build the database from 'n' input cities. Returns 0, or -1 on out of memory.
+int city_db_build(CityDb *db, const City *cities, size_t n);
+void city_db_free(CityDb *db);
+
+// Save a built database as a city file. Returns 0, or -1 (errno set).
+int city_db_write(const CityDb *db, const char *path);
+
+// Map a city file read-only; nothing is parsed or copied, so this takes
+// about the same time for 5 or 500,000 cities, and every process using the
+// file shares the same page-cache pages. Returns 0, or -1 with a reason in
+// 'err' (e.g., "bad magic").
+int city_db_open(CityDb *db, const char *path, const char **err);
+
+// Case-insensitive, accent-insensitive lookup: "Malmö", "MALMO" and "malmo"
+// all find the same record. Returns NULL when the name is unknown.
+const CityRecord *city_db_find_name(const CityDb *db, const char *name, size_t len);
+
+// Nearest city to lat/lon within radius_km (great-circle distance), in
+// O(log n) on average. Returns NULL when nothing is that close; if dist_km is
+// not NULL it receives the distance of the match.
+const CityRecord *city_db_nearest(const CityDb *db, double lat, double lon, double radius_km, double *dist_km);
+
+// Fold 'name' into its lookup key: lower-case ASCII, Latin accents removed
+// (ö → o, ß → ss, ł → l), surrounding spaces trimmed. Writes at most
+// outlen - 1 bytes plus '\0' and returns the key length, or -1 if it is too long.
+int city_normalize(const char *name, size_t len, char *out, size_t outlen);
+
+static inline const char *city_db_name(const CityDb *db, const CityRecord *r) {
+    return db->pool + r->name;
+}
+
+static inline size_t city_db_index(const CityDb *db, const CityRecord *r) {
+    return (size_t)(r - db->records);
+}
+
+#endif
@@ -0,0 +1,204 @@
+// Accept-Encoding negotiation and the gzip/brotli encoders (see compress.h).
+#include "compress.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#define GZIP_LEVEL 5            // zlib's speed/size sweet spot for small JSON bodies
+#define BROTLI_QUALITY 5        // likewise for brotli (11 is for precompressing files)
+#define BROTLI_WINDOW 18        // 256 KB: our bodies are far smaller, so bigger windows only cost memory
+#define POOL_BLOCKS 16          // brotli allocations kept for the next response
+
+static const unsigned SUPPORTED = 0
+#ifdef HAVE_ZLIB
+    | ENCODING_GZIP
+#endif
+#ifdef HAVE_BROTLI
+    | ENCODING_BROTLI
+#endif
+    ;
+
+// A block the brotli encoder allocated, kept for the next encoder instance
+// (brotli has no reset, so every response creates one; with the pool the
+// hash tables it needs come back without touching malloc).
+typedef struct {
+    void *ptr;
+    size_t size;
+    int in_use;
+} PoolBlock;
+
+struct Compressor {
+#ifdef HAVE_ZLIB
+    z_stream gz;                // initialized once, deflateReset() per response
+    int gz_ready;
+#endif
+    PoolBlock pool[POOL_BLOCKS];
+};
+
+Compressor *compressor_create(void) {
+    Compressor *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+#ifdef HAVE_ZLIB
+    // windowBits 15 + 16: gzip framing instead of a raw zlib stream
+    c->gz_ready = deflateInit2(&c->gz, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+#endif
+    return c;
+}
+
+void compressor_destroy(Compressor *c) {
+    if (!c) return;
+#ifdef HAVE_ZLIB
+    if (c->gz_ready) deflateEnd(&c->gz);
+#endif
+    for (int i = 0; i < POOL_BLOCKS; i++) free(c->pool[i].ptr);
+    free(c);
+}
+
+// Is a "q=..." weight zero ("0", "0.0", "0.000")?
+static int q_is_zero(const char *p, const char *end) {
+    if (p == end || *p != '0') return 0;
+    for (p++; p < end && (*p == '.' || *p == '0'); p++) {}
+    return p == end || *p == ' ' || *p == '\t' || *p == ';';
+}
+
+unsigned compress_accepted(StrView accept_encoding) {
+    unsigned accept = 0, reject = 0;
+    int any = 0;                                    // "*" with a non-zero weight
+    const char *p = accept_encoding.ptr, *end = p + accept_encoding.len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char *name = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        size_t len = (size_t)(p - name);
+        int zero = 0;
+        while (p < end && *p != ',') {              // parameters: only q matters
+            if ((*p == 'q' || *p == 'Q') && p + 1 < end && p[1] == '=') {
+                const char *v = p + 2, *vend = v;
+                while (vend < end && *vend != ',' && *vend != ';') vend++;
+                zero = q_is_zero(v, vend);
+                p = vend;
+            } else {
+                p++;
+            }
+        }
+        unsigned bit = 0;
+        if ((len == 4 && strncasecmp(name, "gzip", 4) == 0) || (len == 6 && strncasecmp(name, "x-gzip", 6) == 0)) {
+            bit = ENCODING_GZIP;
+        } else if (len == 2 && strncasecmp(name, "br", 2) == 0) {
+            bit = ENCODING_BROTLI;
+        } else if (len == 1 && *name == '*') {
+            any = !zero;
+        }
+        if (zero) reject |= bit;
+        else accept |= bit;
+    }
+    if (any) accept |= ENCODING_GZIP | ENCODING_BROTLI;
+    return accept & ~reject & SUPPORTED;
+}
+
+ContentEncoding compress_choose(unsigned accepted, size_t len) {
+    if (len < COMPRESS_MIN_SIZE) return ENCODING_IDENTITY;
+    if (accepted & ENCODING_BROTLI) return ENCODING_BROTLI;     // ~15% smaller than gzip on JSON
+    if (accepted & ENCODING_GZIP) return ENCODING_GZIP;
+    return ENCODING_IDENTITY;
+}
+
+const char *compress_name(ContentEncoding enc) {
+    return enc == ENCODING_BROTLI ? "br" : enc == ENCODING_GZIP ? "gzip" : "identity";
+}
+
+const char *compress_support(void) {
+    switch (SUPPORTED) {
+    case ENCODING_GZIP | ENCODING_BROTLI: return "br+gzip";
+    case ENCODING_GZIP: return "gzip";
+    case ENCODING_BROTLI: return "br";
+    default: return "off";
+    }
+}
+
+#ifdef HAVE_ZLIB
+static char *gzip_body(Compressor *c, const char *in, size_t len, size_t *out_len) {
+    if (!c->gz_ready || deflateReset(&c->gz) != Z_OK) return NULL;
+    size_t room = deflateBound(&c->gz, (uLong)len);
+    char *out = malloc(room);
+    if (!out) return NULL;
+    c->gz.next_in = (Bytef *)in;
+    c->gz.avail_in = (uInt)len;
+    c->gz.next_out = (Bytef *)out;
+    c->gz.avail_out = (uInt)room;
+    if (deflate(&c->gz, Z_FINISH) != Z_STREAM_END) { free(out); return NULL; }
+    *out_len = room - c->gz.avail_out;
+    return out;
+}
+#endif
+
+#ifdef HAVE_BROTLI
+// Allocator for the brotli encoder: a free pooled block of the same size
+// if there is one, else malloc (and keep it if the pool has room).
+static void *pool_alloc(void *opaque, size_t size) {
+    Compressor *c = opaque;
+    PoolBlock *empty = NULL;
+    for (int i = 0; i < POOL_BLOCKS; i++) {
+        PoolBlock *b = &c->pool[i];
+        if (b->ptr && !b->in_use && b->size == size) { b->in_use = 1; return b->ptr; }
+        if (!b->ptr && !empty) empty = b;
+    }
+    void *p = malloc(size);
+    if (p && empty) *empty = (PoolBlock){ p, size, 1 };
+    return p;
+}
+
+static void pool_free(void *opaque, void *ptr) {
+    Compressor *c = opaque;
+    if (!ptr) return;
+    for (int i = 0; i < POOL_BLOCKS; i++) {
+        if (c->pool[i].ptr == ptr) { c->pool[i].in_use = 0; return; }
+    }
+    free(ptr);                                      // did not fit in the pool
+}
+
+static char *brotli_body(Compressor *c, const char *in, size_t len, size_t *out_len) {
+    BrotliEncoderState *s = BrotliEncoderCreateInstance(pool_alloc, pool_free, c);
+    if (!s) return NULL;
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, BROTLI_QUALITY);
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, BROTLI_WINDOW);
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_SIZE_HINT, (uint32_t)len);
+    size_t room = BrotliEncoderMaxCompressedSize(len);
+    char *out = room ? malloc(room) : NULL;
+    const uint8_t *next_in = (const uint8_t *)in;
+    uint8_t *next_out = (uint8_t *)out;
+    size_t avail_in = len, avail_out = room;
+    int ok = out && BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH, &avail_in, &next_in,
+                                                &avail_out, &next_out, NULL)
+                 && BrotliEncoderIsFinished(s);
+    BrotliEncoderDestroyInstance(s);
+    if (!ok) { free(out); return NULL; }
+    *out_len = room - avail_out;
+    return out;
+}
+#endif
+
+char *compress_body(Compressor *c, ContentEncoding enc, const char *in, size_t len, size_t *out_len) {
+    char *out = NULL;
+#ifdef HAVE_ZLIB
+    if (enc == ENCODING_GZIP) out = gzip_body(c, in, len, out_len);
+#endif
+#ifdef HAVE_BROTLI
+    if (enc == ENCODING_BROTLI) out = brotli_body(c, in, len, out_len);
+#endif
+    (void)c; (void)enc; (void)in; (void)len;
+    if (out && *out_len >= len) {                   // incompressible: not worth a Content-Encoding
+        free(out);
+        out = NULL;
+    }
+    return out;
+}
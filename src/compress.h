@@ -0,0 +1,49 @@
+// Response compression: Accept-Encoding negotiation plus gzip (zlib) and
+// brotli (libbrotlienc) encoders. Both libraries are optional: the Makefile
+// enables what it finds (HAVE_ZLIB, HAVE_BROTLI), and without them every
+// response simply goes out uncompressed.
+// A Compressor belongs to one worker thread and is reused for every
+// response, so compressing allocates no encoder state per request.
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+
+#include "http_parser.h"
+
+// Bodies smaller than this are sent as they are: compressing them saves a
+// few bytes of a packet at the cost of CPU time on both ends.
+#define COMPRESS_MIN_SIZE 1024
+
+// Content codings as bits (what a client accepts).
+typedef enum {
+    ENCODING_IDENTITY = 0,
+    ENCODING_GZIP = 1 << 0,
+    ENCODING_BROTLI = 1 << 1
+} ContentEncoding;
+
+typedef struct Compressor Compressor;
+
+// NULL if out of memory.
+Compressor *compressor_create(void);
+void compressor_destroy(Compressor *c);
+
+// The codings an Accept-Encoding value allows that this build supports
+// ("gzip, deflate, br" → ENCODING_GZIP | ENCODING_BROTLI; "br;q=0" → 0).
+unsigned compress_accepted(StrView accept_encoding);
+
+// The coding to use for a 'len'-byte body: brotli, else gzip, else identity
+// (also for bodies below COMPRESS_MIN_SIZE).
+ContentEncoding compress_choose(unsigned accepted, size_t len);
+
+// "br", "gzip"
+const char *compress_name(ContentEncoding enc);
+
+// Compress in[0..len) with 'enc'. Returns a malloc'd buffer (size in
+// *out_len), or NULL if that failed or would not be smaller than the input.
+char *compress_body(Compressor *c, ContentEncoding enc, const char *in, size_t len, size_t *out_len);
+
+// What this build can do, for the startup banner ("br+gzip", "gzip", "off").
+const char *compress_support(void);
+
+#endif
@@ -0,0 +1,350 @@
+// Option table, config file / environment / command-line parsing (see config.h).
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "event_loop.h"
+#include "rate_limit.h"
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+#define LINE_MAX_LEN 1024               // longest config file line
+
+typedef enum {
+    OPT_STRING,
+    OPT_CHOICE,                         // a string out of 'arg' ("demo|open-meteo")
+    OPT_LONG,
+    OPT_LONG_ALL,                       // a number, or "all" (stored as -1)
+    OPT_DOUBLE,
+    OPT_BOOL                            // on/off, yes/no, true/false, 1/0 (stored as 1/0)
+} OptKind;
+
+typedef struct {
+    const char *name;                   // "cache-ttl": --cache-ttl, WEATHER_CACHE_TTL, "cache-ttl 300"
+    OptKind kind;
+    size_t offset;                      // of the field in Config
+    double min, max;                    // OPT_LONG*, OPT_DOUBLE
+    int reload;                         // applied again on SIGHUP
+    const char *arg;                    // value placeholder in the usage text
+    const char *help;
+} Option;
+
+#define F(field) offsetof(Config, field)
+static const Option OPTIONS[] = {
+    { "config", OPT_STRING, F(config), 0, 0, 0, "FILE",
+      "read settings from FILE (\"name value\" lines) first" },
+    { "bind", OPT_STRING, F(bind), 0, 0, 0, "ADDR",
+      "address to listen on (default " CONFIG_BIND " = IPv6 and IPv4; 0.0.0.0 = IPv4 only)" },
+    { "port", OPT_LONG, F(port), 1, 65535, 0, "N", "TCP port (default " STR(CONFIG_PORT) ")" },
+    { "workers", OPT_LONG, F(workers), 0, CONFIG_MAX_WORKERS, 0, "N",
+      "worker threads with their own socket and loop (default 1, 0 = one per CPU)" },
+    { "backlog", OPT_LONG, F(backlog), 1, 65535, 1, "N",
+      "connections queued by the kernel until accepted (default " STR(CONFIG_BACKLOG) ")" },
+    { "tcp-nodelay", OPT_BOOL, F(tcp_nodelay), 0, 1, 1, "on|off",
+      "send responses without Nagle delay (default on)" },
+    { "tcp-defer-accept", OPT_LONG, F(tcp_defer_accept), 0, 3600, 1, "SEC",
+      "accept only once the request arrives, waiting up to SEC (Linux; 0 = off)" },
+    { "tcp-fastopen", OPT_LONG, F(tcp_fastopen), 0, 65535, 1, "N",
+      "TCP Fast Open queue length (default 0 = off)" },
+    { "event-loop", OPT_CHOICE, F(event_loop), 0, 0, 0, EV_LOOP_BACKENDS,
+      "how workers wait for sockets (default " EV_LOOP_DEFAULT "; io_uring: Linux 5.19+)" },
+    { "read-buffer", OPT_LONG, F(read_buffer), 1024, 1 << 20, 0, "BYTES",
+      "per connection: longest request accepted (default " STR(CONFIG_READ_BUFFER) ")" },
+    { "write-buffer", OPT_LONG, F(write_buffer), 4096, 1 << 20, 0, "BYTES",
+      "per connection: response bytes queued at once (default " STR(CONFIG_WRITE_BUFFER) ")" },
+    { "keepalive-timeout", OPT_LONG, F(keepalive_timeout), 100, 3600000, 1, "MS",
+      "close connections idle for this long (default " STR(CONFIG_KEEPALIVE_MS) ")" },
+    { "keepalive-requests", OPT_LONG, F(keepalive_requests), 1, 100000000, 1, "N",
+      "close a connection after N requests (default " STR(CONFIG_KEEPALIVE_REQUESTS) ")" },
+    { "max-conns", OPT_LONG, F(max_conns), 0, 100000000, 1, "N",
+      "open connections; more get 503 (default 0 = the fd limit minus 64)" },
+    { "rate-limit", OPT_LONG, F(rate_limit), 0, 100000000, 1, "N",
+      "requests/s per client address; more get 429 (default 0 = off)" },
+    { "rate-burst", OPT_LONG, F(rate_burst), 0, RATE_LIMIT_MAX_BURST, 1, "N",
+      "requests a client may send at once (default 0 = 2 x rate-limit)" },
+    { "drain-timeout", OPT_LONG, F(drain_timeout), 0, 3600000, 1, "MS",
+      "SIGTERM: stop accepting, give open requests this long (default " STR(CONFIG_DRAIN_MS) ")" },
+    { "handoff-socket", OPT_STRING, F(handoff_socket), 0, 0, 0, "PATH",
+      "take over the sockets of the server at PATH, and offer ours there" },
+    { "cities", OPT_STRING, F(cities), 0, 0, 0, "FILE",
+      "city file made by ./mkcities (default: built-in demo cities)" },
+    { "radius-km", OPT_DOUBLE, F(radius_km), 0, 20000, 0, "KM",
+      "how close coordinates must be to a city to use it (default " STR(CONFIG_CITY_RADIUS_KM) ")" },
+    { "provider", OPT_CHOICE, F(provider), 0, 0, 0, "demo|open-meteo",
+      "where weather comes from (default demo)" },
+    { "upstream", OPT_STRING, F(upstream), 0, 0, 0, "HOST[:PORT]",
+      "open-meteo server (default api.open-meteo.com)" },
+    { "cache-size", OPT_LONG, F(cache_size), 1, 100000000, 0, "N",
+      "weather locations kept in memory (default " STR(CONFIG_CACHE_SIZE) ")" },
+    { "cache-ttl", OPT_LONG, F(cache_ttl), 1, 100000000, 1, "SEC",
+      "seconds a cached answer stays fresh (default " STR(CONFIG_CACHE_TTL_SEC) ")" },
+    { "cache-stale", OPT_LONG, F(cache_stale), 0, 100000000, 1, "SEC",
+      "seconds an expired answer is served while refreshed (default " STR(CONFIG_CACHE_STALE_SEC) ")" },
+    { "prefetch", OPT_LONG_ALL, F(prefetch), 0, 100000000, 0, "N|all",
+      "keep the N most populous cities warm in the cache (default 0)" },
+    { "access-log", OPT_STRING, F(access_log), 0, 0, 0, "FILE",
+      "one JSON line per request (- = stdout; SIGHUP reopens FILE)" },
+};
+#define NUM_OPTIONS (sizeof(OPTIONS) / sizeof(OPTIONS[0]))
+
+static void set_err(char *err, size_t err_len, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+static void set_err(char *err, size_t err_len, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(err, err_len, fmt, ap);
+    va_end(ap);
+}
+
+static const Option *find_option(const char *name, size_t len) {
+    for (size_t i = 0; i < NUM_OPTIONS; i++) {
+        if (strlen(OPTIONS[i].name) == len && memcmp(OPTIONS[i].name, name, len) == 0) return &OPTIONS[i];
+    }
+    return NULL;
+}
+
+// Is 'v' one of the '|'-separated words in 'choices'?
+static int is_choice(const char *v, const char *choices) {
+    size_t len = strlen(v);
+    for (const char *p = choices; *p; ) {
+        const char *end = strchr(p, '|');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        if (n == len && memcmp(p, v, n) == 0) return 1;
+        p += n + (end != NULL);
+    }
+    return 0;
+}
+
+// Parse 'v' into the field of 'o'. Returns 0, or -1 with the reason in 'err'.
+static int set_option(Config *c, const Option *o, const char *v, char *err, size_t err_len) {
+    void *field = (char *)c + o->offset;
+    switch (o->kind) {
+    case OPT_CHOICE:
+        if (!is_choice(v, o->arg)) {
+            set_err(err, err_len, "%s: expected %s, not '%s'", o->name, o->arg, v);
+            return -1;
+        }
+        // fall through
+    case OPT_STRING: {
+        char *s = strdup(v);
+        if (!s) { set_err(err, err_len, "out of memory"); return -1; }
+        free(*(char **)field);
+        *(char **)field = s;
+        return 0;
+    }
+    case OPT_LONG_ALL:
+        if (strcmp(v, "all") == 0) { *(long *)field = -1; return 0; }
+        // fall through
+    case OPT_LONG: {
+        char *end;
+        errno = 0;
+        long n = strtol(v, &end, 10);
+        if (end == v || *end || errno || n < o->min || n > o->max) {
+            set_err(err, err_len, "%s: expected a whole number from %.0f to %.0f, not '%s'", o->name,
+                    o->min, o->max, v);
+            return -1;
+        }
+        *(long *)field = n;
+        return 0;
+    }
+    case OPT_DOUBLE: {
+        char *end;
+        double d = strtod(v, &end);
+        if (end == v || *end || !(d >= o->min && d <= o->max)) {
+            set_err(err, err_len, "%s: expected a number from %g to %g, not '%s'", o->name, o->min, o->max, v);
+            return -1;
+        }
+        *(double *)field = d;
+        return 0;
+    }
+    case OPT_BOOL:
+        if (!strcmp(v, "on") || !strcmp(v, "yes") || !strcmp(v, "true") || !strcmp(v, "1")) {
+            *(long *)field = 1;
+        } else if (!strcmp(v, "off") || !strcmp(v, "no") || !strcmp(v, "false") || !strcmp(v, "0")) {
+            *(long *)field = 0;
+        } else {
+            set_err(err, err_len, "%s: expected on or off, not '%s'", o->name, v);
+            return -1;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+static int set_defaults(Config *c) {
+    memset(c, 0, sizeof(*c));
+    c->bind = strdup(CONFIG_BIND);
+    c->provider = strdup("demo");
+    c->event_loop = strdup(EV_LOOP_DEFAULT);
+    c->port = CONFIG_PORT;
+    c->workers = 1;
+    c->backlog = CONFIG_BACKLOG;
+    c->tcp_nodelay = 1;
+    c->read_buffer = CONFIG_READ_BUFFER;
+    c->write_buffer = CONFIG_WRITE_BUFFER;
+    c->keepalive_timeout = CONFIG_KEEPALIVE_MS;
+    c->keepalive_requests = CONFIG_KEEPALIVE_REQUESTS;
+    c->drain_timeout = CONFIG_DRAIN_MS;
+    c->radius_km = CONFIG_CITY_RADIUS_KM;
+    c->cache_size = CONFIG_CACHE_SIZE;
+    c->cache_ttl = CONFIG_CACHE_TTL_SEC;
+    c->cache_stale = CONFIG_CACHE_STALE_SEC;
+    return c->bind && c->provider && c->event_loop ? 0 : -1;
+}
+
+// "name value" or "name = value" lines; '#' starts a comment.
+static int load_file(Config *c, const char *path, char *err, size_t err_len) {
+    FILE *f = fopen(path, "r");
+    if (!f) { set_err(err, err_len, "%s: %s", path, strerror(errno)); return -1; }
+    char line[LINE_MAX_LEN];
+    int lineno = 0, rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        char *end = p + strlen(p);
+        while (end > p && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (!*p) continue;                              // blank or comment
+        char *name = p;
+        while (*p && !isspace((unsigned char)*p) && *p != '=') p++;
+        size_t name_len = (size_t)(p - name);
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '=') p++;
+        while (isspace((unsigned char)*p)) p++;
+        const Option *o = find_option(name, name_len);
+        char msg[256];
+        if (!o || o->offset == F(config)) {
+            set_err(err, err_len, "%s:%d: unknown setting '%.*s'", path, lineno, (int)name_len, name);
+            rc = -1;
+        } else if (!*p) {
+            set_err(err, err_len, "%s:%d: %s needs a value", path, lineno, o->name);
+            rc = -1;
+        } else if (set_option(c, o, p, msg, sizeof(msg)) < 0) {
+            set_err(err, err_len, "%s:%d: %s", path, lineno, msg);
+            rc = -1;
+        }
+    }
+    fclose(f);
+    return rc;
+}
+
+// WEATHER_CACHE_TTL for "cache-ttl".
+static void env_name(const Option *o, char *buf, size_t len) {
+    size_t n = (size_t)snprintf(buf, len, "WEATHER_");
+    for (const char *p = o->name; *p && n + 1 < len; p++) {
+        buf[n++] = *p == '-' ? '_' : (char)toupper((unsigned char)*p);
+    }
+    buf[n] = '\0';
+}
+
+static int load_env(Config *c, char *err, size_t err_len) {
+    for (size_t i = 0; i < NUM_OPTIONS; i++) {
+        char name[64], msg[256];
+        env_name(&OPTIONS[i], name, sizeof(name));
+        const char *v = getenv(name);
+        if (v && set_option(c, &OPTIONS[i], v, msg, sizeof(msg)) < 0) {
+            set_err(err, err_len, "%s: %s", name, msg);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// "--name value" or "--name=value".
+static int load_args(Config *c, int argc, char **argv, char *err, size_t err_len) {
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--help") == 0) return CONFIG_HELP;
+        const char *eq = strchr(a, '=');
+        const Option *o = strncmp(a, "--", 2) == 0
+            ? find_option(a + 2, eq ? (size_t)(eq - a - 2) : strlen(a + 2)) : NULL;
+        if (!o) { set_err(err, err_len, "unknown option '%s'", a); return CONFIG_ERROR; }
+        const char *v = eq ? eq + 1 : i + 1 < argc ? argv[++i] : NULL;
+        if (!v) { set_err(err, err_len, "--%s needs a value", o->name); return CONFIG_ERROR; }
+        char msg[256];
+        if (set_option(c, o, v, msg, sizeof(msg)) < 0) {
+            set_err(err, err_len, "--%s", msg);
+            return CONFIG_ERROR;
+        }
+    }
+    return CONFIG_OK;
+}
+
+// The file named by --config (or WEATHER_CONFIG), which has to be read
+// before the environment and the other options.
+static const char *config_path(int argc, char **argv) {
+    const char *path = getenv("WEATHER_CONFIG");
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) path = argv[++i];
+        else if (strncmp(argv[i], "--config=", 9) == 0) path = argv[i] + 9;
+    }
+    return path;
+}
+
+int config_load(Config *c, int argc, char **argv, char *err, size_t err_len) {
+    const char *path = config_path(argc, argv);
+    int rc = CONFIG_OK;
+    if (set_defaults(c) < 0 || (path && !(c->config = strdup(path)))) {
+        set_err(err, err_len, "out of memory");
+        rc = CONFIG_ERROR;
+    }
+    if (rc == CONFIG_OK && path) rc = load_file(c, path, err, err_len);
+    if (rc == CONFIG_OK) rc = load_env(c, err, err_len);
+    if (rc == CONFIG_OK) rc = load_args(c, argc, argv, err, err_len);
+    if (rc != CONFIG_OK) config_free(c);
+    return rc;
+}
+
+void config_free(Config *c) {
+    for (size_t i = 0; i < NUM_OPTIONS; i++) {
+        if (OPTIONS[i].kind == OPT_STRING || OPTIONS[i].kind == OPT_CHOICE) {
+            char **field = (char **)((char *)c + OPTIONS[i].offset);
+            free(*field);
+            *field = NULL;
+        }
+    }
+}
+
+int config_report_restart(const Config *running, const Config *next, FILE *out) {
+    int n = 0;
+    for (size_t i = 0; i < NUM_OPTIONS; i++) {
+        const Option *o = &OPTIONS[i];
+        if (o->reload || o->offset == F(config)) continue;
+        const void *a = (const char *)running + o->offset, *b = (const char *)next + o->offset;
+        int changed;
+        if (o->kind == OPT_STRING || o->kind == OPT_CHOICE) {
+            const char *sa = *(char *const *)a, *sb = *(char *const *)b;
+            changed = (sa == NULL) != (sb == NULL) || (sa && strcmp(sa, sb) != 0);
+        } else if (o->kind == OPT_DOUBLE) {
+            changed = *(const double *)a != *(const double *)b;
+        } else {
+            changed = *(const long *)a != *(const long *)b;
+        }
+        if (changed) {
+            fprintf(out, "config: %s changed; it takes effect after a restart\n", o->name);
+            n++;
+        }
+    }
+    return n;
+}
+
+void config_usage(const char *prog, FILE *out) {
+    fprintf(out,
+            "Usage: %s [--NAME VALUE]...\n"
+            "Every setting can also be given as 'NAME VALUE' in the --config file or as\n"
+            "WEATHER_NAME in the environment (e.g. WEATHER_CACHE_TTL=60); the command line\n"
+            "wins over the environment, which wins over the file. SIGHUP re-reads them and\n"
+            "applies the settings marked *; the others need a restart.\n",
+            prog);
+    for (size_t i = 0; i < NUM_OPTIONS; i++) {
+        const Option *o = &OPTIONS[i];
+        char flag[48];
+        snprintf(flag, sizeof(flag), "--%s %s", o->name, o->arg);
+        fprintf(out, "  %-26s %s%s\n", flag, o->reload ? "* " : "", o->help);
+    }
+}
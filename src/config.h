@@ -0,0 +1,84 @@
+// Runtime configuration. Every setting has a compiled-in default and can be
+// changed, in increasing order of precedence, in a config file (--config),
+// in a WEATHER_* environment variable or on the command line:
+//
+//     port 8080                       # config file: "name value" per line
+//     WEATHER_PORT=8080               # environment: WEATHER_ + NAME_IN_CAPS
+//     --port 8080                     # command line
+//
+// Settings marked reloadable in the option table are applied again when the
+// server gets SIGHUP (the file is re-read); the others need a restart.
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define CONFIG_MAX_WORKERS 256          // upper bound for --workers
+
+// Defaults
+#define CONFIG_PORT 8080
+#define CONFIG_BIND "::"                // every IPv6 and IPv4 address (dual stack)
+#define CONFIG_BACKLOG 511              // connections the kernel queues before accept()
+#define CONFIG_READ_BUFFER 8192         // per connection: the longest request accepted
+#define CONFIG_WRITE_BUFFER 16384       // per connection: response bytes queued at once
+#define CONFIG_KEEPALIVE_MS 5000        // idle connections are closed after this long
+#define CONFIG_KEEPALIVE_REQUESTS 1000  // a connection is closed after this many requests
+#define CONFIG_DRAIN_MS 10000           // SIGTERM: open requests get this long to finish
+#define CONFIG_CITY_RADIUS_KM 2.0       // how close coordinates must be to count as a city
+#define CONFIG_CACHE_SIZE 10000         // weather locations kept in memory
+#define CONFIG_CACHE_TTL_SEC 300        // seconds before a cached answer is refetched
+#define CONFIG_CACHE_STALE_SEC 600      // seconds an expired answer may still be served
+
+typedef struct {
+    char *config;                   // the file read before the environment and the command line
+    // Listening sockets
+    char *bind;                     // numeric address; "::" also accepts IPv4 where supported
+    long port;
+    long workers;                   // 0 = one per CPU core
+    long backlog;
+    long tcp_nodelay;               // 0/1: TCP_NODELAY on client sockets
+    long tcp_defer_accept;          // seconds (Linux TCP_DEFER_ACCEPT), 0 = off
+    long tcp_fastopen;              // TCP Fast Open queue length, 0 = off
+    // Connections
+    char *event_loop;               // "epoll", "kqueue" or "io_uring" (EV_LOOP_BACKENDS)
+    long read_buffer;
+    long write_buffer;
+    long keepalive_timeout;         // ms
+    long keepalive_requests;
+    long max_conns;                 // 0 = the open file limit minus a reserve
+    long rate_limit;                // requests per second per client, 0 = off
+    long rate_burst;                // 0 = twice rate_limit
+    // Restarts
+    long drain_timeout;             // ms
+    char *handoff_socket;           // Unix socket for taking over from / handing over to another process
+    // Data
+    char *cities;                   // NULL = the built-in demo cities
+    char *provider;                 // "demo" or "open-meteo"
+    char *upstream;                 // NULL = the provider's default host
+    double radius_km;
+    long cache_size;
+    long cache_ttl;                 // seconds
+    long cache_stale;               // seconds
+    long prefetch;                  // cities kept warm, -1 = all
+    char *access_log;               // NULL = off, "-" = standard output
+} Config;
+
+#define CONFIG_OK 0
+#define CONFIG_ERROR -1                 // message in 'err'
+#define CONFIG_HELP 1                   // --help was given
+
+// Fill 'c' from the defaults, the config file, the environment and argv
+// (in that order). On CONFIG_ERROR 'c' holds nothing that needs freeing.
+int config_load(Config *c, int argc, char **argv, char *err, size_t err_len);
+
+void config_free(Config *c);
+
+// Print a note for every setting that differs between 'running' and 'next'
+// but only takes effect after a restart. Returns how many there were.
+int config_report_restart(const Config *running, const Config *next, FILE *out);
+
+// Option list with descriptions and defaults.
+void config_usage(const char *prog, FILE *out);
+
+#endif
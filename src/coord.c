@@ -0,0 +1,48 @@
+// Fixed-point decimal parser (see coord.h).
+// The digits are collected into one integer scaled by 10^COORD_FRAC_DIGITS.
+// That integer is exact (coordinates have at most 3 integer digits, so it
+// stays far below 2^53) and one IEEE division by the exact power of ten
+// rounds it correctly: the result is the double nearest the decimal.
+#include "coord.h"
+
+#include <stdint.h>
+
+#define INT_DIGITS_MAX 6        // "123456" is out of any range, but still a number
+
+static const double POW10[COORD_FRAC_DIGITS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+size_t coord_scan(const char *s, size_t len, double *out) {
+    size_t i = 0;
+    int neg = 0;
+    if (i < len && (s[i] == '-' || s[i] == '+')) neg = s[i++] == '-';
+    size_t start = i;                               // first digit (after the sign)
+    uint64_t v = 0;
+    size_t int_digits = 0, frac_digits = 0;
+    while (i < len && s[i] >= '0' && s[i] <= '9') {
+        if (int_digits == INT_DIGITS_MAX) return 0;
+        if (v || s[i] != '0') int_digits++;         // leading zeros do not count
+        v = v * 10 + (uint64_t)(s[i++] - '0');
+    }
+    size_t digits_seen = i - start;
+    if (i < len && s[i] == '.') {
+        i++;
+        while (i < len && s[i] >= '0' && s[i] <= '9') {
+            if (frac_digits < COORD_FRAC_DIGITS) {
+                v = v * 10 + (uint64_t)(s[i] - '0');
+                frac_digits++;
+            }
+            digits_seen++;
+            i++;
+        }
+    }
+    if (digits_seen == 0) return 0;                 // "", "-", "." are not numbers
+    double d = (double)v / POW10[frac_digits];      // exact integer, one rounding
+    *out = neg ? -d : d;
+    return i;
+}
+
+int coord_parse(const char *s, size_t len, double *out) {
+    return len > 0 && coord_scan(s, len, out) == len ? 0 : -1;
+}
@@ -0,0 +1,21 @@
+// Coordinate parsing for query strings.
+// Reads plain decimals ("55.6050", "-13", "+0.5") straight from a query
+// value, without NUL-terminating or copying it, independent of the C locale.
+// Anything else (exponents, hex, "nan", spaces, "55,6", empty values) is
+// rejected instead of silently becoming 0 as with atof().
+#ifndef COORD_H
+#define COORD_H
+
+#include <stddef.h>
+
+// Parse the decimal at the start of s[0..len). Returns the number of bytes it
+// used (the caller checks what follows), or 0 if there is no valid number.
+// Up to COORD_FRAC_DIGITS fraction digits are exact (the same double as
+// strtod); further digits are read but ignored (< 1e-9°, well under a mm).
+#define COORD_FRAC_DIGITS 9
+size_t coord_scan(const char *s, size_t len, double *out);
+
+// Parse all of s[0..len) as a decimal. Returns 0, or -1 if it is not one.
+int coord_parse(const char *s, size_t len, double *out);
+
+#endif
@@ -0,0 +1,175 @@
+// Event loop backends: epoll (Linux) and kqueue (macOS/BSD), plus io_uring
+// on Linux (uring.c). All report the same EvEvent structure so the server
+// code does not care which one runs.
+#include "event_loop.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+// Upper bound of kernel events fetched per ev_loop_wait() call
+#define EV_BATCH 256
+
+struct EventLoop {
+    int fd;         // epoll or kqueue descriptor (-1 with io_uring)
+    Uring *uring;   // the io_uring backend, else NULL
+};
+
+EventLoop *ev_loop_create(const char *backend) {
+    if (!backend) backend = EV_LOOP_DEFAULT;
+    EventLoop *loop = malloc(sizeof(*loop));
+    if (!loop) return NULL;
+    loop->fd = -1;
+    loop->uring = NULL;
+    int ok;
+    if (strcmp(backend, "io_uring") == 0) {
+        loop->uring = uring_create();
+        ok = loop->uring != NULL;
+    } else if (strcmp(backend, EV_LOOP_DEFAULT) == 0) {
+#if defined(__linux__)
+        loop->fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+        loop->fd = kqueue();
+#endif
+        ok = loop->fd >= 0;
+    } else {
+        errno = ENOSYS;
+        ok = 0;
+    }
+    if (!ok) {                          // keep errno from the failing call
+        int saved = errno;
+        free(loop);
+        errno = saved;
+        return NULL;
+    }
+    return loop;
+}
+
+void ev_loop_destroy(EventLoop *loop) {
+    if (!loop) return;
+    if (loop->uring) uring_destroy(loop->uring);
+    else close(loop->fd);
+    free(loop);
+}
+
+const char *ev_loop_backend(const EventLoop *loop) {
+    return loop->uring ? "io_uring" : EV_LOOP_DEFAULT;
+}
+
+int ev_loop_async(const EventLoop *loop) {
+    return loop->uring != NULL;
+}
+
+// The operations exist only with io_uring; elsewhere they fail with ENOSYS.
+int ev_loop_accept(EventLoop *loop, int fd, void *data) {
+    if (!loop->uring) { errno = ENOSYS; return -1; }
+    return uring_accept(loop->uring, fd, data);
+}
+
+int ev_loop_recv(EventLoop *loop, int fd, void *buf, size_t len, void *data) {
+    if (!loop->uring) { errno = ENOSYS; return -1; }
+    return uring_recv(loop->uring, fd, buf, len, data);
+}
+
+int ev_loop_send(EventLoop *loop, int fd, const struct iovec *iov, int iovcnt, int close_after, void *data) {
+    if (!loop->uring) { errno = ENOSYS; return -1; }
+    return uring_send(loop->uring, fd, iov, iovcnt, close_after, data);
+}
+
+int ev_loop_cancel(EventLoop *loop, void *data) {
+    if (!loop->uring) { errno = ENOSYS; return -1; }
+    return uring_cancel(loop->uring, data);
+}
+
+#if defined(__linux__)
+
+int ev_loop_add(EventLoop *loop, int fd, int events, void *data) {
+    if (loop->uring) return uring_add(loop->uring, fd, events, data);
+    struct epoll_event ev = {0};
+    ev.events = EPOLLET | EPOLLRDHUP;           // edge-triggered, notice half-closed peers
+    if (events & EVL_READ) ev.events |= EPOLLIN;
+    if (events & EVL_WRITE) ev.events |= EPOLLOUT;
+    ev.data.ptr = data;
+    return epoll_ctl(loop->fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int ev_loop_del(EventLoop *loop, int fd) {
+    if (loop->uring) return uring_del(loop->uring, fd);
+    return epoll_ctl(loop->fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int ev_loop_wait(EventLoop *loop, EvEvent *out, int max, int timeout_ms) {
+    if (loop->uring) return uring_wait(loop->uring, out, max, timeout_ms);
+    struct epoll_event evs[EV_BATCH];
+    if (max > EV_BATCH) max = EV_BATCH;
+    int n = epoll_wait(loop->fd, evs, max, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        int e = 0;
+        if (evs[i].events & (EPOLLIN | EPOLLRDHUP)) e |= EVL_READ;   // read to observe EOF too
+        if (evs[i].events & EPOLLOUT) e |= EVL_WRITE;
+        if (evs[i].events & (EPOLLERR | EPOLLHUP)) e |= EVL_ERROR;
+        out[i].data = evs[i].data.ptr;
+        out[i].events = e;
+        out[i].result = 0;
+    }
+    return n;
+}
+
+#else
+
+int ev_loop_add(EventLoop *loop, int fd, int events, void *data) {
+    struct kevent ch[2];
+    int n = 0;
+    // EV_CLEAR gives edge-triggered semantics like EPOLLET
+    if (events & EVL_READ) EV_SET(&ch[n++], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, data);
+    if (events & EVL_WRITE) EV_SET(&ch[n++], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, data);
+    return kevent(loop->fd, ch, n, NULL, 0, NULL);
+}
+
+int ev_loop_del(EventLoop *loop, int fd) {
+    // Filters are removed automatically when the fd is closed; deleting a
+    // filter that was never added fails with ENOENT, which we ignore.
+    struct kevent ch[2];
+    EV_SET(&ch[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    EV_SET(&ch[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    (void)kevent(loop->fd, ch, 2, NULL, 0, NULL);
+    return 0;
+}
+
+int ev_loop_wait(EventLoop *loop, EvEvent *out, int max, int timeout_ms) {
+    struct kevent evs[EV_BATCH];
+    struct timespec ts, *tp = NULL;
+    if (max > EV_BATCH) max = EV_BATCH;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        tp = &ts;
+    }
+    int n = kevent(loop->fd, NULL, 0, evs, max, tp);
+    for (int i = 0; i < n; i++) {
+        int e = 0;
+        if (evs[i].filter == EVFILT_READ) e |= EVL_READ;
+        if (evs[i].filter == EVFILT_WRITE) e |= EVL_WRITE;
+        // Socket errors come as EV_EOF with the errno in fflags (a plain
+        // EV_EOF is the peer's FIN: read() returns 0); EV_ERROR is for
+        // the filter itself.
+        if ((evs[i].flags & EV_ERROR) || ((evs[i].flags & EV_EOF) && evs[i].fflags != 0)) e |= EVL_ERROR;
+        out[i].data = evs[i].udata;
+        out[i].events = e;
+        out[i].result = 0;
+    }
+    return n;
+}
+
+#endif
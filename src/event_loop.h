@@ -0,0 +1,84 @@
+// Small event loop used by the HTTP server.
+// Linux uses epoll, macOS/BSD use kqueue. Both are driven edge-triggered:
+// you get one notification when a socket becomes readable/writable and must
+// then read/write until the call returns EAGAIN.
+//
+// Linux also has an io_uring backend (5.19+). It reports readiness the same
+// way, and on top it can do the socket work itself (ev_loop_async()):
+// ev_loop_accept(), ev_loop_recv() and ev_loop_send() queue operations, the
+// next ev_loop_wait() hands all of them to the kernel in the same system
+// call it waits in, and each one comes back as an EVL_DONE event.
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// Interest / readiness bits (can be OR-ed together)
+#define EVL_READ  0x1   // socket has bytes to read (or a pending accept)
+#define EVL_WRITE 0x2   // socket has room in its send buffer
+#define EVL_ERROR 0x4   // peer hung up or the socket is in an error state
+#define EVL_DONE  0x8   // an ev_loop_accept/recv/send operation finished: see 'result'
+#define EVL_MORE  0x10  // with EVL_DONE from ev_loop_accept(): the accept goes on
+
+// Backends ev_loop_create() knows on this platform; the first is the default
+#if defined(__linux__)
+#define EV_LOOP_BACKENDS "epoll|io_uring"
+#define EV_LOOP_DEFAULT "epoll"
+#else
+#define EV_LOOP_BACKENDS "kqueue"
+#define EV_LOOP_DEFAULT "kqueue"
+#endif
+
+// One ready file descriptor, or one finished operation, from ev_loop_wait()
+typedef struct {
+    void *data;   // the pointer registered with ev_loop_add() (e.g., a connection)
+    int events;   // EVL_READ / EVL_WRITE / EVL_ERROR bits that fired, or EVL_DONE (| EVL_MORE)
+    int result;   // EVL_DONE: what the call returned (new fd, bytes received or sent), or -errno
+} EvEvent;
+
+typedef struct EventLoop EventLoop;   // opaque: epoll fd, kqueue fd or io_uring
+
+// Create / destroy a loop with the named backend (NULL = EV_LOOP_DEFAULT).
+// Returns NULL if the kernel refuses (errno is set; ENOSYS: the backend is
+// not available here, e.g. io_uring on a kernel older than 5.19).
+EventLoop *ev_loop_create(const char *backend);
+void ev_loop_destroy(EventLoop *loop);
+
+// Register a non-blocking fd for edge-triggered EVL_READ and/or EVL_WRITE.
+// 'data' is handed back in every EvEvent for this fd. Returns 0 or -1.
+int ev_loop_add(EventLoop *loop, int fd, int events, void *data);
+
+// Remove an fd before closing it. Returns 0 or -1.
+int ev_loop_del(EventLoop *loop, int fd);
+
+// Wait up to timeout_ms (-1 = forever) and fill at most max events.
+// Returns the number of events, 0 on timeout, or -1 on error (EINTR included).
+int ev_loop_wait(EventLoop *loop, EvEvent *out, int max, int timeout_ms);
+
+// Name of the loop's backend ("epoll", "kqueue" or "io_uring"), for the startup banner.
+const char *ev_loop_backend(const EventLoop *loop);
+
+// 1 if the operations below work on this loop (io_uring), else 0.
+int ev_loop_async(const EventLoop *loop);
+
+// Operations run by the kernel. Each one reports back with one EVL_DONE
+// event carrying 'data' (non-NULL and at least 2-byte aligned); buffers
+// must stay untouched until then. Return 0, or -1 if it cannot be queued.
+//
+// Accept clients on a listening socket until cancelled: one EVL_DONE | EVL_MORE
+// event per new (non-blocking) fd. An event without EVL_MORE ends it (an
+// error such as EMFILE, or -ECANCELED); call it again to go on.
+int ev_loop_accept(EventLoop *loop, int fd, void *data);
+// Receive up to len bytes (result 0: the peer closed).
+int ev_loop_recv(EventLoop *loop, int fd, void *buf, size_t len, void *data);
+// Send all of iov[0..iovcnt) (less only on error; the iovec array counts as
+// a buffer too). With close_after the fd is closed as soon as everything is
+// sent (in the kernel, linked to the send; if the send falls short, the fd
+// stays open).
+int ev_loop_send(EventLoop *loop, int fd, const struct iovec *iov, int iovcnt, int close_after, void *data);
+// End every operation of 'data' soon: they report -ECANCELED (or their
+// result, if they finished first).
+int ev_loop_cancel(EventLoop *loop, void *data);
+
+#endif
@@ -0,0 +1,167 @@
+// Sharded TTL + LRU forecast store, laid out like the weather cache: the
+// key space is split over FS_SHARDS shards with a mutex each, and all
+// entries are allocated up front and recycled (no malloc after startup).
+#include "forecast_store.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "weather_cache.h"
+
+#define FS_SHARDS 16
+#define FS_ERROR_TTL_SEC 5      // how long a failed fetch is remembered
+
+typedef struct Entry {
+    uint64_t key;
+    int ok;                     // 0 = the last fetch failed (negative entry)
+    long long expires;          // monotonic seconds; the series (or the failure) is fresh until then
+    struct Entry *hnext;        // hash bucket chain
+    struct Entry *prev, *next;  // LRU list, most recent first
+    ForecastSeries series;      // last: the list pointers share a cache line with the key
+} Entry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Entry **buckets;            // power-of-two hash table
+    size_t mask;
+    Entry *lru_head, *lru_tail;
+    Entry *free_list;
+} Shard;
+
+struct ForecastStore {
+    int ttl_sec;
+    Entry *entries;
+    Shard shards[FS_SHARDS];
+};
+
+static long long mono_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec;
+}
+
+// 64-bit mix (splitmix64 finalizer): spreads neighbouring cells over shards
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+ForecastStore *forecast_store_create(size_t capacity, int ttl_sec) {
+    if (capacity < FS_SHARDS) capacity = FS_SHARDS;
+    ForecastStore *fs = calloc(1, sizeof(*fs));
+    if (!fs) return NULL;
+    fs->ttl_sec = ttl_sec;
+    fs->entries = calloc(capacity, sizeof(Entry));
+    if (!fs->entries) { free(fs); return NULL; }
+    size_t per_shard = capacity / FS_SHARDS;
+    size_t buckets = 16;
+    while (buckets < per_shard) buckets <<= 1;
+    for (int i = 0; i < FS_SHARDS; i++) {
+        Shard *s = &fs->shards[i];
+        pthread_mutex_init(&s->lock, NULL);
+        s->buckets = calloc(buckets, sizeof(Entry *));
+        if (!s->buckets) return NULL;             // startup only: the process exits anyway
+        s->mask = buckets - 1;
+        for (size_t j = 0; j < per_shard; j++) {
+            Entry *e = &fs->entries[i * per_shard + j];
+            e->hnext = s->free_list;
+            s->free_list = e;
+        }
+    }
+    return fs;
+}
+
+static Entry **bucket_of(Shard *s, uint64_t key) {
+    return &s->buckets[(mix(key) >> 4) & s->mask];
+}
+
+static Entry *lookup(Shard *s, uint64_t key) {
+    for (Entry *e = *bucket_of(s, key); e; e = e->hnext) {
+        if (e->key == key) return e;
+    }
+    return NULL;
+}
+
+static void hash_remove(Shard *s, Entry *e) {
+    for (Entry **pp = bucket_of(s, e->key); *pp; pp = &(*pp)->hnext) {
+        if (*pp == e) { *pp = e->hnext; return; }
+    }
+}
+
+static void lru_unlink(Shard *s, Entry *e) {
+    if (e->prev) e->prev->next = e->next; else s->lru_head = e->next;
+    if (e->next) e->next->prev = e->prev; else s->lru_tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(Shard *s, Entry *e) {
+    e->prev = NULL;
+    e->next = s->lru_head;
+    if (s->lru_head) s->lru_head->prev = e; else s->lru_tail = e;
+    s->lru_head = e;
+}
+
+static Entry *alloc_entry(Shard *s) {
+    Entry *e = s->free_list;
+    if (e) { s->free_list = e->hnext; return e; }
+    e = s->lru_tail;                              // never NULL: every shard owns entries
+    lru_unlink(s, e);
+    hash_remove(s, e);
+    return e;
+}
+
+static Shard *shard_of(ForecastStore *fs, uint64_t key) {
+    return &fs->shards[mix(key) % FS_SHARDS];
+}
+
+void forecast_slice(const ForecastSeries *s, time_t from, size_t hours, ForecastSeries *out) {
+    size_t lo = 0, hi = s->count;                 // first index with time >= from
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (s->time[mid] < (int64_t)from) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t n = s->count - lo < hours ? s->count - lo : hours;
+    memcpy(out->time, s->time + lo, n * sizeof(s->time[0]));
+    memcpy(out->temp_c, s->temp_c + lo, n * sizeof(s->temp_c[0]));
+    memcpy(out->precip_mm, s->precip_mm + lo, n * sizeof(s->precip_mm[0]));
+    memcpy(out->code, s->code + lo, n * sizeof(s->code[0]));
+    out->count = (uint32_t)n;
+    out->updated_at = s->updated_at;
+}
+
+int forecast_store_lookup(ForecastStore *fs, uint64_t key, time_t from, size_t hours, ForecastSeries *out) {
+    Shard *s = shard_of(fs, key);
+    pthread_mutex_lock(&s->lock);
+    Entry *e = lookup(s, key);
+    int rc = WC_MISS;
+    if (e && e->expires > mono_sec()) {
+        rc = e->ok ? WC_HIT : WC_FAILED;
+        if (e->ok) forecast_slice(&e->series, from, hours, out);   // copy under the lock
+        lru_unlink(s, e);
+        lru_push_front(s, e);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return rc;
+}
+
+void forecast_store_put(ForecastStore *fs, uint64_t key, const ForecastSeries *series) {
+    Shard *s = shard_of(fs, key);
+    pthread_mutex_lock(&s->lock);
+    Entry *e = lookup(s, key);
+    if (e) {
+        lru_unlink(s, e);
+    } else {
+        e = alloc_entry(s);
+        e->key = key;
+        e->hnext = *bucket_of(s, key);
+        *bucket_of(s, key) = e;
+    }
+    e->ok = series != NULL;
+    if (series) forecast_slice(series, 0, series->count, &e->series);   // copies only 'count' values
+    e->expires = mono_sec() + (series ? fs->ttl_sec : FS_ERROR_TTL_SEC);
+    lru_push_front(s, e);
+    pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,35 @@
+// In-memory store of hourly forecasts, shared by all worker threads.
+// Every location's forecast is kept as a ForecastSeries (struct of arrays),
+// so answering "the next N hours" is a binary search on the time column and
+// one memcpy per column. Keys are weather_cache_key() grid cells; entries
+// expire after a TTL and the least recently used one is evicted when the
+// store is full. Like the weather cache it only stores answers: fetching is
+// up to the caller.
+#ifndef FORECAST_STORE_H
+#define FORECAST_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "provider.h"
+
+typedef struct ForecastStore ForecastStore;
+
+// capacity: max stored locations; ttl_sec: how long a forecast stays fresh.
+ForecastStore *forecast_store_create(size_t capacity, int ttl_sec);
+
+// Copy s's values from the first hour starting at or after 'from' (at most
+// 'hours' of them) into 'out'; out->count may be less than 'hours' (even 0)
+// when the series ends sooner.
+void forecast_slice(const ForecastSeries *s, time_t from, size_t hours, ForecastSeries *out);
+
+// Look up a cell and slice it like forecast_slice(). Returns WC_HIT,
+// WC_MISS (fetch and wait) or WC_FAILED (the last fetch failed recently).
+int forecast_store_lookup(ForecastStore *fs, uint64_t key, time_t from, size_t hours, ForecastSeries *out);
+
+// Store the forecast for a cell, or NULL if the fetch failed (remembered
+// for a few seconds).
+void forecast_store_put(ForecastStore *fs, uint64_t key, const ForecastSeries *series);
+
+#endif
@@ -0,0 +1,198 @@
+// Listening socket and cache handoff between two server processes (see handoff.h).
+// Wire format, old → new: one HandoffHeader carrying the sockets as
+// SCM_RIGHTS ancillary data, then header.entries WeatherCacheItem records.
+// New → old: one byte once its workers run. Both ends are the same program,
+// usually of neighbouring versions: the header says how big an item is, and
+// a mismatch only costs the cache, never the sockets.
+#include "handoff.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0              // macOS: the received sockets are not close-on-exec then
+#endif
+
+#define HANDOFF_MAGIC 0x57484f31u       // "WHO1"
+#define READY_TIMEOUT_MS 30000          // the new process must be serving by then
+#define IO_TIMEOUT_MS 5000              // for every read and write of the exchange
+
+typedef struct {
+    uint32_t magic;
+    uint32_t fds;                       // sockets in the ancillary data
+    uint32_t item_size;                 // sizeof(WeatherCacheItem) of the sender
+    uint32_t pad;
+    uint64_t entries;                   // cache items that follow
+} HandoffHeader;
+
+static int unix_addr(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) { errno = ENAMETOOLONG; return -1; }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Wait until 'fd' is ready for 'events'. 0, or -1 on timeout or error.
+static int wait_fd(int fd, short events, int timeout_ms) {
+    struct pollfd p = { fd, events, 0 };
+    int r;
+    do r = poll(&p, 1, timeout_ms); while (r < 0 && errno == EINTR);
+    if (r == 0) errno = ETIMEDOUT;
+    return r > 0 ? 0 : -1;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        if (wait_fd(fd, POLLOUT, IO_TIMEOUT_MS) < 0) return -1;
+        ssize_t n = send(fd, p, len, 0);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        if (wait_fd(fd, POLLIN, IO_TIMEOUT_MS) < 0) return -1;
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) { if (n == 0) errno = ECONNRESET; return -1; }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int handoff_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (unix_addr(path, &addr) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    (void)unlink(path);                 // left over from a crash, or our predecessor's
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0
+        || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+int handoff_give(int ctl, const int *fds, int n, WeatherCache *cache, const char **err) {
+    int conn = accept(ctl, NULL, NULL);
+    if (conn < 0) { *err = strerror(errno); return -1; }
+    size_t count = 0;
+    WeatherCacheItem *items = weather_cache_export(cache, &count);
+    HandoffHeader h = { HANDOFF_MAGIC, (uint32_t)n, sizeof(WeatherCacheItem), 0, count };
+
+    union {                             // aligned room for the sockets
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { &h, sizeof(h) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)n);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)n);
+    memcpy(CMSG_DATA(cm), fds, sizeof(int) * (size_t)n);
+
+    char ready = 0;
+    errno = 0;
+    int ok = n > 0 && n <= HANDOFF_MAX_FDS && sendmsg(conn, &msg, 0) == (ssize_t)sizeof(h)
+             && write_all(conn, items, count * sizeof(*items)) == 0
+             && wait_fd(conn, POLLIN, READY_TIMEOUT_MS) == 0 && recv(conn, &ready, 1, 0) == 1;
+    if (!ok) *err = errno ? strerror(errno) : "the new process went away";
+    free(items);
+    close(conn);
+    return ok ? 0 : -1;
+}
+
+int handoff_take(const char *path, int *fds, int max, int *n, WeatherCache *cache, size_t *entries,
+                 const char **err) {
+    *err = NULL;
+    *n = 0;
+    *entries = 0;
+    struct sockaddr_un addr;
+    if (unix_addr(path, &addr) < 0) { *err = strerror(errno); return -1; }
+    int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0) { *err = strerror(errno); return -1; }
+    if (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (errno != ENOENT && errno != ECONNREFUSED) *err = strerror(errno);
+        close(conn);
+        return -1;                      // ENOENT / ECONNREFUSED: nobody to take over from
+    }
+
+    HandoffHeader h;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    } control;
+    struct iovec iov = { &h, sizeof(h) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t r = -1;
+    if (wait_fd(conn, POLLIN, IO_TIMEOUT_MS) == 0) {
+        do r = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC); while (r < 0 && errno == EINTR);
+    }
+    struct cmsghdr *cm = r == (ssize_t)sizeof(h) ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (!cm || h.magic != HANDOFF_MAGIC || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+        *err = "no sockets in the handoff";
+        close(conn);
+        return -1;
+    }
+    size_t got = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < got; i++) {
+        int fd;
+        memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(fd));
+        if (*n < max) fds[(*n)++] = fd;
+        else close(fd);                 // more than we can use
+    }
+
+    // Cached answers: import them if this build agrees on the record layout,
+    // else read past them.
+    int same = h.item_size == sizeof(WeatherCacheItem);
+    for (uint64_t i = 0; i < h.entries; i++) {
+        WeatherCacheItem item;
+        char skip[512];
+        if (same ? read_all(conn, &item, sizeof(item)) < 0
+                 : h.item_size > sizeof(skip) || read_all(conn, skip, h.item_size) < 0) {
+            break;                      // the sockets are what matters
+        }
+        if (same) {
+            weather_cache_import(cache, &item);
+            (*entries)++;
+        }
+    }
+    return conn;
+}
+
+void handoff_done(int conn) {
+    char ready = 'R';
+    (void)write_all(conn, &ready, 1);
+    close(conn);
+}
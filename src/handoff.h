@@ -0,0 +1,43 @@
+// Zero-downtime restarts: a running server hands its listening sockets and
+// a snapshot of its weather cache to a new process over a Unix socket
+// (--handoff-socket PATH), then drains and exits.
+//
+//   new process                          old process
+//   handoff_take(PATH)  ── connect ──►   handoff_give(): sockets (SCM_RIGHTS)
+//                       ◄──────────────    + cached answers
+//   start workers on the same sockets
+//   handoff_done()      ── "ready" ──►   stop accepting, finish requests, exit
+//   handoff_listen(PATH)                 (for the next restart)
+//
+// The sockets never close, so the kernel keeps queueing connections during
+// the switch; until "ready" both processes accept them. If the new process
+// dies before that, the old one simply keeps serving.
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stddef.h>
+
+#include "weather_cache.h"
+
+#define HANDOFF_MAX_FDS 256             // listening sockets passed at most (one per worker)
+
+// Old process: create the control socket at 'path' (replacing a stale
+// one). Returns the non-blocking listening fd, or -1 with errno set.
+int handoff_listen(const char *path);
+
+// Old process, 'ctl' readable: accept the new process, send it 'fds' and
+// the cache, and wait until it serves. Returns 0 if it took over (the
+// caller stops accepting and drains), -1 with the reason in *err if not.
+int handoff_give(int ctl, const int *fds, int n, WeatherCache *cache, const char **err);
+
+// New process: take over from the process listening on 'path'. Fills
+// fds[0..*n) with its sockets and imports its cached answers (count in
+// *entries). Returns the connection to confirm on with handoff_done(), or
+// -1: with *err NULL if nobody is there (a normal start), else the reason.
+int handoff_take(const char *path, int *fds, int max, int *n, WeatherCache *cache, size_t *entries,
+                 const char **err);
+
+// New process: tell the old one that the workers serve on its sockets now.
+void handoff_done(int conn);
+
+#endif
@@ -0,0 +1,295 @@
+// Incremental, zero-copy HTTP/1.x request parser (request line + headers).
+// The parser works line by line. 'scan' remembers how far we already looked
+// for the next '\n', so bytes that arrived in an earlier read are never
+// searched twice, and the header size limit is a simple bound on the search.
+// Lines are found with memchr() (vectorized by libc); query strings are
+// tokenized with scan_block(), which finds all delimiters of 64 bytes at once.
+#include "http_parser.h"
+#include "scan.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+enum {
+    PS_REQUEST_LINE,   // waiting for "METHOD TARGET HTTP/1.x"
+    PS_HEADERS,        // reading "Name: value" lines until the blank line
+    PS_DONE            // header block complete
+};
+
+void http_parser_init(HttpParser *p, size_t max_header) {
+    memset(p, 0, sizeof(*p));
+    p->state = PS_REQUEST_LINE;
+    p->max_header = max_header;
+}
+
+int sv_eq(StrView v, const char *s) {
+    size_t n = strlen(s);
+    return v.len == n && memcmp(v.ptr, s, n) == 0;
+}
+
+int sv_starts_with(StrView v, const char *prefix) {
+    size_t n = strlen(prefix);
+    return v.len >= n && memcmp(v.ptr, prefix, n) == 0;
+}
+
+static int sv_ieq(StrView v, const char *s) {
+    size_t n = strlen(s);
+    return v.len == n && strncasecmp(v.ptr, s, n) == 0;
+}
+
+int http_header_has_token(StrView value, const char *token) {
+    size_t tlen = strlen(token);
+    const char *p = value.ptr;
+    const char *end = value.ptr + value.len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char *tok = p;                 // start of this list element
+        while (p < end && *p != ',') p++;
+        const char *tend = p;
+        while (tend > tok && (tend[-1] == ' ' || tend[-1] == '\t')) tend--; // trim trailing space
+        if ((size_t)(tend - tok) == tlen && strncasecmp(tok, token, tlen) == 0) return 1;
+    }
+    return 0;
+}
+
+int http_etag_match(StrView if_none_match, const char *etag) {
+    size_t n = strlen(etag);
+    const char *p = if_none_match.ptr;
+    const char *end = p + if_none_match.len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        if (p == end) break;
+        if (*p == '*') return 1;                              // any current representation
+        if (end - p > 2 && p[0] == 'W' && p[1] == '/') p += 2; // weak tags compare by their opaque part
+        const char *tag = p;
+        if (*p == '"') {
+            const char *close = memchr(p + 1, '"', (size_t)(end - p - 1));
+            if (!close) return 0;
+            p = close + 1;
+        }
+        if ((size_t)(p - tag) == n && memcmp(tag, etag, n) == 0) return 1;
+        while (p < end && *p != ',') p++;                     // skip to the next list element
+    }
+    return 0;
+}
+
+// "GET /api/v1/geo?city=Malmo HTTP/1.1" → method, path, query, version
+static int parse_request_line(HttpRequest *req, const char *line, size_t len) {
+    const char *end = line + len;
+    const char *sp1 = memchr(line, ' ', len);             // METHOD ends at the first space
+    if (!sp1 || sp1 == line) return 0;
+    for (const char *c = line; c < sp1; c++) {            // methods are upper-case tokens
+        if (*c < 'A' || *c > 'Z') return 0;
+    }
+    const char *target = sp1 + 1;
+    const char *sp2 = memchr(target, ' ', (size_t)(end - target)); // TARGET ends at the next one
+    if (!sp2 || sp2 == target) return 0;
+    const char *ver = sp2 + 1;
+    if (end - ver != 8 || memcmp(ver, "HTTP/1.", 7) != 0) return 0;
+    if (ver[7] != '0' && ver[7] != '1') return 0;
+
+    req->method.ptr = line;
+    req->method.len = (size_t)(sp1 - line);
+    req->minor_version = ver[7] - '0';
+    req->keep_alive = req->minor_version == 1;            // HTTP/1.1 is persistent by default
+
+    const char *q = memchr(target, '?', (size_t)(sp2 - target)); // split on '?': path vs query
+    req->path.ptr = target;
+    req->path.len = (size_t)((q ? q : sp2) - target);
+    if (q) {
+        req->query.ptr = q + 1;
+        req->query.len = (size_t)(sp2 - (q + 1));
+    }
+    return 1;
+}
+
+// "Name: value" → remember the headers the server cares about
+static int parse_header_line(HttpRequest *req, const char *line, size_t len) {
+    if (line[0] == ' ' || line[0] == '\t') return 0;      // obsolete line folding is not allowed
+    const char *colon = memchr(line, ':', len);
+    if (!colon || colon == line) return 0;
+    StrView name = { line, (size_t)(colon - line) };
+    for (size_t i = 0; i < name.len; i++) {               // no whitespace inside field names
+        if (name.ptr[i] == ' ' || name.ptr[i] == '\t') return 0;
+    }
+    const char *v = colon + 1, *vend = line + len;
+    while (v < vend && (*v == ' ' || *v == '\t')) v++;           // trim optional whitespace
+    while (vend > v && (vend[-1] == ' ' || vend[-1] == '\t')) vend--;
+    StrView value = { v, (size_t)(vend - v) };
+
+    if (sv_ieq(name, "Connection")) {
+        if (http_header_has_token(value, "close")) req->keep_alive = 0;
+        else if (http_header_has_token(value, "keep-alive")) req->keep_alive = 1;
+    } else if (sv_ieq(name, "Content-Length")) {
+        if (value.len == 0 || value.len > 9) return 0;    // we never accept bodies near 1 GB
+        size_t n = 0;
+        for (size_t i = 0; i < value.len; i++) {
+            if (value.ptr[i] < '0' || value.ptr[i] > '9') return 0;
+            n = n * 10 + (size_t)(value.ptr[i] - '0');
+        }
+        // Repeats must agree (RFC 9112 §6.3): a proxy in front that used the
+        // other value would see a different request boundary (smuggling).
+        if (req->has_content_length && req->content_length != n) return 0;
+        req->has_content_length = 1;
+        req->content_length = n;
+    } else if (sv_ieq(name, "If-None-Match")) {
+        req->if_none_match = value;
+    } else if (sv_ieq(name, "Accept-Encoding")) {
+        req->accept_encoding = value;
+    } else if (sv_ieq(name, "Transfer-Encoding")) {
+        return 0;                                         // chunked request bodies are not supported
+    }
+    return 1;
+}
+
+HttpParseResult http_parser_feed(HttpParser *p, const char *buf, size_t len) {
+    if (p->state == PS_DONE) return HTTP_PARSE_DONE;
+    size_t limit = len < p->max_header ? len : p->max_header; // never look past the header limit
+
+    while (1) {
+        const char *nl = p->scan < limit ? memchr(buf + p->scan, '\n', limit - p->scan) : NULL;
+        if (!nl) {                                        // line not complete yet
+            p->scan = limit;
+            return len >= p->max_header ? HTTP_PARSE_TOO_LARGE : HTTP_PARSE_INCOMPLETE;
+        }
+        size_t next = (size_t)(nl - buf) + 1;             // first byte of the following line
+        const char *line = buf + p->line_start;
+        size_t line_len = (size_t)(nl - line);
+        if (line_len && line[line_len - 1] == '\r') line_len--; // accept CRLF and bare LF
+
+        if (p->state == PS_REQUEST_LINE) {
+            if (line_len > 0) {                           // ignore empty lines before a request
+                if (!parse_request_line(&p->req, line, line_len)) return HTTP_PARSE_ERROR;
+                p->state = PS_HEADERS;
+            }
+        } else if (line_len == 0) {                       // blank line: end of headers
+            p->state = PS_DONE;
+            p->req.header_len = next;
+            p->req.body.ptr = buf + next;                 // body bytes may still be on their way
+            p->req.body.len = p->req.content_length;
+            p->line_start = p->scan = next;
+            return HTTP_PARSE_DONE;
+        } else if (!parse_header_line(&p->req, line, line_len)) {
+            return HTTP_PARSE_ERROR;
+        }
+        p->line_start = p->scan = next;
+    }
+}
+
+// Very small URL-decoder (handles %xx and '+'). Modifies the string in-place.
+// Example: "Malmo%20City" → "Malmo City"; "+" becomes space as well.
+void http_url_decode(char *s) {
+    char *o = s;                           // output pointer writes back onto the same string
+    for (; *s; s++, o++) {                  // walk the input string, writing to output
+        if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2])) {
+            char hex[3] = { s[1], s[2], 0 }; // two hex digits after '%'
+            *o = (char) strtol(hex, NULL, 16); // convert hex to a single byte
+            s += 2;                           // skip the two hex digits we just consumed
+        } else if (*s == '+') {               // '+' represents space in URL encoding
+            *o = ' ';
+        } else {
+            *o = *s;                          // normal character, copy as-is
+        }
+    }
+    *o = '\0';                              // null-terminate the decoded string
+}
+
+// Read a key=value from the URL query string. Returns the decoded value
+// (copied into the arena, so it is never truncated), or NULL if not found.
+// The query is a view into the request buffer.
+// Example: query="city=Malmo&x=1", key="city" → "Malmo"
+char *http_query_param(Arena *a, StrView query, const char *key) {
+    if (!query.ptr) return NULL;            // no query string at all
+    size_t keylen = strlen(key);
+    const char *p = query.ptr;              // scanning pointer
+    const char *end = query.ptr + query.len;
+    while (p < end) {                       // loop over key=value pairs separated by '&'
+        const char *amp = memchr(p, '&', (size_t)(end - p));          // find next '&' (end of this pair)
+        const char *pair_end = amp ? amp : end;
+        const char *eq = memchr(p, '=', (size_t)(pair_end - p));      // find '=' between key and value
+        if (eq && (size_t)(eq - p) == keylen && memcmp(p, key, keylen) == 0) {
+            char *out = arena_strndup(a, eq + 1, (size_t)(pair_end - eq - 1)); // copy value substring
+            if (out) http_url_decode(out);                                 // decode %xx and '+' (only shrinks)
+            return out;
+        }
+        p = pair_end + 1;                   // move to next pair
+    }
+    return NULL;                         // not found
+}
+
+static const ScanSet QUERY_DELIMS = SCAN_SET('&', '=', '%', '+');
+
+// One pass over the query: every delimiter of a 64-byte block comes out of
+// one bitmask, so the loop runs per delimiter, not per byte.
+void http_query_parse(StrView query, HttpQuery *q) {
+    q->count = 0;
+    q->rest.ptr = NULL;
+    q->rest.len = 0;
+    if (!query.ptr) return;
+    const char *end = query.ptr + query.len;
+    const char *key = query.ptr;            // start of the current pair
+    const char *eq = NULL;                  // its '=' (NULL until seen)
+    int escaped = 0;
+    for (size_t i = 0; i <= query.len; i += 64) {
+        uint64_t m = i < query.len ? scan_block(query.ptr + i, query.len - i, &QUERY_DELIMS) : 0;
+        int last = i + 64 >= query.len;
+        // Walk this block's delimiters; after the last block, end the final pair.
+        while (m || last) {
+            const char *c;
+            if (m) {
+                c = query.ptr + i + __builtin_ctzll(m);
+                m &= m - 1;
+            } else {
+                c = end;
+                last = 0;
+            }
+            if (c < end && *c == '=') {
+                if (!eq) eq = c;
+            } else if (c < end && *c != '&') {      // '%' or '+'
+                escaped |= eq != NULL;
+            } else {                                // '&' or the end: the pair is complete
+                if (eq) {
+                    if (q->count == HTTP_QUERY_MAX) {
+                        q->rest.ptr = key;
+                        q->rest.len = (size_t)(end - key);
+                        return;
+                    }
+                    HttpQueryParam *pr = &q->params[q->count++];
+                    pr->key.ptr = key;
+                    pr->key.len = (size_t)(eq - key);
+                    pr->value.ptr = eq + 1;
+                    pr->value.len = (size_t)(c - eq - 1);
+                    pr->escaped = escaped;
+                }
+                key = c + 1;
+                eq = NULL;
+                escaped = 0;
+                if (c == end) return;
+            }
+        }
+    }
+}
+
+const HttpQueryParam *http_query_find(const HttpQuery *q, const char *key, HttpQueryParam *tmp) {
+    for (size_t i = 0; i < q->count; i++) {
+        if (sv_eq(q->params[i].key, key)) return &q->params[i];
+    }
+    if (!q->rest.ptr) return NULL;
+    HttpQuery more;                         // rare: a query with many pairs
+    http_query_parse(q->rest, &more);
+    const HttpQueryParam *p = http_query_find(&more, key, tmp);
+    if (!p) return NULL;
+    *tmp = *p;
+    return tmp;
+}
+
+char *http_query_get(const HttpQuery *q, Arena *a, const char *key) {
+    HttpQueryParam tmp;
+    const HttpQueryParam *p = http_query_find(q, key, &tmp);
+    if (!p) return NULL;
+    char *out = arena_strndup(a, p->value.ptr, p->value.len);
+    if (out && p->escaped) http_url_decode(out);
+    return out;
+}
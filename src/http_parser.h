@@ -0,0 +1,105 @@
+// Incremental HTTP/1.x request parser.
+// Feed it the connection's input buffer every time more bytes arrive; it
+// remembers how far it got and only scans the new bytes. Parsed fields are
+// string views (pointer + length) into that buffer — nothing is copied, so
+// the buffer must not move while the request is being handled.
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+// A slice of someone else's memory (not NUL-terminated).
+typedef struct {
+    const char *ptr;
+    size_t len;
+} StrView;
+
+// Result of http_parser_feed()
+typedef enum {
+    HTTP_PARSE_INCOMPLETE = 0,   // need more bytes
+    HTTP_PARSE_DONE = 1,         // request line + headers complete (see HttpRequest)
+    HTTP_PARSE_ERROR = -1,       // malformed request: answer 400 and close
+    HTTP_PARSE_TOO_LARGE = -2    // header block exceeds the limit: answer 431 and close
+} HttpParseResult;
+
+// The parts of a request the server uses.
+typedef struct {
+    StrView method;           // "GET", "OPTIONS", ...
+    StrView path;             // "/api/v1/geo" (target without the query)
+    StrView query;            // "city=Malmo" (ptr == NULL when there is no '?')
+    int minor_version;        // 0 for HTTP/1.0, 1 for HTTP/1.1
+    int keep_alive;           // connection stays open after this request (version + Connection header)
+    size_t content_length;    // request body size announced by Content-Length (0 if none)
+    int has_content_length;   // a Content-Length header was seen (repeats must agree)
+    StrView if_none_match;    // If-None-Match value (ptr == NULL when absent)
+    StrView accept_encoding;  // Accept-Encoding value (ptr == NULL when absent)
+    size_t header_len;        // bytes of request line + headers + blank line
+    StrView body;             // the content_length bytes after the headers (check they have arrived)
+} HttpRequest;
+
+typedef struct {
+    int state;                // where the parser stopped (request line / headers / done)
+    size_t line_start;        // offset of the line being parsed
+    size_t scan;              // first byte not searched for '\n' yet
+    size_t max_header;        // limit for the whole header block
+    HttpRequest req;          // fields filled in so far
+} HttpParser;
+
+// Reset the parser for a new request; header blocks larger than
+// max_header bytes are rejected with HTTP_PARSE_TOO_LARGE.
+void http_parser_init(HttpParser *p, size_t max_header);
+
+// Continue parsing buf[0..len). 'buf' must start at the first byte of the
+// request and keep the same address between calls (bytes are only appended).
+HttpParseResult http_parser_feed(HttpParser *p, const char *buf, size_t len);
+
+// Does the comma-separated header value contain 'token' (case-insensitive)?
+// Example: value "keep-alive, Upgrade", token "keep-alive" → 1
+int http_header_has_token(StrView value, const char *token);
+
+// Does an If-None-Match value ("\"a\", W/\"b\"" or "*") match 'etag' (with
+// its quotes)? Uses the weak comparison RFC 9110 prescribes for it.
+int http_etag_match(StrView if_none_match, const char *etag);
+
+// Value of 'key' in a query string ("city=Malmo&x=1"), URL-decoded into the
+// arena (so it is never truncated). NULL if the key is missing or the arena
+// is full. Scans the query once per call: for several keys use HttpQuery.
+char *http_query_param(Arena *a, StrView query, const char *key);
+
+#define HTTP_QUERY_MAX 16       // key=value pairs kept by http_query_parse()
+
+// One key=value pair of a query, as views into the request.
+typedef struct {
+    StrView key;
+    StrView value;              // still URL-encoded
+    int escaped;                // value contains '%' or '+': decode before use
+} HttpQueryParam;
+
+// A query string split into its pairs in one pass.
+typedef struct {
+    HttpQueryParam params[HTTP_QUERY_MAX];
+    size_t count;
+    StrView rest;               // pairs after the first HTTP_QUERY_MAX (searched on a miss)
+} HttpQuery;
+
+// Split the query into key=value pairs (pairs without '=' are skipped).
+void http_query_parse(StrView query, HttpQuery *q);
+
+// The first pair named 'key'; NULL if there is none. A pair found in
+// q->rest is returned in 'tmp'.
+const HttpQueryParam *http_query_find(const HttpQuery *q, const char *key, HttpQueryParam *tmp);
+
+// Like http_query_param(): the decoded value of 'key' in the arena, or NULL.
+char *http_query_get(const HttpQuery *q, Arena *a, const char *key);
+
+// Decode %xx escapes and '+' (space) in place. The result is never longer.
+// Example: "Malmo%20City" → "Malmo City"
+void http_url_decode(char *s);
+
+// Helpers for comparing views with C string literals.
+int sv_eq(StrView v, const char *s);
+int sv_starts_with(StrView v, const char *prefix);
+
+#endif
@@ -0,0 +1,176 @@
+// Streaming JSON writer (see json_writer.h).
+#include "json_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const double POW10[JSON_MAX_DECIMALS + 1] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+// What a byte turns into inside a string: 0 = itself, 'u' = \u00XX,
+// anything else = backslash + that character.
+static const char ESCAPE[256] = {
+    ['\b'] = 'b', ['\t'] = 't', ['\n'] = 'n', ['\f'] = 'f', ['\r'] = 'r',
+    [0x00] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u', [0x05] = 'u', [0x06] = 'u',
+    [0x07] = 'u', [0x0b] = 'u', [0x0e] = 'u', [0x0f] = 'u', [0x10] = 'u', [0x11] = 'u', [0x12] = 'u',
+    [0x13] = 'u', [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u', [0x18] = 'u', [0x19] = 'u',
+    [0x1a] = 'u', [0x1b] = 'u', [0x1c] = 'u', [0x1d] = 'u', [0x1e] = 'u', [0x1f] = 'u',
+    ['"'] = '"', ['\\'] = '\\',
+};
+
+void json_init(JsonWriter *w, char *buf, size_t room) {
+    w->buf = w->p = buf;
+    w->end = buf + room;
+    w->failed = 0;
+    w->depth = 0;
+    w->after_key = 0;
+    w->has_items = 0;
+}
+
+// Make sure 'n' more bytes fit; once something did not, nothing does.
+static int room_for(JsonWriter *w, size_t n) {
+    if (!w->failed && (size_t)(w->end - w->p) >= n) return 1;
+    w->failed = 1;
+    return 0;
+}
+
+// Comma before every element but the first of its container (and none
+// between a key and its value).
+static void separate(JsonWriter *w) {
+    if (w->after_key) { w->after_key = 0; return; }
+    uint32_t bit = 1u << (w->depth & (JSON_MAX_DEPTH - 1));
+    if (w->has_items & bit) {
+        if (room_for(w, 1)) *w->p++ = ',';
+    }
+    w->has_items |= bit;
+}
+
+static void open_container(JsonWriter *w, char c) {
+    separate(w);
+    if (!room_for(w, 1) || w->depth == JSON_MAX_DEPTH - 1) { w->failed = 1; return; }
+    *w->p++ = c;
+    w->depth++;
+    w->has_items &= ~(1u << w->depth);
+}
+
+static void close_container(JsonWriter *w, char c) {
+    if (!room_for(w, 1) || w->depth == 0) { w->failed = 1; return; }
+    *w->p++ = c;
+    w->depth--;
+}
+
+void json_begin_object(JsonWriter *w) { open_container(w, '{'); }
+void json_end_object(JsonWriter *w) { close_container(w, '}'); }
+void json_begin_array(JsonWriter *w) { open_container(w, '['); }
+void json_end_array(JsonWriter *w) { close_container(w, ']'); }
+
+void json_key(JsonWriter *w, const char *key) {
+    separate(w);
+    size_t len = strlen(key);
+    if (!room_for(w, len + 3)) return;
+    *w->p++ = '"';
+    memcpy(w->p, key, len);
+    w->p += len;
+    *w->p++ = '"';
+    *w->p++ = ':';
+    w->after_key = 1;
+}
+
+void json_string_len(JsonWriter *w, const char *s, size_t len) {
+    separate(w);
+    if (!room_for(w, len + 2)) return;          // the common case: nothing to escape
+    *w->p++ = '"';
+    const unsigned char *in = (const unsigned char *)s, *end = in + len;
+    while (in < end) {
+        const unsigned char *run = in;          // copy runs of plain bytes at once
+        while (in < end && !ESCAPE[*in]) in++;
+        size_t n = (size_t)(in - run);
+        memcpy(w->p, run, n);
+        w->p += n;
+        if (in == end) break;
+        char e = ESCAPE[*in];
+        // Room for this byte escaped, the rest as is and the closing quote.
+        if (!room_for(w, (e == 'u' ? 6 : 2) + (size_t)(end - in))) return;
+        *w->p++ = '\\';
+        if (e == 'u') {
+            static const char HEX[] = "0123456789abcdef";
+            memcpy(w->p, "u00", 3);
+            w->p[3] = HEX[*in >> 4];
+            w->p[4] = HEX[*in & 15];
+            w->p += 5;
+        } else {
+            *w->p++ = e;
+        }
+        in++;
+    }
+    *w->p++ = '"';
+}
+
+void json_string(JsonWriter *w, const char *s) {
+    json_string_len(w, s, strlen(s));
+}
+
+// Digits of v, most significant first, at w->p (room already checked).
+static void put_digits(JsonWriter *w, uint64_t v, int min_digits) {
+    char tmp[20];
+    int n = 0;
+    do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v || n < min_digits);
+    while (n) *w->p++ = tmp[--n];
+}
+
+void json_int(JsonWriter *w, long long v) {
+    separate(w);
+    if (!room_for(w, 21)) return;
+    uint64_t u = (uint64_t)v;
+    if (v < 0) { *w->p++ = '-'; u = 0 - u; }
+    put_digits(w, u, 1);
+}
+
+// |v| · 10^decimals rounded to an integer the way printf rounds: to nearest,
+// ties to even, decided on the exact value of v (fma gives the rounding
+// error of the multiplication, so 0.15 → "0.1" like printf, not "0.2").
+static uint64_t scaled(double v, int decimals) {
+    double x = v * POW10[decimals];
+    double whole = floor(x);
+    double frac = x - whole;                    // exact: x < 2^53
+    uint64_t n = (uint64_t)whole;
+    if (frac > 0.5) return n + 1;
+    if (frac < 0.5) return n;
+    double err = fma(v, POW10[decimals], -x);   // exact value = x + err
+    return err > 0 || (err == 0 && (n & 1)) ? n + 1 : n;
+}
+
+// Write v with 'decimals' digits after the point; trim: drop trailing zeros.
+static void put_fixed(JsonWriter *w, double v, int decimals, int trim) {
+    separate(w);
+    if (decimals < 0) decimals = 0;
+    if (decimals > JSON_MAX_DECIMALS) decimals = JSON_MAX_DECIMALS;
+    if (!room_for(w, 32)) return;
+    if (!isfinite(v)) { memcpy(w->p, "null", 4); w->p += 4; return; }
+    double a = fabs(v);
+    if (a * POW10[decimals] >= 9007199254740992.0) {  // beyond 2^53: rare enough for printf
+        int n = snprintf(w->p, (size_t)(w->end - w->p), "%.*f", decimals, v);
+        if (n < 0 || n >= w->end - w->p) { w->failed = 1; return; }
+        w->p += n;
+        return;
+    }
+    uint64_t n = scaled(a, decimals);
+    if (n && v < 0) *w->p++ = '-';              // "-0.0" would be odd in JSON
+    uint64_t unit = (uint64_t)POW10[decimals];
+    put_digits(w, n / unit, 1);
+    uint64_t frac = n % unit;
+    if (decimals == 0 || (trim && frac == 0)) return;
+    if (trim) {
+        while (frac % 10 == 0) { frac /= 10; decimals--; }
+    }
+    *w->p++ = '.';
+    put_digits(w, frac, decimals);
+}
+
+void json_fixed(JsonWriter *w, double v, int decimals) {
+    put_fixed(w, v, decimals, 0);
+}
+
+void json_number(JsonWriter *w, double v, int decimals) {
+    put_fixed(w, v, decimals, 1);
+}
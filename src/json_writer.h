@@ -0,0 +1,58 @@
+// Streaming JSON writer for response bodies: appends to a caller's buffer
+// (usually the connection's output buffer) with no format strings, no
+// locale and no allocation. Strings are escaped; numbers are written with a
+// fixed number of decimals by integer arithmetic, correctly rounded like
+// printf("%.*f"). Commas between elements are inserted automatically.
+// Running out of room sets 'failed' and stops all further output, so callers
+// check once at the end.
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_MAX_DEPTH 32           // nesting levels tracked for comma placement
+#define JSON_MAX_DECIMALS 9
+
+typedef struct {
+    char *buf;                      // start of the output
+    char *p;                        // next byte to write
+    char *end;                      // one past the last usable byte
+    int failed;                     // ran out of room: the output is incomplete
+    int depth;                      // open objects/arrays
+    int after_key;                  // the next value belongs to the key just written
+    uint32_t has_items;             // bit d: the container at depth d has an element already
+} JsonWriter;
+
+// Write into buf[0..room); nothing is NUL-terminated.
+void json_init(JsonWriter *w, char *buf, size_t room);
+
+void json_begin_object(JsonWriter *w);
+void json_end_object(JsonWriter *w);
+void json_begin_array(JsonWriter *w);
+void json_end_array(JsonWriter *w);
+
+// Member name inside an object. Written as is: 'key' must not need escaping
+// (it is always a literal in our code).
+void json_key(JsonWriter *w, const char *key);
+
+// String values, escaped ("\"", "\\", control characters; UTF-8 is copied).
+void json_string(JsonWriter *w, const char *s);
+void json_string_len(JsonWriter *w, const char *s, size_t len);
+
+// Number with exactly 'decimals' (0..9) digits after the point, like "%.*f"
+// ("10.5", "55.6050"). Non-finite values become null (JSON has no NaN).
+void json_fixed(JsonWriter *w, double v, int decimals);
+
+// The same with trailing zeros (and a bare point) dropped: 55.6050 with 6
+// decimals → "55.605", 13.0 → "13".
+void json_number(JsonWriter *w, double v, int decimals);
+
+void json_int(JsonWriter *w, long long v);
+
+// Bytes written so far.
+static inline size_t json_length(const JsonWriter *w) {
+    return (size_t)(w->p - w->buf);
+}
+
+#endif
@@ -0,0 +1,161 @@
+// Per-worker request metrics and their Prometheus rendering (see metrics.h).
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Status codes with their own slot; anything else lands in the last one.
+static const int STATUS_CODES[METRICS_STATUS_SLOTS - 1] = {
+    200, 204, 304, 400, 404, 405, 413, 429, 431, 500, 502, 503, 504
+};
+
+static int status_slot(int status) {
+    for (int i = 0; i < METRICS_STATUS_SLOTS - 1; i++) {
+        if (STATUS_CODES[i] == status) return i;
+    }
+    return METRICS_STATUS_SLOTS - 1;
+}
+
+// Bucket k holds (250 ns · 2^(k-1), 250 ns · 2^k]; the last one is +Inf.
+static int latency_bucket(uint64_t ns) {
+    uint64_t v = (ns + 249) / 250;                  // in 250 ns units, rounded up
+    int k = v <= 1 ? 0 : 64 - __builtin_clzll(v - 1);
+    return k < METRICS_BUCKETS ? k : METRICS_BUCKETS;
+}
+
+static void hist_observe(MetricsHistogram *h, uint64_t ns) {
+    metrics_add(&h->counts[latency_bucket(ns)], 1);
+    metrics_add(&h->sum_ns, ns);
+}
+
+MetricsShard *metrics_create(int n) {
+    MetricsShard *m = aligned_alloc(64, (size_t)n * sizeof(*m));   // sizeof is a multiple of 64
+    if (m) memset(m, 0, (size_t)n * sizeof(*m));
+    return m;
+}
+
+void metrics_request(MetricsShard *m, RouteId route, int status, uint64_t ns) {
+    metrics_add(&m->requests[route][status_slot(status)], 1);
+    hist_observe(&m->latency[route], ns);
+}
+
+void metrics_upstream(MetricsShard *m, int ok, uint64_t ns) {
+    if (!ok) metrics_add(&m->upstream_errors, 1);
+    hist_observe(&m->upstream, ns);
+}
+
+static uint64_t load(const uint64_t *c) {
+    return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+// Growing output buffer; 'failed' sticks once memory runs out.
+typedef struct {
+    char *p;
+    size_t len, cap;
+    int failed;
+} Out;
+
+__attribute__((format(printf, 2, 3)))
+static void out_printf(Out *o, const char *fmt, ...) {
+    while (!o->failed) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(o->p + o->len, o->cap - o->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) { o->failed = 1; return; }
+        if ((size_t)n < o->cap - o->len) { o->len += (size_t)n; return; }
+        char *p = realloc(o->p, o->cap * 2 + (size_t)n);
+        if (!p) { o->failed = 1; return; }
+        o->p = p;
+        o->cap = o->cap * 2 + (size_t)n;
+    }
+}
+
+static void hist_sum(MetricsHistogram *into, const MetricsHistogram *h) {
+    for (int i = 0; i <= METRICS_BUCKETS; i++) into->counts[i] += load(&h->counts[i]);
+    into->sum_ns += load(&h->sum_ns);
+}
+
+// One histogram's sample lines: cumulative buckets, sum and count.
+static void render_hist(Out *o, const char *name, const char *labels, const MetricsHistogram *h) {
+    uint64_t total = 0;
+    const char *sep = *labels ? "," : "";
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        total += h->counts[i];
+        out_printf(o, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep,
+                   250e-9 * (double)(1ULL << i), (unsigned long long)total);
+    }
+    total += h->counts[METRICS_BUCKETS];
+    out_printf(o, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, (unsigned long long)total);
+    const char *open = *labels ? "{" : "", *close = *labels ? "}" : "";
+    out_printf(o, "%s_sum%s%s%s %.9f\n", name, open, labels, close, (double)h->sum_ns / 1e9);
+    out_printf(o, "%s_count%s%s%s %llu\n", name, open, labels, close, (unsigned long long)total);
+}
+
+static void render_counter(Out *o, const char *name, const char *help, uint64_t v) {
+    out_printf(o, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)v);
+}
+
+char *metrics_render(const MetricsShard *shards, int n, const WeatherCacheStats *cache, size_t *len) {
+    // Start from a snapshot of the sums: every counter is read once.
+    uint64_t requests[ROUTE_COUNT][METRICS_STATUS_SLOTS] = { { 0 } };
+    MetricsHistogram latency[ROUTE_COUNT], upstream;
+    memset(latency, 0, sizeof(latency));
+    memset(&upstream, 0, sizeof(upstream));
+    uint64_t upstream_errors = 0, accepted = 0, closed = 0, rejected = 0, dropped = 0;
+    for (int s = 0; s < n; s++) {
+        const MetricsShard *m = &shards[s];
+        for (int r = 0; r < ROUTE_COUNT; r++) {
+            for (int i = 0; i < METRICS_STATUS_SLOTS; i++) requests[r][i] += load(&m->requests[r][i]);
+            hist_sum(&latency[r], &m->latency[r]);
+        }
+        hist_sum(&upstream, &m->upstream);
+        upstream_errors += load(&m->upstream_errors);
+        accepted += load(&m->conns_accepted);
+        closed += load(&m->conns_closed);
+        rejected += load(&m->conns_rejected);
+        dropped += load(&m->log_dropped);
+    }
+
+    Out o = { malloc(16384), 0, 16384, 0 };
+    if (!o.p) return NULL;
+    out_printf(&o, "# HELP weather_http_requests_total Responses sent, by route and status code.\n"
+                   "# TYPE weather_http_requests_total counter\n");
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        for (int i = 0; i < METRICS_STATUS_SLOTS; i++) {
+            if (!requests[r][i]) continue;                      // only combinations that occurred
+            char status[8];
+            if (i < METRICS_STATUS_SLOTS - 1) snprintf(status, sizeof(status), "%d", STATUS_CODES[i]);
+            else snprintf(status, sizeof(status), "other");
+            out_printf(&o, "weather_http_requests_total{route=\"%s\",status=\"%s\"} %llu\n",
+                       route_name((RouteId)r), status, (unsigned long long)requests[r][i]);
+        }
+    }
+    out_printf(&o, "# HELP weather_http_request_duration_seconds Time from reading a request to queueing its response.\n"
+                   "# TYPE weather_http_request_duration_seconds histogram\n");
+    for (int r = ROUTE_GEO; r <= ROUTE_FORECAST; r++) {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "route=\"%s\"", route_name((RouteId)r));
+        render_hist(&o, "weather_http_request_duration_seconds", labels, &latency[r]);
+    }
+    out_printf(&o, "# HELP weather_connections_active Client connections currently open.\n"
+                   "# TYPE weather_connections_active gauge\n"
+                   "weather_connections_active %llu\n", (unsigned long long)(accepted - closed));
+    render_counter(&o, "weather_connections_accepted_total", "Client connections accepted.", accepted);
+    render_counter(&o, "weather_connections_rejected_total", "Client connections turned away with 503 at the connection limit.", rejected);
+    render_counter(&o, "weather_cache_hits_total", "Weather cache lookups answered with a fresh entry.", cache->hits);
+    render_counter(&o, "weather_cache_stale_hits_total", "Weather cache lookups answered with an expired entry being refreshed.", cache->stale);
+    render_counter(&o, "weather_cache_misses_total", "Weather cache lookups that needed the provider.", cache->misses);
+    render_counter(&o, "weather_cache_evictions_total", "Live weather cache entries evicted to make room.", cache->evictions);
+    render_counter(&o, "weather_cache_fetch_errors_total", "Provider fetches stored as failures.", cache->errors);
+    render_counter(&o, "weather_upstream_errors_total", "Upstream provider requests that failed or did not return 200.", upstream_errors);
+    render_counter(&o, "weather_access_log_dropped_total", "Access log records dropped because the log writer fell behind.", dropped);
+    out_printf(&o, "# HELP weather_upstream_duration_seconds Time from queueing an upstream provider request to its answer.\n"
+                   "# TYPE weather_upstream_duration_seconds histogram\n");
+    render_hist(&o, "weather_upstream_duration_seconds", "", &upstream);
+    if (o.failed) { free(o.p); return NULL; }
+    *len = o.len;
+    return o.p;
+}
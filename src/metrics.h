@@ -0,0 +1,55 @@
+// Request metrics for the /metrics endpoint (Prometheus text format).
+// Every worker thread counts into its own MetricsShard: the shards are
+// cache-line aligned and only ever written by their owner, so counting is a
+// plain add with no lock, no atomic read-modify-write and no false sharing.
+// Shards are summed only when /metrics is scraped.
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "router.h"
+#include "weather_cache.h"
+
+#define METRICS_STATUS_SLOTS 14      // the status codes the server sends, and "other"
+#define METRICS_BUCKETS 25           // latency buckets: 250 ns · 2^k, up to ~4.2 s (plus +Inf)
+
+// Latency histogram: counts[i] observations in bucket i (not cumulative).
+typedef struct {
+    uint64_t counts[METRICS_BUCKETS + 1];
+    uint64_t sum_ns;
+} MetricsHistogram;
+
+typedef struct {
+    _Alignas(64) uint64_t requests[ROUTE_COUNT][METRICS_STATUS_SLOTS];
+    MetricsHistogram latency[ROUTE_COUNT];  // request read → response queued
+    MetricsHistogram upstream;              // upstream_get() → answer
+    uint64_t upstream_errors;               // failed or non-200 upstream requests
+    uint64_t conns_accepted;
+    uint64_t conns_closed;                  // active = accepted - closed
+    uint64_t conns_rejected;                // turned away with 503 (--max-conns)
+    uint64_t log_dropped;                   // access log records lost to a full ring
+} MetricsShard;
+
+// 'n' zeroed shards (one per worker), or NULL if out of memory.
+MetricsShard *metrics_create(int n);
+
+// Count one response of 'route' with HTTP 'status', 'ns' after the request
+// was read. Only the shard's own worker may call this.
+void metrics_request(MetricsShard *m, RouteId route, int status, uint64_t ns);
+
+// Count one upstream request that took 'ns' (ok: answered with 200).
+void metrics_upstream(MetricsShard *m, int ok, uint64_t ns);
+
+// Single-writer counter update: other threads may read it at any time.
+static inline void metrics_add(uint64_t *c, uint64_t v) {
+    __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+// Sum the shards and format everything (plus the cache counters) in the
+// Prometheus text exposition format. Returns a malloc'd string (length in
+// *len), or NULL if out of memory.
+char *metrics_render(const MetricsShard *shards, int n, const WeatherCacheStats *cache, size_t *len);
+
+#endif
@@ -0,0 +1,224 @@
+// Weather providers: built-in demo data and Open-Meteo over HTTP.
+#include "provider.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------
+// Demo provider: fixed numbers for a few demo cities, "Cloudy" elsewhere.
+
+typedef struct {
+    const CityDb *cities;
+    double radius_km;
+} DemoCtx;
+
+static int demo_fetch(const WeatherProvider *p, double lat, double lon, WeatherReport *out) {
+    const DemoCtx *ctx = p->ctx;
+    const CityRecord *c = city_db_nearest(ctx->cities, lat, lon, ctx->radius_km, NULL);
+    double tempC = 7.0;                     // default value
+    const char *desc = "Cloudy";            // default description
+    if (c) {
+        const char *name = city_db_name(ctx->cities, c);
+        if (strcmp(name, "Malmo") == 0) { tempC = 10.5; desc = "Sunny"; }
+        else if (strcmp(name, "Gothenburg") == 0) { tempC = 8.2; desc = "Windy"; }
+        else if (strcmp(name, "Orebro") == 0) { tempC = 6.3; desc = "Overcast"; }
+    }
+    out->temp_c = tempC;
+    snprintf(out->description, sizeof(out->description), "%s", desc);
+    out->updated_at = time(NULL);
+    return 0;
+}
+
+// The current demo numbers as the daily mean of a diurnal curve (coldest
+// around 04:00 UTC, warmest around 16:00), with an afternoon shower every
+// other day unless it is sunny.
+static int demo_fetch_forecast(const WeatherProvider *p, double lat, double lon, ForecastSeries *out) {
+    WeatherReport now;
+    demo_fetch(p, lat, lon, &now);
+    int sunny = strcmp(now.description, "Sunny") == 0;
+    uint8_t code = sunny ? 0 : strcmp(now.description, "Windy") == 0 ? 2 : 3;
+    int64_t hour = (int64_t)now.updated_at / 3600 * 3600;
+    for (uint32_t i = 0; i < FORECAST_MAX_HOURS; i++) {
+        int64_t t = hour + (int64_t)i * 3600;
+        int h = (int)(t / 3600 % 24), day = (int)(t / 86400);
+        int shower = !sunny && (day & 1) && h >= 14 && h < 17;
+        out->time[i] = t;
+        out->temp_c[i] = (float)(now.temp_c + 4.0 * sin((h - 10) * (M_PI / 12)));
+        out->precip_mm[i] = shower ? 0.8f : 0.0f;
+        out->code[i] = shower ? 61 : code;
+    }
+    out->count = FORECAST_MAX_HOURS;
+    out->updated_at = now.updated_at;
+    return 0;
+}
+
+const WeatherProvider *provider_demo(const CityDb *cities, double radius_km) {
+    static DemoCtx ctx;
+    static WeatherProvider p = { "demo", demo_fetch, NULL, NULL, NULL, NULL, NULL, 0,
+                                 demo_fetch_forecast, NULL, NULL, &ctx };
+    ctx.cities = cities;
+    ctx.radius_km = radius_km;
+    return &p;
+}
+
+// ---------------------------------------------------------------------------
+// Open-Meteo: GET /v1/forecast?latitude=..&longitude=..&current=temperature_2m,weather_code
+
+const char *wmo_code_description(int code) {
+    switch (code) {
+    case 0: return "Clear sky";
+    case 1: return "Mainly clear";
+    case 2: return "Partly cloudy";
+    case 3: return "Overcast";
+    case 45: case 48: return "Fog";
+    case 51: case 53: case 55: return "Drizzle";
+    case 56: case 57: return "Freezing drizzle";
+    case 61: return "Light rain";
+    case 63: return "Rain";
+    case 65: return "Heavy rain";
+    case 66: case 67: return "Freezing rain";
+    case 71: case 73: case 75: case 77: return "Snow";
+    case 80: case 81: case 82: return "Rain showers";
+    case 85: case 86: return "Snow showers";
+    case 95: return "Thunderstorm";
+    case 96: case 99: return "Thunderstorm with hail";
+    default: return "Unknown";
+    }
+}
+
+// Read a number following "key": inside obj[0..len). Returns 1 if found.
+static int json_number_after(const char *obj, size_t len, const char *key, double *out) {
+    size_t klen = strlen(key);
+    for (const char *p = obj; p + klen < obj + len; p++) {
+        if (memcmp(p, key, klen) == 0) {
+            char *end;
+            *out = strtod(p + klen, &end);
+            return end != p + klen;
+        }
+    }
+    return 0;
+}
+
+// Pick temperature and weather code out of the first "current": {...} object
+// in body[0..len). Returns a pointer just past that object, or NULL.
+static const char *parse_current(const char *body, size_t len, WeatherReport *out) {
+    const char *cur = NULL;
+    for (size_t i = 0; i + 11 <= len; i++) {
+        if (memcmp(body + i, "\"current\":{", 11) == 0) { cur = body + i + 11; break; }
+    }
+    if (!cur) return NULL;
+    const char *cend = memchr(cur, '}', (size_t)(body + len - cur));
+    if (!cend) return NULL;
+    double temp, code;
+    if (!json_number_after(cur, (size_t)(cend - cur), "\"temperature_2m\":", &temp)) return NULL;
+    if (!json_number_after(cur, (size_t)(cend - cur), "\"weather_code\":", &code)) return NULL;
+    out->temp_c = temp;
+    snprintf(out->description, sizeof(out->description), "%s", wmo_code_description((int)code));
+    out->updated_at = time(NULL);
+    return cend + 1;
+}
+
+static int open_meteo_parse(const WeatherProvider *p, const char *body, size_t len, WeatherReport *out) {
+    (void)p;
+    return parse_current(body, len, out) ? 0 : -1;
+}
+
+// Several locations come back as a JSON array of the single-location
+// objects, in request order: take one "current" block after the other.
+static int open_meteo_parse_batch(const WeatherProvider *p, const char *body, size_t len,
+                                  WeatherReport *out, size_t n) {
+    (void)p;
+    const char *end = body + len;
+    for (size_t i = 0; i < n; i++) {
+        const char *next = parse_current(body, (size_t)(end - body), &out[i]);
+        if (!next) return -1;
+        body = next;
+    }
+    return 0;
+}
+
+static int open_meteo_path(const WeatherProvider *p, double lat, double lon, char *out, size_t room) {
+    (void)p;
+    return snprintf(out, room, "/v1/forecast?latitude=%.2f&longitude=%.2f&current=temperature_2m,weather_code",
+                    lat, lon);
+}
+
+// /v1/forecast?latitude=a,b,c&longitude=x,y,z&current=...
+static int open_meteo_batch_path(const WeatherProvider *p, const double *lat, const double *lon, size_t n,
+                                 char *out, size_t room) {
+    (void)p;
+    size_t len = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        const double *v = pass == 0 ? lat : lon;
+        int w = snprintf(len < room ? out + len : NULL, len < room ? room - len : 0, pass == 0 ? "/v1/forecast?latitude=" : "&longitude=");
+        len += (size_t)w;
+        for (size_t i = 0; i < n; i++) {
+            w = snprintf(len < room ? out + len : NULL, len < room ? room - len : 0, i ? ",%.2f" : "%.2f", v[i]);
+            len += (size_t)w;
+        }
+    }
+    len += (size_t)snprintf(len < room ? out + len : NULL, len < room ? room - len : 0, "&current=temperature_2m,weather_code");
+    return (int)len;
+}
+
+static int open_meteo_forecast_path(const WeatherProvider *p, double lat, double lon, char *out, size_t room) {
+    (void)p;
+    return snprintf(out, room, "/v1/forecast?latitude=%.2f&longitude=%.2f"
+                    "&hourly=temperature_2m,precipitation,weather_code&forecast_days=7&timeformat=unixtime",
+                    lat, lon);
+}
+
+// Read the numbers of the array following "key": inside obj[0..len) into
+// out[0..max). Returns how many were read, or -1 if the key is missing.
+static int json_numbers_after(const char *obj, size_t len, const char *key, double *out, int max) {
+    size_t klen = strlen(key);
+    const char *end = obj + len;
+    for (const char *p = obj; p + klen < end; p++) {
+        if (memcmp(p, key, klen) != 0) continue;
+        int n = 0;
+        for (p += klen; n < max && p < end && *p != ']'; p++) {     // p: '[' or ','
+            char *next;
+            out[n] = strtod(p + 1, &next);
+            if (next == p + 1) break;                               // empty array or null
+            n++;
+            p = next - 1;
+        }
+        return n;
+    }
+    return -1;
+}
+
+// The "hourly" object holds one array per variable, all of the same length:
+// exactly the columns of a ForecastSeries.
+static int open_meteo_parse_forecast(const WeatherProvider *p, const char *body, size_t len, ForecastSeries *out) {
+    (void)p;
+    const char *h = NULL;
+    for (size_t i = 0; i + 10 <= len; i++) {
+        if (memcmp(body + i, "\"hourly\":{", 10) == 0) { h = body + i + 10; break; }
+    }
+    if (!h) return -1;
+    size_t hlen = (size_t)(body + len - h);
+    double col[FORECAST_MAX_HOURS];
+    int n = json_numbers_after(h, hlen, "\"time\":", col, FORECAST_MAX_HOURS);
+    if (n <= 0) return -1;
+    for (int i = 0; i < n; i++) out->time[i] = (int64_t)col[i];
+    if (json_numbers_after(h, hlen, "\"temperature_2m\":", col, n) != n) return -1;
+    for (int i = 0; i < n; i++) out->temp_c[i] = (float)col[i];
+    if (json_numbers_after(h, hlen, "\"precipitation\":", col, n) != n) return -1;
+    for (int i = 0; i < n; i++) out->precip_mm[i] = (float)col[i];
+    if (json_numbers_after(h, hlen, "\"weather_code\":", col, n) != n) return -1;
+    for (int i = 0; i < n; i++) out->code[i] = (uint8_t)col[i];
+    out->count = (uint32_t)n;
+    out->updated_at = time(NULL);
+    return 0;
+}
+
+const WeatherProvider *provider_open_meteo(const char *host) {
+    static WeatherProvider p = { "open-meteo", NULL, NULL, open_meteo_path, open_meteo_parse,
+                                 open_meteo_batch_path, open_meteo_parse_batch, 50,
+                                 NULL, open_meteo_forecast_path, open_meteo_parse_forecast, NULL };
+    p.upstream = host ? host : "api.open-meteo.com";
+    return &p;
+}
@@ -0,0 +1,76 @@
+// Weather providers: where current conditions come from.
+// A provider is a small table of function pointers, so the server can use
+// the built-in demo data or a real upstream (Open-Meteo) with the same code.
+// Local providers answer through fetch(). HTTP providers only describe the
+// request and how to read the answer; the server sends it from its event
+// loop (see upstream.h), so a slow upstream never blocks other clients.
+#ifndef PROVIDER_H
+#define PROVIDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "cities.h"
+
+// Current conditions at one location.
+typedef struct {
+    double temp_c;          // air temperature (°C)
+    char description[32];   // short text, e.g., "Sunny" or "Light rain"
+    time_t updated_at;      // when the data was fetched (UTC seconds)
+} WeatherReport;
+
+#define FORECAST_MAX_HOURS 168  // 7 days of hourly values per location
+
+// Hourly forecast for one location, struct-of-arrays: every column is a
+// contiguous array, so slicing an hour range is one memcpy per column and
+// serializing a column is one tight loop.
+typedef struct {
+    uint32_t count;                     // values in each column
+    time_t updated_at;                  // when the data was fetched (UTC seconds)
+    int64_t time[FORECAST_MAX_HOURS];   // start of each hour (UTC seconds), ascending
+    float temp_c[FORECAST_MAX_HOURS];   // air temperature (°C)
+    float precip_mm[FORECAST_MAX_HOURS]; // precipitation during the hour (mm)
+    uint8_t code[FORECAST_MAX_HOURS];   // WMO weather code (see wmo_code_description)
+} ForecastSeries;
+
+typedef struct WeatherProvider WeatherProvider;
+
+struct WeatherProvider {
+    const char *name;       // "demo" or "open-meteo"
+    // Local providers: current weather for lat/lon, without blocking.
+    // Returns 0 and fills 'out', or -1. NULL for HTTP providers.
+    int (*fetch)(const WeatherProvider *p, double lat, double lon, WeatherReport *out);
+    // HTTP providers: the server to ask ("host[:port]"), the path + query of
+    // the GET request for lat/lon (returns its length, >= room if truncated),
+    // and a parser for the 200 response body (returns 0 and fills 'out', or -1).
+    const char *upstream;
+    int (*format_path)(const WeatherProvider *p, double lat, double lon, char *out, size_t room);
+    int (*parse)(const WeatherProvider *p, const char *body, size_t len, WeatherReport *out);
+    // Optional (NULL = one request per location): the same for n locations
+    // in one request. parse_batch fills out[0..n) in request order and
+    // returns 0, or -1 if the answer is unusable.
+    int (*format_batch_path)(const WeatherProvider *p, const double *lat, const double *lon, size_t n,
+                             char *out, size_t room);
+    int (*parse_batch)(const WeatherProvider *p, const char *body, size_t len, WeatherReport *out, size_t n);
+    size_t batch_max;       // most locations format_batch_path accepts at once
+    // Optional (NULL = no forecasts): the hourly forecast from now on, the
+    // same way as current weather (fetch_forecast for local providers,
+    // format_forecast_path + parse_forecast for HTTP providers).
+    int (*fetch_forecast)(const WeatherProvider *p, double lat, double lon, ForecastSeries *out);
+    int (*format_forecast_path)(const WeatherProvider *p, double lat, double lon, char *out, size_t room);
+    int (*parse_forecast)(const WeatherProvider *p, const char *body, size_t len, ForecastSeries *out);
+    void *ctx;              // provider-specific settings
+};
+
+// Demo data derived from the nearest known city (never fails, no network).
+const WeatherProvider *provider_demo(const CityDb *cities, double radius_km);
+
+// Open-Meteo forecast API over plain HTTP. 'host' may include ":port"
+// (default "api.open-meteo.com").
+const WeatherProvider *provider_open_meteo(const char *host);
+
+// Text for a WMO weather interpretation code (as used by Open-Meteo).
+const char *wmo_code_description(int code);
+
+#endif
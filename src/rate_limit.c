@@ -0,0 +1,125 @@
+// Lock-free token buckets (see rate_limit.h).
+// A slot is two 64-bit words: the client key, and the bucket state packed
+// as (last refill time << 24 | milli-tokens) so that one compare-and-swap
+// updates it. Slots come in 64-byte groups of four and a client only ever
+// probes its own group: one cache line per request, and workers serving
+// different clients rarely touch the same line.
+#include "rate_limit.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define GROUP_SLOTS 4
+#define TOKEN_BITS 24
+#define TOKEN_MASK ((1ULL << TOKEN_BITS) - 1)
+#define MILLI 1000                  // one token in milli-tokens
+
+typedef struct {
+    _Atomic uint64_t key;           // 0 = free
+    _Atomic uint64_t state;         // 0 = new bucket (full); else time_ms << TOKEN_BITS | milli-tokens
+} Slot;
+
+typedef struct {
+    _Alignas(64) Slot slots[GROUP_SLOTS];
+} Group;
+
+struct RateLimiter {
+    _Atomic uint64_t rate;          // milli-tokens per ms (= tokens per second)
+    _Atomic uint64_t burst;         // milli-tokens
+    long long epoch_ms;             // times are stored relative to this, plus one (never 0)
+    size_t mask;                    // groups - 1
+    Group *groups;
+};
+
+static long long mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 64-bit mix (splitmix64 finalizer): neighbouring addresses land in different groups
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void rate_limiter_set(RateLimiter *rl, unsigned rate, unsigned burst) {
+    if (rate < 1) rate = 1;
+    if (burst < 1) burst = 1;
+    if (burst > RATE_LIMIT_MAX_BURST) burst = RATE_LIMIT_MAX_BURST;
+    atomic_store_explicit(&rl->rate, rate, memory_order_relaxed);
+    atomic_store_explicit(&rl->burst, (uint64_t)burst * MILLI, memory_order_relaxed);
+}
+
+RateLimiter *rate_limiter_create(unsigned rate, unsigned burst, size_t slots) {
+    size_t groups = 1;
+    while (groups * GROUP_SLOTS < slots) groups <<= 1;
+    RateLimiter *rl = malloc(sizeof(*rl));
+    if (!rl) return NULL;
+    rl->groups = aligned_alloc(64, groups * sizeof(Group));
+    if (!rl->groups) { free(rl); return NULL; }
+    for (size_t g = 0; g < groups; g++) {
+        for (int i = 0; i < GROUP_SLOTS; i++) {
+            atomic_init(&rl->groups[g].slots[i].key, 0);
+            atomic_init(&rl->groups[g].slots[i].state, 0);
+        }
+    }
+    rate_limiter_set(rl, rate, burst);
+    rl->epoch_ms = mono_ms();
+    rl->mask = groups - 1;
+    return rl;
+}
+
+// The slot of 'client' in its group: found, claimed if free, or taken over
+// from the member that has been idle longest.
+static Slot *slot_of(RateLimiter *rl, uint64_t client) {
+    Group *g = &rl->groups[mix(client) & rl->mask];
+    for (int i = 0; i < GROUP_SLOTS; i++) {
+        Slot *s = &g->slots[i];
+        uint64_t k = atomic_load_explicit(&s->key, memory_order_acquire);
+        if (k == client) return s;
+        if (k == 0) {
+            uint64_t expected = 0;
+            if (atomic_compare_exchange_strong(&s->key, &expected, client) || expected == client) return s;
+        }
+    }
+    Slot *oldest = &g->slots[0];
+    uint64_t oldest_state = UINT64_MAX;
+    for (int i = 0; i < GROUP_SLOTS; i++) {
+        uint64_t st = atomic_load_explicit(&g->slots[i].state, memory_order_relaxed);
+        if (st < oldest_state) { oldest_state = st; oldest = &g->slots[i]; }  // time is the high bits
+    }
+    // A racing update of the evicted client may still land in this bucket;
+    // the only effect is one slightly wrong token count.
+    atomic_store_explicit(&oldest->key, client, memory_order_release);
+    atomic_store_explicit(&oldest->state, 0, memory_order_relaxed);
+    return oldest;
+}
+
+long rate_limiter_take(RateLimiter *rl, uint64_t client, long long now_ms) {
+    Slot *s = slot_of(rl, client);
+    uint64_t rate = atomic_load_explicit(&rl->rate, memory_order_relaxed);
+    uint64_t burst = atomic_load_explicit(&rl->burst, memory_order_relaxed);
+    uint64_t now = (uint64_t)(now_ms - rl->epoch_ms + 1);
+    uint64_t st = atomic_load_explicit(&s->state, memory_order_relaxed);
+    while (1) {
+        uint64_t tokens = burst;                // new bucket: full
+        if (st) {
+            uint64_t last = st >> TOKEN_BITS;
+            tokens = st & TOKEN_MASK;
+            if (tokens > burst) tokens = burst; // the burst was lowered since
+            if (now > last) {
+                uint64_t add = (now - last) * rate;
+                tokens = add >= burst - tokens ? burst : tokens + add;
+            }
+        }
+        int allowed = tokens >= MILLI;
+        uint64_t next = now << TOKEN_BITS | (allowed ? tokens - MILLI : tokens);
+        if (atomic_compare_exchange_weak_explicit(&s->state, &st, next,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return allowed ? 0 : (long)((MILLI - tokens + rate - 1) / rate);
+        }
+    }
+}
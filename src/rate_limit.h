@@ -0,0 +1,32 @@
+// Per-client request rate limiting with token buckets, shared by all worker
+// threads without locks. Each client (a key derived from its address) has a
+// bucket of 'burst' tokens refilled at 'rate' tokens per second; every
+// request takes one. The table has a fixed size: clients map to a group of
+// four slots, and when a group is full the longest-idle client in it is
+// forgotten (it comes back with a full bucket, which only ever errs on the
+// side of letting a request through).
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RATE_LIMIT_MAX_BURST 16000  // tokens are kept in 1/1000 units in 24 bits
+
+typedef struct RateLimiter RateLimiter;
+
+// rate: tokens per second (>= 1); burst: bucket size (1..RATE_LIMIT_MAX_BURST);
+// slots: clients tracked at once (rounded up to a power of two). NULL if out
+// of memory.
+RateLimiter *rate_limiter_create(unsigned rate, unsigned burst, size_t slots);
+
+// Change the rate and burst of a running limiter (any thread; takes effect
+// from the next request of each client).
+void rate_limiter_set(RateLimiter *rl, unsigned rate, unsigned burst);
+
+// Take a token from the bucket of 'client' (any non-zero key) at monotonic
+// time 'now_ms'. Returns 0 if the request may go ahead, else the
+// milliseconds until the bucket has a token again.
+long rate_limiter_take(RateLimiter *rl, uint64_t client, long long now_ms);
+
+#endif
@@ -0,0 +1,57 @@
+// Route table and lookup (see router.h).
+#include "router.h"
+
+#include <string.h>
+
+// Every route, once: id, exact path, accepted methods, metrics name.
+// Both the table and the lookup switch below are generated from this list.
+// Two paths of the same length make the switch fail to compile (duplicate
+// case value); give that length a case of its own that compares both.
+#define ROUTES(X)                                                              \
+    X(ROUTE_GEO,     "/api/v1/geo",           METHOD_GET,               "geo")           \
+    X(ROUTE_WEATHER, "/api/v1/weather",       METHOD_GET,               "weather")       \
+    X(ROUTE_BATCH,   "/api/v1/weather/batch", METHOD_GET | METHOD_POST, "weather_batch") \
+    X(ROUTE_FORECAST, "/api/v1/forecast",     METHOD_GET,               "forecast")      \
+    X(ROUTE_METRICS, "/metrics",              METHOD_GET,               "metrics")
+
+typedef struct {
+    unsigned methods;
+    const char *name;
+} Route;
+
+#define ROUTE_ENTRY(id, path, methods, name) [id] = { methods, name },
+static const Route TABLE[ROUTE_COUNT] = {
+    ROUTES(ROUTE_ENTRY)
+    [ROUTE_OTHER] = { 0, "other" },
+};
+
+#define ROUTE_CASE(id, path, methods, name) \
+    case sizeof(path) - 1: return memcmp(p.ptr, path, sizeof(path) - 1) == 0 ? id : ROUTE_OTHER;
+
+RouteId route_lookup(StrView p) {
+    switch (p.len) {
+    ROUTES(ROUTE_CASE)
+    default: return ROUTE_OTHER;
+    }
+}
+
+unsigned route_methods(RouteId route) {
+    return TABLE[route].methods;
+}
+
+const char *route_name(RouteId route) {
+    return TABLE[route].name;
+}
+
+// The first byte picks the candidate, the length and one memcmp confirm it.
+HttpMethod http_method(StrView m) {
+    if (m.len < 3) return METHOD_OTHER;
+    switch (m.ptr[0]) {
+    case 'G': return sv_eq(m, "GET") ? METHOD_GET : METHOD_OTHER;
+    case 'H': return sv_eq(m, "HEAD") ? METHOD_HEAD : METHOD_OTHER;
+    case 'P': return sv_eq(m, "POST") ? METHOD_POST : sv_eq(m, "PUT") ? METHOD_PUT : METHOD_OTHER;
+    case 'D': return sv_eq(m, "DELETE") ? METHOD_DELETE : METHOD_OTHER;
+    case 'O': return sv_eq(m, "OPTIONS") ? METHOD_OPTIONS : METHOD_OTHER;
+    default: return METHOD_OTHER;
+    }
+}
@@ -0,0 +1,43 @@
+// Request routing: exact path → endpoint, and which methods it accepts.
+// The lookup is a switch on the path length followed by one memcmp (the
+// same shape gperf generates): constant time however many routes there
+// are, with no prefix surprises ("/api/v1/geoXYZ" is not /api/v1/geo).
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "http_parser.h"
+
+typedef enum {
+    ROUTE_GEO,                  // /api/v1/geo
+    ROUTE_WEATHER,              // /api/v1/weather
+    ROUTE_BATCH,                // /api/v1/weather/batch
+    ROUTE_FORECAST,             // /api/v1/forecast
+    ROUTE_METRICS,              // /metrics
+    ROUTE_OTHER,                // no route: preflight, unknown paths, malformed requests
+    ROUTE_COUNT
+} RouteId;
+
+// Request methods as bits, so a route lists the ones it accepts.
+typedef enum {
+    METHOD_OTHER = 0,
+    METHOD_GET = 1 << 0,
+    METHOD_HEAD = 1 << 1,
+    METHOD_POST = 1 << 2,
+    METHOD_PUT = 1 << 3,
+    METHOD_DELETE = 1 << 4,
+    METHOD_OPTIONS = 1 << 5
+} HttpMethod;
+
+// The route for an exact path (without the query), or ROUTE_OTHER.
+RouteId route_lookup(StrView path);
+
+// Methods 'route' accepts (METHOD_* bits); 0 for ROUTE_OTHER.
+unsigned route_methods(RouteId route);
+
+// Name used in metrics labels ("geo", "weather_batch", ...).
+const char *route_name(RouteId route);
+
+// The method of a request line ("GET" → METHOD_GET; METHOD_OTHER if unknown).
+HttpMethod http_method(StrView method);
+
+#endif
@@ -0,0 +1,150 @@
+// Byte-class scanning (see scan.h). Every implementation turns up to 64
+// bytes into a bitmask with full-width vector compares; a last piece shorter
+// than a vector is copied into a zeroed one first, so nothing past the
+// caller's bytes is ever read.
+#include "scan.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCAN_NEON 1
+#endif
+
+typedef uint64_t (*BlockFn)(const char *p, size_t n, const ScanSet *set);
+
+static uint64_t block_scalar(const char *p, size_t n, const ScanSet *s) {
+    uint64_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char b = (unsigned char)p[i];
+        m |= (uint64_t)(b == s->c[0] || b == s->c[1] || b == s->c[2] || b == s->c[3]) << i;
+    }
+    return m;
+}
+
+#ifdef SCAN_X86
+// 16 bytes → 16 bits
+static inline uint64_t match16_sse2(__m128i v, const ScanSet *s) {
+    __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)s->c[0])),
+                                            _mm_cmpeq_epi8(v, _mm_set1_epi8((char)s->c[1]))),
+                               _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)s->c[2])),
+                                            _mm_cmpeq_epi8(v, _mm_set1_epi8((char)s->c[3]))));
+    return (uint16_t)_mm_movemask_epi8(hit);
+}
+
+// The last n < 16 bytes: copied into a zeroed vector so nothing past p[n) is read.
+static inline uint64_t tail16_sse2(const char *p, size_t n, const ScanSet *s) {
+    char buf[16] = { 0 };
+    memcpy(buf, p, n);
+    return match16_sse2(_mm_loadu_si128((const __m128i *)buf), s) & ((1u << n) - 1);
+}
+
+static uint64_t block_sse2(const char *p, size_t n, const ScanSet *s) {
+    uint64_t m = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) m |= match16_sse2(_mm_loadu_si128((const __m128i *)(p + i)), s) << i;
+    if (i < n) m |= tail16_sse2(p + i, n - i, s) << i;
+    return m;
+}
+
+__attribute__((target("avx2")))
+static uint64_t block_avx2(const char *p, size_t n, const ScanSet *s) {
+    const __m256i a = _mm256_set1_epi8((char)s->c[0]), b = _mm256_set1_epi8((char)s->c[1]);
+    const __m256i c = _mm256_set1_epi8((char)s->c[2]), d = _mm256_set1_epi8((char)s->c[3]);
+    uint64_t m = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, a), _mm256_cmpeq_epi8(v, b)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, c), _mm256_cmpeq_epi8(v, d)));
+        m |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hit) << i;
+    }
+    for (; i + 16 <= n; i += 16) m |= match16_sse2(_mm_loadu_si128((const __m128i *)(p + i)), s) << i;
+    if (i < n) m |= tail16_sse2(p + i, n - i, s) << i;
+    return m;
+}
+#endif
+
+#ifdef SCAN_NEON
+static inline uint64_t match16_neon(uint8x16_t v, const ScanSet *s) {
+    static const uint8_t BIT[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8(s->c[0])), vceqq_u8(v, vdupq_n_u8(s->c[1]))),
+                              vorrq_u8(vceqq_u8(v, vdupq_n_u8(s->c[2])), vceqq_u8(v, vdupq_n_u8(s->c[3]))));
+    uint8x16_t bits = vandq_u8(hit, vld1q_u8(BIT));     // one bit per lane, then add up each half
+    return (uint64_t)vaddv_u8(vget_low_u8(bits)) | (uint64_t)vaddv_u8(vget_high_u8(bits)) << 8;
+}
+
+static uint64_t block_neon(const char *p, size_t n, const ScanSet *s) {
+    uint64_t m = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) m |= match16_neon(vld1q_u8((const uint8_t *)p + i), s) << i;
+    if (i < n) {
+        uint8_t buf[16] = { 0 };
+        memcpy(buf, p + i, n - i);
+        m |= (match16_neon(vld1q_u8(buf), s) & ((1u << (n - i)) - 1)) << i;
+    }
+    return m;
+}
+#endif
+
+typedef struct {
+    const char *name;
+    BlockFn fn;
+} Backend;
+
+static const Backend BACKENDS[] = {     // best first
+#ifdef SCAN_X86
+    { "avx2", block_avx2 },
+    { "sse2", block_sse2 },
+#endif
+#ifdef SCAN_NEON
+    { "neon", block_neon },
+#endif
+    { "scalar", block_scalar },
+};
+
+#define NUM_BACKENDS (sizeof(BACKENDS) / sizeof(BACKENDS[0]))
+
+static int backend_supported(const Backend *b) {
+#ifdef SCAN_X86
+    if (b->fn == block_avx2) return __builtin_cpu_supports("avx2");
+    if (b->fn == block_sse2) return __builtin_cpu_supports("sse2");
+#endif
+    (void)b;
+    return 1;
+}
+
+// Chosen on first use; every thread picks the same one, so the race is harmless.
+static _Atomic(const Backend *) CURRENT;
+
+static const Backend *current(void) {
+    const Backend *b = atomic_load_explicit(&CURRENT, memory_order_relaxed);
+    if (b) return b;
+    for (size_t i = 0; i < NUM_BACKENDS; i++) {
+        if (backend_supported(&BACKENDS[i])) { b = &BACKENDS[i]; break; }
+    }
+    atomic_store_explicit(&CURRENT, b, memory_order_relaxed);
+    return b;
+}
+
+uint64_t scan_block(const char *p, size_t n, const ScanSet *set) {
+    return current()->fn(p, n < 64 ? n : 64, set);
+}
+
+const char *scan_backend(void) {
+    return current()->name;
+}
+
+int scan_use(const char *name) {
+    for (size_t i = 0; i < NUM_BACKENDS; i++) {
+        if (strcmp(BACKENDS[i].name, name) == 0 && backend_supported(&BACKENDS[i])) {
+            atomic_store_explicit(&CURRENT, &BACKENDS[i], memory_order_relaxed);
+            return 0;
+        }
+    }
+    return -1;
+}
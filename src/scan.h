@@ -0,0 +1,31 @@
+// Byte-class scanning for the HTTP parser.
+// scan_block() compares 64 bytes against a set of up to four delimiter bytes
+// (' ' and '?' in a request line, '&' '=' '%' '+' in a query) and returns one
+// bit per byte, so a tokenizer can walk every delimiter of a block with
+// ctz instead of stopping at each byte. The implementation (AVX2, SSE2, NEON
+// or portable C) is picked on first use from what the CPU supports.
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Up to four bytes to look for; repeat one to use fewer.
+typedef struct {
+    unsigned char c[4];
+} ScanSet;
+
+#define SCAN_SET(a, b, c, d) { { (unsigned char)(a), (unsigned char)(b), (unsigned char)(c), (unsigned char)(d) } }
+
+// Bit i is set if p[i] is in 'set', for i < n. n <= 64; only those n bytes
+// are read.
+uint64_t scan_block(const char *p, size_t n, const ScanSet *set);
+
+// Name of the implementation in use ("avx2", "sse2", "neon" or "scalar").
+const char *scan_backend(void);
+
+// Use a specific implementation (benchmarks compare them). Returns 0, or -1
+// if it is unknown or this CPU does not support it.
+int scan_use(const char *name);
+
+#endif
@@ -1,329 +1,2551 @@
 // Socket/network headers (Linux/WSL/macOS). Provide IPv4 types and functions.
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
 // Standard C headers for I/O, memory, strings, etc.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
-#include <ctype.h>
 #include <errno.h>
+#include <stddef.h>
 #include <time.h>
 #include <math.h>
 
-// Configuration: network port, listen queue size, and max request buffer
-#define PORT 8080
-#define BACKLOG 16
-#define BUF_SIZE 8192
+#include "access_log.h"
+#include "arena.h"
+#include "cities.h"
+#include "compress.h"
+#include "config.h"
+#include "coord.h"
+#include "event_loop.h"
+#include "forecast_store.h"
+#include "handoff.h"
+#include "http_parser.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "provider.h"
+#include "rate_limit.h"
+#include "router.h"
+#include "scan.h"
+#include "upstream.h"
+#include "weather_cache.h"
 
-// A very small in-memory "database" of cities we support for the demo.
+// Fixed limits (everything a deployment may want to tune is in config.h)
+#define MAX_EVENTS 256   // ready sockets handled per event loop iteration
+#define GEO_PREBUILD_MAX 4096 // city lists up to this size get their geo responses built at startup
+#define FORECAST_STORE_SIZE 2000 // forecast locations kept in memory (~3 KB each)
+#define FORECAST_TTL_SEC 1800   // seconds before a stored forecast is refetched
+#define FORECAST_DEFAULT_HOURS 24 // /api/v1/forecast without 'hours'
+#define PREFETCH_MAX_PER_SEC 50 // upper bound for prefetch requests to the provider
+#define PREFETCH_BURST 16   // max prefetch requests started per loop iteration
+#define UPSTREAM_TIMEOUT_MS 3000 // an upstream weather request must be answered within this time
+#define RECHECK_MS 1000         // remote fetches are looked up again at least this often
+#define UPSTREAM_CONNS 8    // keep-alive connections to the upstream, per worker
+#define FETCH_BUCKETS 256   // per-worker hash of upstream fetches in flight
+#define RATE_LIMIT_SLOTS 65536  // clients the rate limiter tracks at once (16 bytes each)
+#define RESERVED_FDS 64     // default --max-conns leaves this many fds for listeners, upstream, files
+#define RESPONSE_RESERVE 2048   // only handle the next pipelined request if this much 'out' is free
+#define OUT_IOV 64              // queued output segments per connection (one writev() sends them all)
+#define JSON_HEAD_ROOM 640      // 'out' left free for the headers of a JSON body built in place
+#define CONN_SLAB 32            // connections allocated at once when a worker's free list is empty
+#define GEO_MAX_AGE_SEC 86400   // Cache-Control max-age of geo answers (they never change while we run)
+#define DATE_LINE_LEN 37        // strlen("Date: Tue, 14 Oct 2026 05:45:13 GMT\r\n"), always the same
+#define BATCH_MAX_POINTS 200    // locations accepted by one /api/v1/weather/batch request
+#define BATCH_ITEM_MAX 192      // upper bound for one location's JSON in a batch answer
+#define DRAIN_QUIET_MS 250      // draining: keep-alive connections idle this long are closed
+#define ACCEPT_RETRY_MS 100     // io_uring: pause after an accept error (e.g. EMFILE) before the next one
+
+// Each client connection moves through a tiny state machine:
+// READING (collect and answer requests) → WRITING (wait until the socket
+// drains) → back to READING for the next keep-alive request, or
+// CLOSING (finish sending, then close). A request that needs the upstream
+// weather provider parks the connection in WAITING until the answer arrives;
+// pipelined requests behind it are not looked at until then.
+typedef enum {
+    CONN_READING,
+    CONN_WRITING,
+    CONN_CLOSING,
+    CONN_WAITING
+} ConnState;
+
+// With an io_uring loop the kernel does the reading and sending, one
+// operation per connection at a time; the buffers involved are its own
+// until the operation ends (conn_io_done).
+typedef enum {
+    CONN_IO_NONE,
+    CONN_IO_RECV,           // into 'in'
+    CONN_IO_SEND,           // the queued segments
+    CONN_IO_SEND_CLOSE      // the queued segments, then close the socket (last response)
+} ConnIo;
+
+struct Worker;
+struct Fetch;
+struct Batch;
+struct BatchPoint;
+
+// Per-connection state kept between event loop wakeups.
+typedef struct Conn {
+    struct Worker *worker;  // the worker thread that owns this connection
+    int fd;                 // client socket (non-blocking)
+    uint64_t client;        // rate limiter key of the peer address
+    unsigned char peer[16]; // peer address for the access log (IPv4: the first 4 bytes)
+    int peer_family;        // AF_INET or AF_INET6
+    ConnState state;        // where we are in the request/response cycle
+    int keep_alive;         // 1 if the response being built keeps the connection open
+    unsigned accept_enc;    // content codings the current request accepts (ENCODING_* bits)
+    int readable;           // edge-triggered: 1 until recv() reports EAGAIN
+    int peer_closed;        // client sent EOF (no more requests will arrive)
+    int deferred;           // a pipelined request waits for room in 'out'
+    ConnIo io;              // io_uring: the operation in flight (the Conn is not reused before it ends)
+    size_t io_len;          // CONN_IO_SEND*: bytes handed to the kernel
+    int io_fd;              // CONN_IO_SEND_CLOSE cut short by conn_close(): the socket to close after it
+    unsigned requests;      // requests served on this connection so far
+    RouteId route;          // what the current request is counted as in /metrics
+    HttpMethod method;      // of the current request (METHOD_OTHER until it is parsed)
+    long long started_ns;   // monotonic ns when the current request was read
+    long long last_active;  // monotonic ms of the last read/write progress
+    struct Conn *prev;      // idle list (least recently active first)
+    struct Conn *next;      //   (after conn_close / when unused: the worker's free lists)
+    struct Fetch *waiting;  // CONN_WAITING: the upstream fetch this request waits for
+    struct Conn *wait_next; // other connections waiting for the same fetch
+    unsigned forecast_hours; // CONN_WAITING for a forecast: how many hours were asked for
+    struct Batch *batch;    // CONN_WAITING: the batch request this connection waits for
+    char *owned;            // malloc'd response body queued in 'iov', freed once sent
+    HttpParser parser;      // incremental parse state of the request at the start of 'in'
+    size_t in_len;          // bytes currently stored in 'in'
+    size_t out_len;         // bytes of 'out' in use
+    int iov_count;          // queued output segments: ranges of 'out' or prebuilt responses
+    int iov_done;           // segments already handed to the kernel completely
+    struct iovec iov[OUT_IOV];
+    Arena arena;            // request-scoped allocations in 'scratch', reset per request
+    // Buffers last: a recycled Conn only has the fields above cleared. Their
+    // sizes are set at startup (--read-buffer, --write-buffer) and they follow
+    // the struct in the same allocation.
+    char *in;               // raw request bytes (parsed in place, never copied): conn_in_size
+    char *out;              // response bytes waiting to be sent: conn_out_size
+    char *scratch;          // arena memory: conn_in_size (a request's values never outgrow it)
+    char buffers[];
+} Conn;
+
+// A worker's wall clock, formatted once per second for all responses of that
+// second (clock_tick() runs once per event loop iteration).
+typedef struct {
+    time_t sec;                     // the second described below
+    char date[DATE_LINE_LEN + 1];   // "Date: Tue, 14 Oct 2026 05:45:13 GMT\r\n" header line
+    char iso[21];                   // "2026-10-14T05:45:13Z"
+} Clock;
+
+// A worker's listening socket
 typedef struct {
-    const char *city;    // City display name, e.g., "Malmo"
-    const char *country; // Two-letter country code, e.g., "SE"
-    double lat;          // Latitude (decimal degrees)
-    double lon;          // Longitude (decimal degrees)
-} City;
+    int fd;                 // -1 once closed (draining)
+    int accepting;          // io_uring: its multishot accept is running
+    long long retry_ms;     // io_uring: not restarted before this (monotonic ms) after an error
+} Listener;
+
+// One worker = one thread with its own listening socket (SO_REUSEPORT) and
+// its own event loop. Workers share nothing, so no locks are needed: the
+// kernel spreads new connections across the listening sockets.
+typedef struct Worker {
+    int id;                 // 0..workers-1, used in log messages
+    Listener *listeners;    // this worker's listening sockets (one, unless taken over
+    int listen_count;       //   from a process that had more workers)
+    int draining;           // stopped accepting; exits once its connections are done
+    EventLoop *loop;        // this worker's epoll/kqueue/io_uring instance
+    int async;              // the loop does the socket I/O itself (io_uring): see conn_drive()
+    int wake[2];            // pipe registered in the loop: wake_workers() cuts its wait short
+    Clock clock;            // current time, preformatted for responses
+    MetricsShard *metrics;  // this worker's counters (METRICS[id])
+    Compressor *compressor; // gzip/brotli state reused for every compressed response
+    AccessRing *log;        // this worker's access log ring (NULL without --access-log)
+    Conn *idle_head;        // open connections ordered by last activity, so the
+    Conn *idle_tail;        //   idle sweep only looks at the front of the list
+    Conn *closed;           // closed during this loop iteration, recycled after it
+    Conn *io_pending;       // closed, but the kernel still has their buffers (io_uring)
+    Conn *conn_free;        // recycled connection objects (allocated CONN_SLAB at a time)
+    char **slabs;           // every slab allocated, freed when the worker is done
+    size_t slab_count;
+    struct Fetch *fetch_free; // recycled Fetch objects
+    UpstreamPool *upstream; // connections to the HTTP weather provider (NULL for demo)
+    struct Fetch *fetches[FETCH_BUCKETS]; // upstream fetches in flight, by cache key
+    int remote_fetches;     // how many of them are another worker's (Fetch.remote)
+    int woken;              // the wake pipe fired: another worker stored an answer we may wait for
+    long long recheck_ms;   // when fetch_recheck() runs next at the latest
+    int prefetch;           // 1 on the worker that keeps the PREFETCH cities warm
+    size_t prefetch_next;   // next index into PREFETCH
+    long long prefetch_due; // monotonic µs when prefetch_next is due
+    int prefetch_warm;      // the first (fast) pass over PREFETCH is done
+    pthread_t thread;
+} Worker;
+
+// One upstream weather request in flight, shared by every client connection
+// of the worker that asked for the same grid cell meanwhile. When another
+// worker holds the cell's claim (WC_PENDING), the Fetch is 'remote': no
+// request of ours, just waiters until the answer shows up in the cache.
+typedef struct Fetch {
+    uint64_t key;           // weather cache key of the cell
+    int forecast;           // 1: the cell's hourly forecast (FORECASTS), 0: current weather
+    int remote;             // WEATHER's claim is another worker's: see fetch_recheck()
+    int batched;            // fetched by a BatchCall's request (batch_call_done() finishes it)
+    double lat, lon;        // the cell centre (to fetch it ourselves if the claim lapses)
+    long long deadline_ms;  // remote: answer 502 if nothing arrived by then
+    Worker *worker;
+    long long started_ns;   // when the upstream request was queued
+    Conn *waiters;          // connections parked in CONN_WAITING (linked by wait_next)
+    struct BatchPoint *points; // cells of batch requests waiting for it (linked by wait_next)
+    struct Fetch *next;     // hash chain in worker->fetches
+} Fetch;
+
+// /api/v1/weather/batch (handle_weather_batch()): one point of the request.
+// A point whose cell is missing waits on the cell's Fetch, whoever's
+// request that is: another batch's, a single /api/v1/weather one, or
+// another worker's (remote).
+typedef struct BatchPoint {
+    double lat, lon;        // as requested
+    double qlat, qlon;      // grid cell centre (what is fetched)
+    uint64_t key;           // weather cache key
+    int rc;                 // WC_HIT once 'report' is filled, WC_FAILED, or WC_MISS while fetching
+    size_t rep;             // index of the first point in the same cell (which holds the answer)
+    WeatherReport report;
+    struct Batch *batch;    // while waiting: the request it belongs to
+    struct BatchPoint *wait_next; // next point waiting on the same Fetch
+} BatchPoint;
+
+// One batch request; freed when its last cell is answered.
+typedef struct Batch {
+    Conn *conn;             // NULL once the client has gone away
+    size_t pending;         // cells not answered yet (+1 while they are being looked up)
+    size_t n;
+    BatchPoint points[];
+} Batch;
+
+// One upstream request for up to PROVIDER->batch_max missing cells.
+typedef struct {
+    Worker *worker;
+    long long started_ns;   // when the upstream request was queued
+    size_t n;
+    Fetch *cells[];         // the cells' (batched) Fetch entries, in request order
+} BatchCall;
 
 // Our fixed test data. Feel free to add more entries here.
-static City DEMO_CITIES[] = {
-    {"Stockholm", "SE", 59.3293, 18.0686},
-    {"Orebro", "SE", 59.2741, 15.2066},
-    {"Malmo", "SE", 55.6050, 13.0038},
-    {"Gothenburg", "SE", 57.7089, 11.9746},
-    {"Uppsala", "SE", 59.8586, 17.6389}
+static const City DEMO_CITIES[] = {
+    {"Stockholm", "SE", 59.3293, 18.0686, 975551},
+    {"Orebro", "SE", 59.2741, 15.2066, 126009},
+    {"Malmo", "SE", 55.6050, 13.0038, 351749},
+    {"Gothenburg", "SE", 57.7089, 11.9746, 583056},
+    {"Uppsala", "SE", 59.8586, 17.6389, 177074}
 };
 
-// Build a simple JSON error message as a string.
-// Example: json_error(404, "not found") → "{\"error\":{\"code\":404,\"message\":\"not found\"}}"
-static const char *json_error(int code, const char *message) {
-    static char buf[1024];             // static buffer reused per call (single-threaded server)
-    snprintf(buf, sizeof(buf),
-             "{\"error\":{\"code\":%d,\"message\":\"%s\"}}",
-             code, message);
-    return buf;                         // caller uses it immediately to send the response
+#define NUM_DEMO_CITIES (sizeof(DEMO_CITIES) / sizeof(DEMO_CITIES[0]))
+
+// The city database every lookup goes through: the file given with
+// --cities (memory-mapped), or DEMO_CITIES. Read-only after startup.
+static CityDb CITIES;
+
+// Weather answers (shared by all workers), filled from the --provider backend.
+static WeatherCache *WEATHER;
+static ForecastStore *FORECASTS;
+static const WeatherProvider *PROVIDER;
+
+// --prefetch: CITIES.records indexes (most populous first) whose weather is
+// refreshed on a schedule, so requests for them never wait for the provider.
+static uint32_t *PREFETCH;
+static size_t prefetch_count;
+
+// Counters of every worker, one cache-line aligned shard each (/metrics).
+static MetricsShard *METRICS;
+static Worker *WORKERS;                 // the pool (wake_workers())
+static int num_workers;
+static AccessLog *ACCESS_LOG;           // --access-log (NULL: off)
+
+// Per-connection buffer sizes, fixed at startup
+static size_t conn_in_size;             // --read-buffer
+static size_t conn_out_size;            // --write-buffer
+
+// Settings a SIGHUP may change while the workers run (apply_settings()).
+// Each one stands alone, so relaxed loads are enough: a worker sees a new
+// value the next time it looks.
+static atomic_long keepalive_ms;        // --keepalive-timeout
+static atomic_long keepalive_requests;  // --keepalive-requests
+static atomic_int tcp_nodelay;          // --tcp-nodelay
+static atomic_long max_conns;           // --max-conns: open client connections, all workers together
+static _Atomic(RateLimiter *) RATE_LIMIT; // per-client request rate (NULL: no --rate-limit)
+static atomic_int weather_ttl_sec;      // --cache-ttl (also the clients' max-age)
+static _Atomic long long prefetch_step_us; // time between two prefetch requests
+#define SETTING(v) atomic_load_explicit(&(v), memory_order_relaxed)
+
+static atomic_long active_conns;
+static atomic_int running_workers;      // main() handles signals while this is > 0
+static volatile sig_atomic_t reload_requested;  // SIGHUP
+static volatile sig_atomic_t stop_requested;    // SIGTERM / SIGINT, counted: the second one hurries
+
+// Restarts: once set, every worker stops accepting and exits when its
+// connections are done or at this monotonic ms, whichever comes first.
+static _Atomic long long drain_deadline;
+static long drain_timeout_ms;           // --drain-timeout (main thread only)
+
+// A complete HTTP response (headers + body) built once and then only copied.
+// The two variants differ only in the Connection header; both live in 'data'.
+// The Date header is not part of it: write_prebuilt() copies the worker's
+// current one into the output buffer, after the status line.
+typedef struct {
+    char etag[24];           // "\"g-<64-bit hash of the body>\"" (strong: the bytes never change)
+    char cache_headers[96];  // its ETag and Cache-Control lines (also sent with a 304)
+    size_t head_len;         // "HTTP/1.1 200 OK\r\n" (the same in both variants)
+    size_t keep_alive_len;   // data[0..keep_alive_len): "...Connection: keep-alive\r\n\r\n{...}"
+    size_t close_len;        // followed by "...Connection: close\r\n\r\n{...}"
+    char data[];
+} PrebuiltResponse;
+
+// /api/v1/geo answers for CITIES.records[i]. Small city lists are built in
+// main(); with a big --cities file each entry is built on its first request
+// and published with an atomic compare-and-swap. Entries never change once
+// set, so workers read them without locks.
+static _Atomic(PrebuiltResponse *) *GEO_RESPONSES;
+
+// Nanoseconds from a clock that never jumps (used for latency metrics).
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-// Send a basic HTTP response with CORS headers.
+// Microseconds from the same clock (used for the prefetch schedule).
+static long long now_us(void) {
+    return now_ns() / 1000;
+}
+
+// Milliseconds from the same clock (used for idle timeouts).
+static long long now_ms(void) {
+    return now_ns() / 1000000;
+}
+
+// Count the response just queued for the current request ('bytes' long, as
+// sent) in /metrics, and hand it to the access log.
+static void count_response(Conn *conn, int status_code, size_t bytes) {
+    Worker *w = conn->worker;
+    long long now = now_ns();
+    metrics_request(w->metrics, conn->route, status_code, (uint64_t)(now - conn->started_ns));
+    if (!w->log) return;
+    AccessRecord r;
+    r.mono_ns = now;
+    r.duration_ns = (uint64_t)(now - conn->started_ns);
+    r.bytes = (uint32_t)bytes;
+    r.status = (uint16_t)status_code;
+    r.route = (uint8_t)conn->route;
+    r.method = (uint8_t)conn->method;
+    r.family = (uint8_t)conn->peer_family;
+    memcpy(r.addr, conn->peer, sizeof(r.addr));
+    if (!access_log_push(w->log, &r)) metrics_add(&w->metrics->log_dropped, 1);   // the writer fell behind
+}
+
+// Format a complete HTTP response (CORS headers + body) into 'out'.
+// Returns the number of bytes written, or -1 if it does not fit in 'room'.
 // - status_code / status_text: e.g., 200 "OK"
 // - content_type: e.g., "application/json"
-// - body: the response payload as a C string
-static void write_response(int client_fd, int status_code, const char *status_text, const char *content_type, const char *body) {
-    char header[1024];                         // buffer for response header lines
-    int content_length = body ? (int)strlen(body) : 0; // byte length of body
+// - body / body_len: the response payload (body NULL: only the headers are
+//   written, the caller queues body_len bytes of body itself)
+// - date_line: the worker's "Date: ...\r\n" line ("" for prebuilt responses)
+// - headers: more header lines, each ending in "\r\n" ("" for none)
+// 204 and 304 responses have no body, so they get no Content-Length.
+static int format_response(char *out, size_t room, int status_code, const char *status_text,
+                           const char *content_type, const char *body, size_t body_len, int keep_alive,
+                           const char *date_line, const char *headers) {
+    char length[40] = "";
+    if (status_code != 204 && status_code != 304) {
+        snprintf(length, sizeof(length), "Content-Length: %zu\r\n", body_len);
+    }
     // Build the HTTP response header with common CORS headers for browser access
-    int n = snprintf(header, sizeof(header),
+    int n = snprintf(out, room,
         "HTTP/1.1 %d %s\r\n"
+        "%s"
         "Content-Type: %s\r\n"
-        "Content-Length: %d\r\n"
+        "%s"
+        "%s"
         "Access-Control-Allow-Origin: *\r\n"
-        "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
+        "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
         "Access-Control-Allow-Headers: Content-Type\r\n"
-        "Connection: close\r\n\r\n",
-        status_code, status_text, content_type, content_length);
-    send(client_fd, header, n, 0);             // send header first
-    if (body && content_length > 0) {
-        send(client_fd, body, content_length, 0); // then send body if present
+        "Connection: %s\r\n\r\n",
+        status_code, status_text, date_line, content_type, length, headers,
+        keep_alive ? "keep-alive" : "close");
+    if (!body) return n < 0 || (size_t)n > room ? -1 : n;
+    if (n < 0 || (size_t)n + body_len > room) return -1;
+    if (body_len > 0) memcpy(out + n, body, body_len);   // body right after the header
+    return n + (int)body_len;
+}
+
+// A response that cannot be queued: stop after what is already queued.
+static void write_overflow(Conn *conn) {
+    conn->state = CONN_CLOSING;
+    conn->keep_alive = 0;
+}
+
+// Append a segment to the output queue. Consecutive bytes of 'out' extend
+// the previous segment, so a run of small responses is a single iovec.
+static void out_push(Conn *conn, const char *base, size_t len) {
+    struct iovec *last = conn->iov_count ? &conn->iov[conn->iov_count - 1] : NULL;
+    if (last && (const char *)last->iov_base + last->iov_len == base) {
+        last->iov_len += len;
+        return;
     }
+    if (conn->iov_count == OUT_IOV) { write_overflow(conn); return; }
+    conn->iov[conn->iov_count].iov_base = (void *)base;   // writev() only reads it
+    conn->iov[conn->iov_count].iov_len = len;
+    conn->iov_count++;
 }
 
-// Respond to OPTIONS preflight (no body, 204 No Content)
-static void write_options_ok(int client_fd) {
-    write_response(client_fd, 204, "No Content", "text/plain", "");
-}
-
-// Very small URL-decoder (handles %xx and '+'). Modifies the string in-place.
-// Example: "Malmo%20City" → "Malmo City"; "+" becomes space as well.
-static void url_decode(char *s) {
-    char *o = s;                           // output pointer writes back onto the same string
-    for (; *s; s++, o++) {                  // walk the input string, writing to output
-        if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2])) {
-            char hex[3] = { s[1], s[2], 0 }; // two hex digits after '%'
-            *o = (char) strtol(hex, NULL, 16); // convert hex to a single byte
-            s += 2;                           // skip the two hex digits we just consumed
-        } else if (*s == '+') {               // '+' represents space in URL encoding
-            *o = ' ';
-        } else {
-            *o = *s;                          // normal character, copy as-is
-        }
-    }
-    *o = '\0';                              // null-terminate the decoded string
-}
-
-// Read a key=value from the URL query string. Returns 1 if found.
-// Example: query="city=Malmo&x=1", key="city" → writes "Malmo" to out
-static int parse_query_param(const char *query, const char *key, char *out, size_t outlen) {
-    if (!query) return 0;                   // no query string at all
-    size_t keylen = strlen(key);
-    const char *p = query;                  // scanning pointer
-    while (p && *p) {                       // loop over key=value pairs separated by '&'
-        const char *eq = strchr(p, '=');    // find '=' between key and value
-        const char *amp = strchr(p, '&');   // find next '&' (end of this pair)
-        if (!eq) break;                     // no '=', stop
-        size_t klen = (size_t)(eq - p);     // length of the key
-        if (klen == keylen && strncmp(p, key, keylen) == 0) {
-            size_t vlen = amp ? (size_t)(amp - eq - 1) : strlen(eq + 1); // compute value length
-            if (vlen >= outlen) vlen = outlen - 1;                        // clamp to buffer size
-            strncpy(out, eq + 1, vlen);                                   // copy value substring
-            out[vlen] = '\0';                                            // add terminator
-            url_decode(out);                                              // decode %xx and '+'
-            return 1;                                                     // success
-        }
-        p = amp ? amp + 1 : NULL;      // move to next pair or stop if none
-    }
-    return 0;                            // not found
-}
-
-static int starts_with(const char *s, const char *prefix) {
-    return strncmp(s, prefix, strlen(prefix)) == 0;
-}
-
-// Parse the first request line: METHOD PATH HTTP/1.1
-// Fills method, path (without query), and sets *query to the part after '?'
-static int parse_request_line(char *buf, char *method, size_t mlen, char *path, size_t plen, char **query) {
-    char *line_end = strstr(buf, "\r\n");   // request line ends at CRLF
-    if (!line_end) return 0;                 // malformed if no CRLF
-    *line_end = '\0';                        // temporarily terminate the line for parsing
-
-    char *sp1 = strchr(buf, ' ');            // first space separates METHOD and PATH
-    if (!sp1) return 0;
-    size_t m = (size_t)(sp1 - buf);          // length of METHOD
-    if (m >= mlen) m = mlen - 1;             // clamp to output buffer
-    strncpy(method, buf, m);                  // copy METHOD
-    method[m] = '\0';                        // terminate METHOD string
-
-    char *sp2 = strchr(sp1 + 1, ' ');        // second space separates PATH and HTTP version
-    if (!sp2) return 0;
-    size_t pathlen = (size_t)(sp2 - (sp1 + 1)); // length of PATH + optional query
-    if (pathlen >= plen) pathlen = plen - 1;    // clamp
-    strncpy(path, sp1 + 1, pathlen);            // copy PATH?QUERY
-    path[pathlen] = '\0';                      // terminate PATH string
-
-    char *q = strchr(path, '?');             // split on '?': path vs query
-    if (q) {
-        *q = '\0';                          // end the PATH here
-        *query = q + 1;                      // point to query substring
+// Queue a prebuilt response (valid and unchanged until it is sent): it is
+// sent from where it is, without a copy, with the worker's current Date line
+// spliced in after the status line. The Date line is copied to 'out':
+// clock_tick() rewrites the clock's in place, and a send split over two
+// seconds would otherwise mix both.
+static void write_prebuilt(Conn *conn, const char *data, size_t len, size_t head_len) {
+    if (conn_out_size - conn->out_len < DATE_LINE_LEN || conn->iov_count > OUT_IOV - 3) {
+        write_overflow(conn);
+        return;
+    }
+    char *date = conn->out + conn->out_len;
+    memcpy(date, conn->worker->clock.date, DATE_LINE_LEN);
+    conn->out_len += DATE_LINE_LEN;
+    out_push(conn, data, head_len);
+    out_push(conn, date, DATE_LINE_LEN);
+    out_push(conn, data + head_len, len - head_len);
+    count_response(conn, 200, len + DATE_LINE_LEN);
+}
+
+// Queue a response whose body is too big for 'out': the headers go to 'out',
+// the malloc'd body is sent from where it is and freed by the connection.
+// Only one such body can be queued at a time (conn_process waits for it).
+static void queue_owned(Conn *conn, int status_code, const char *status_text, const char *content_type,
+                        char *body, size_t len, const char *headers) {
+    size_t room = conn_out_size - conn->out_len;
+    int n = format_response(conn->out + conn->out_len, room, status_code, status_text,
+                            content_type, NULL, len, conn->keep_alive, conn->worker->clock.date, headers);
+    if (n < 0 || conn->iov_count > OUT_IOV - 2) {
+        free(body);
+        write_overflow(conn);
+        return;
+    }
+    out_push(conn, conn->out + conn->out_len, (size_t)n);
+    conn->out_len += (size_t)n;
+    out_push(conn, body, len);
+    conn->owned = body;
+    count_response(conn, status_code, (size_t)n + len);
+}
+
+// Content negotiation for a body of *len >= COMPRESS_MIN_SIZE bytes: if the
+// client accepts a coding this build has, compress it with the worker's
+// compressor. Writes the Content-Encoding and Vary lines plus 'headers' to
+// 'out'. Returns the malloc'd compressed body (*len updated), or NULL to send
+// the body as it is.
+static char *compress_for_client(Conn *conn, const char *body, size_t *len, const char *headers,
+                                 char *out, size_t room) {
+    ContentEncoding enc = compress_choose(conn->accept_enc, *len);
+    size_t zlen = 0;
+    char *z = enc ? compress_body(conn->worker->compressor, enc, body, *len, &zlen) : NULL;
+    if (z) {
+        snprintf(out, room, "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n%s", compress_name(enc), headers);
+        *len = zlen;
     } else {
-        *query = NULL;                       // no query provided
+        snprintf(out, room, "Vary: Accept-Encoding\r\n%s", headers);  // caches must still tell clients apart
     }
-    return 1;
+    return z;
 }
 
-// Find a city by exact (case-sensitive) name.
-static const City* find_city_by_name(const char *name) {
-    size_t n = sizeof(DEMO_CITIES) / sizeof(DEMO_CITIES[0]); // number of entries
-    for (size_t i = 0; i < n; i++) {
-        if (strcmp(DEMO_CITIES[i].city, name) == 0) return &DEMO_CITIES[i]; // found
+// Queue an HTTP response with CORS headers, plus the given header lines
+// ("" for none), on the connection. Big bodies are compressed if the client
+// accepts that.
+// Nothing is sent here: the bytes are appended to conn->out and flushed by the
+// event loop once the socket is writable.
+static void write_response_with(Conn *conn, int status_code, const char *status_text, const char *content_type,
+                                const char *body, const char *headers) {
+    size_t room = conn_out_size - conn->out_len;  // free space left in the output buffer
+    size_t content_length = body ? strlen(body) : 0; // byte length of body
+    char negotiated[256];
+    if (content_length >= COMPRESS_MIN_SIZE) {
+        size_t len = content_length;
+        char *z = compress_for_client(conn, body, &len, headers, negotiated, sizeof(negotiated));
+        if (z) { queue_owned(conn, status_code, status_text, content_type, z, len, negotiated); return; }
+        headers = negotiated;
     }
-    return NULL; // not found
+    int n = format_response(conn->out + conn->out_len, room, status_code, status_text,
+                            content_type, body, content_length, conn->keep_alive, conn->worker->clock.date,
+                            headers);
+    if (n < 0) {                                      // response does not fit: give up on this connection
+        write_overflow(conn);
+        return;
+    }
+    out_push(conn, conn->out + conn->out_len, (size_t)n);
+    conn->out_len += (size_t)n;
+    count_response(conn, status_code, (size_t)n);
 }
 
-// Find a city whose coordinates are "close" to given lat/lon.
-static const City* find_city_by_coords(double lat, double lon) {
-    size_t n = sizeof(DEMO_CITIES) / sizeof(DEMO_CITIES[0]);
-    for (size_t i = 0; i < n; i++) {
-        // Treat coordinates as matching if both lat and lon are within ~0.01 degrees
-        if (fabs(DEMO_CITIES[i].lat - lat) < 0.01 && fabs(DEMO_CITIES[i].lon - lon) < 0.01) {
-            return &DEMO_CITIES[i];
+static void write_response(Conn *conn, int status_code, const char *status_text, const char *content_type, const char *body) {
+    write_response_with(conn, status_code, status_text, content_type, body, "");
+}
+
+// The client's cached copy is still current: 304 with the validators, no body.
+static void write_not_modified(Conn *conn, const char *headers) {
+    write_response_with(conn, 304, "Not Modified", "application/json", NULL, headers);
+}
+
+// Queue a malloc'd body (see queue_owned), compressed if the client accepts that.
+static void write_owned(Conn *conn, int status_code, const char *status_text, const char *content_type,
+                        char *body, size_t len) {
+    char negotiated[256];
+    const char *headers = "";
+    if (len >= COMPRESS_MIN_SIZE) {
+        char *z = compress_for_client(conn, body, &len, "", negotiated, sizeof(negotiated));
+        if (z) {
+            free(body);
+            body = z;
         }
+        headers = negotiated;
     }
-    return NULL; // no nearby city
+    queue_owned(conn, status_code, status_text, content_type, body, len, headers);
+}
+
+// Start a JSON response body right in conn->out, JSON_HEAD_ROOM bytes past
+// what is already queued. write_json() then formats the headers into that
+// gap and slides the body up behind them: the body is never built somewhere
+// else and copied over.
+static void json_body_begin(Conn *conn, JsonWriter *j) {
+    size_t start = conn->out_len + JSON_HEAD_ROOM;
+    json_init(j, conn->out + start, start < conn_out_size ? conn_out_size - start : 0);
+}
+
+// Queue the body built since json_body_begin() as an application/json
+// response with the given header lines ("" for none), compressed if it is
+// big and the client accepts that.
+static void write_json(Conn *conn, int status_code, const char *status_text, const JsonWriter *j,
+                       const char *headers) {
+    if (j->failed) { write_overflow(conn); return; }   // does not fit: give up on this connection
+    size_t len = json_length(j);
+    char negotiated[256];
+    if (len >= COMPRESS_MIN_SIZE) {
+        char *z = compress_for_client(conn, j->buf, &len, headers, negotiated, sizeof(negotiated));
+        if (z) { queue_owned(conn, status_code, status_text, "application/json", z, len, negotiated); return; }
+        headers = negotiated;
+    }
+    char *head = conn->out + conn->out_len;
+    int n = format_response(head, JSON_HEAD_ROOM, status_code, status_text, "application/json", NULL, len,
+                            conn->keep_alive, conn->worker->clock.date, headers);
+    if (n < 0) { write_overflow(conn); return; }
+    memmove(head + n, j->buf, len);                 // close the gap: headers and body in one segment
+    out_push(conn, head, (size_t)n + len);
+    conn->out_len += (size_t)n + len;
+    count_response(conn, status_code, (size_t)n + len);
+}
+
+// Queue an error response using the shared JSON error model, plus the given
+// header lines ("" for none): {"error":{"code":404,"message":"not found"}}
+static void write_error_with(Conn *conn, int status_code, const char *status_text, const char *message,
+                             const char *headers) {
+    JsonWriter j;
+    json_body_begin(conn, &j);
+    json_begin_object(&j);
+    json_key(&j, "error");
+    json_begin_object(&j);
+    json_key(&j, "code");
+    json_int(&j, status_code);
+    json_key(&j, "message");
+    json_string(&j, message);
+    json_end_object(&j);
+    json_end_object(&j);
+    write_json(conn, status_code, status_text, &j, headers);
+}
+
+static void write_error(Conn *conn, int status_code, const char *status_text, const char *message) {
+    write_error_with(conn, status_code, status_text, message, "");
+}
+
+// Respond to OPTIONS preflight (no body, 204 No Content)
+static void write_options_ok(Conn *conn) {
+    write_response(conn, 204, "No Content", "text/plain", "");
+}
+
+// Format the /api/v1/geo response (both Connection variants) for one city.
+static PrebuiltResponse *build_geo_response(const CityRecord *c) {
+    char body[1024];                           // build the JSON response body (names are < 512 bytes)
+    JsonWriter j;
+    json_init(&j, body, sizeof(body));
+    json_begin_object(&j);
+    json_key(&j, "city");
+    json_string(&j, city_db_name(&CITIES, c));
+    json_key(&j, "country");
+    json_string(&j, c->country);
+    json_key(&j, "lat");
+    json_fixed(&j, c->lat, 4);
+    json_key(&j, "lon");
+    json_fixed(&j, c->lon, 4);
+    json_end_object(&j);
+    if (j.failed) return NULL;
+    int blen = (int)json_length(&j);
+    uint64_t hash = 0xcbf29ce484222325ULL;     // FNV-1a: the ETag changes exactly when the body does
+    for (int i = 0; i < blen; i++) hash = (hash ^ (unsigned char)body[i]) * 0x100000001b3ULL;
+    char etag[24], cache_headers[96];
+    snprintf(etag, sizeof(etag), "\"g-%016llx\"", (unsigned long long)hash);
+    snprintf(cache_headers, sizeof(cache_headers), "ETag: %s\r\nCache-Control: public, max-age=%d\r\n",
+             etag, GEO_MAX_AGE_SEC);
+    char buf[4096];
+    int ka = format_response(buf, sizeof(buf), 200, "OK", "application/json", body, (size_t)blen, 1,
+                             "", cache_headers);
+    int cl = ka < 0 ? -1 : format_response(buf + ka, sizeof(buf) - (size_t)ka, 200, "OK",
+                                           "application/json", body, (size_t)blen, 0, "", cache_headers);
+    if (cl < 0) return NULL;
+    PrebuiltResponse *r = malloc(sizeof(*r) + (size_t)ka + (size_t)cl);
+    if (!r) return NULL;
+    memcpy(r->etag, etag, sizeof(etag));
+    memcpy(r->cache_headers, cache_headers, sizeof(cache_headers));
+    r->head_len = (size_t)((const char *)memchr(buf, '\n', (size_t)ka) + 1 - buf);
+    r->keep_alive_len = (size_t)ka;
+    r->close_len = (size_t)cl;
+    memcpy(r->data, buf, (size_t)(ka + cl));
+    return r;
+}
+
+// The cached geo response for record 'i', building it on first use.
+// Two workers may race to build the same entry; the loser frees its copy.
+static const PrebuiltResponse *geo_response(size_t i) {
+    PrebuiltResponse *r = atomic_load_explicit(&GEO_RESPONSES[i], memory_order_acquire);
+    if (r) return r;
+    PrebuiltResponse *fresh = build_geo_response(&CITIES.records[i]);
+    if (!fresh) return NULL;
+    PrebuiltResponse *expected = NULL;
+    if (atomic_compare_exchange_strong_explicit(&GEO_RESPONSES[i], &expected, fresh,
+                                                memory_order_acq_rel, memory_order_acquire)) {
+        return fresh;
+    }
+    free(fresh);
+    return expected;                           // the other worker's copy
+}
+
+// Find a city by name, ignoring case and accents ("malmö" finds "Malmo").
+static const CityRecord* find_city_by_name(const char *name) {
+    return city_db_find_name(&CITIES, name, strlen(name)); // O(1) hash lookup
+}
+
+// UTC calendar fields of a Unix time, without gmtime()/strftime() and their
+// locale and time zone machinery (days → civil date after H. Hinnant).
+typedef struct {
+    int year, month, day, hour, min, sec, wday;    // month 1..12, wday 0 = Sunday
+} UtcTime;
+
+static UtcTime utc_time(time_t t) {
+    UtcTime u;
+    long long days = (long long)t / 86400, rem = (long long)t % 86400;
+    if (rem < 0) { rem += 86400; days--; }
+    u.hour = (int)(rem / 3600);
+    u.min = (int)(rem / 60 % 60);
+    u.sec = (int)(rem % 60);
+    u.wday = (int)((days % 7 + 11) % 7);           // 1970-01-01 was a Thursday
+    long long z = days + 719468;                   // days since 0000-03-01
+    long long era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);   // day of the 400-year era
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;             // month, counted from March
+    u.day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    u.month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    u.year = (int)(yoe + era * 400 + (u.month <= 2));
+    return u;
+}
+
+static char *put2(char *p, int v) {
+    p[0] = (char)('0' + v / 10);
+    p[1] = (char)('0' + v % 10);
+    return p + 2;
+}
+
+// "2025-11-03T12:34:56Z" into out[21]
+static void format_iso8601(char *out, time_t t) {
+    UtcTime u = utc_time(t);
+    char *p = put2(put2(out, u.year / 100), u.year % 100);
+    *p++ = '-'; p = put2(p, u.month);
+    *p++ = '-'; p = put2(p, u.day);
+    *p++ = 'T'; p = put2(p, u.hour);
+    *p++ = ':'; p = put2(p, u.min);
+    *p++ = ':'; p = put2(p, u.sec);
+    *p++ = 'Z';
+    *p = '\0';
+}
+
+// "Date: Mon, 03 Nov 2025 12:34:56 GMT\r\n" (RFC 9110 IMF-fixdate) into out[DATE_LINE_LEN + 1]
+static void format_date_line(char *out, time_t t) {
+    static const char WDAY[] = "SunMonTueWedThuFriSat";
+    static const char MON[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    UtcTime u = utc_time(t);
+    char *p = out;
+    memcpy(p, "Date: ", 6); p += 6;
+    memcpy(p, WDAY + 3 * u.wday, 3); p += 3;
+    *p++ = ','; *p++ = ' ';
+    p = put2(p, u.day); *p++ = ' ';
+    memcpy(p, MON + 3 * (u.month - 1), 3); p += 3;
+    *p++ = ' ';
+    p = put2(put2(p, u.year / 100), u.year % 100);
+    *p++ = ' '; p = put2(p, u.hour);
+    *p++ = ':'; p = put2(p, u.min);
+    *p++ = ':'; p = put2(p, u.sec);
+    memcpy(p, " GMT\r\n", 7);                     // includes the NUL
 }
 
-// Get current UTC time as a simple ISO-8601 string.
-static void iso8601_utc_now(char *out, size_t outlen) {
-    time_t t = time(NULL);                    // seconds since epoch
-    struct tm g;                              // broken-out UTC time
-    g = *gmtime(&t);                          // convert to UTC components
-    strftime(out, outlen, "%Y-%m-%dT%H:%M:%SZ", &g); // format like 2025-11-03T12:34:56Z
+// Bring the worker's clock up to date; the strings are only rebuilt when
+// the second changes.
+static void clock_tick(Clock *c) {
+    struct timespec ts;
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);     // seconds are all we need: the cheap clock will do
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+    if (ts.tv_sec == c->sec) return;
+    c->sec = ts.tv_sec;
+    format_date_line(c->date, c->sec);
+    format_iso8601(c->iso, c->sec);
+}
+
+// ISO-8601 form of 't': the clock's cached string when 't' is the current
+// second (fresh answers), else formatted into buf[21].
+static const char *clock_iso8601(const Clock *c, time_t t, char *buf) {
+    if (t == c->sec) return c->iso;
+    format_iso8601(buf, t);
+    return buf;
 }
 
 // Handle /api/v1/geo?city=NAME — City → Coordinates
-static void handle_geo(int client_fd, const char *query) {
-    char city[128] = {0};                     // buffer for extracted city name
-    if (!parse_query_param(query, "city", city, sizeof(city))) {
-        write_response(client_fd, 400, "Bad Request", "application/json", json_error(400, "missing query param: city"));
+static void handle_geo(Conn *conn, const HttpRequest *req) {
+    const char *city = http_query_param(&conn->arena, req->query, "city"); // decoded city name
+    if (!city) {
+        write_error(conn, 400, "Bad Request", "missing query param: city");
         return;
     }
     // Limits: max city length 100 characters
     if (strlen(city) > 100) {
-        write_response(client_fd, 400, "Bad Request", "application/json", json_error(400, "city too long (max 100)"));
+        write_error(conn, 400, "Bad Request", "city too long (max 100)");
         return;
     }
-    const City *c = find_city_by_name(city);  // lookup in our demo data
+    const CityRecord *c = find_city_by_name(city); // hash lookup in the city database
     if (!c) {
-        write_response(client_fd, 404, "Not Found", "application/json", json_error(404, "city not found"));
+        write_error(conn, 404, "Not Found", "city not found");
+        return;
+    }
+    // The whole 200 OK response is formatted only once per city: queue it as is
+    const PrebuiltResponse *r = geo_response(city_db_index(&CITIES, c));
+    if (!r) {
+        write_error(conn, 500, "Internal Server Error", "out of memory");
         return;
     }
-    char body[256];                            // build the JSON response body
-    snprintf(body, sizeof(body),
-             "{\"city\":\"%s\",\"country\":\"%s\",\"lat\":%.4f,\"lon\":%.4f}",
-             c->city, c->country, c->lat, c->lon);
-    write_response(client_fd, 200, "OK", "application/json", body); // send 200 OK with JSON
+    if (req->if_none_match.ptr && http_etag_match(req->if_none_match, r->etag)) {
+        write_not_modified(conn, r->cache_headers);    // the browser or CDN already has these bytes
+        return;
+    }
+    if (conn->keep_alive) write_prebuilt(conn, r->data, r->keep_alive_len, r->head_len);
+    else write_prebuilt(conn, r->data + r->keep_alive_len, r->close_len, r->head_len);
 }
 
-// Handle /api/v1/weather?lat=X&lon=Y — Coordinates → Weather
-static void handle_weather(int client_fd, const char *query) {
-    char lat_s[64] = {0};                     // temp buffer for latitude string
-    char lon_s[64] = {0};                     // temp buffer for longitude string
-    if (!parse_query_param(query, "lat", lat_s, sizeof(lat_s)) || !parse_query_param(query, "lon", lon_s, sizeof(lon_s))) {
-        write_response(client_fd, 400, "Bad Request", "application/json", json_error(400, "missing query params: lat, lon"));
+// Allocate the geo response table and, for small city lists, build every
+// entry right away. Returns 0, or -1 if memory runs out.
+static int build_geo_responses(void) {
+    GEO_RESPONSES = calloc(CITIES.count ? CITIES.count : 1, sizeof(*GEO_RESPONSES));
+    if (!GEO_RESPONSES) return -1;
+    if (CITIES.count > GEO_PREBUILD_MAX) return 0;   // big files: build lazily
+    for (size_t i = 0; i < CITIES.count; i++) {
+        if (!geo_response(i)) return -1;
+    }
+    return 0;
+}
+
+// ETag of the weather answer for cell 'key': a cell's answer is identified
+// by when the provider gave it.
+static void weather_etag(char *out, size_t room, uint64_t key, const WeatherReport *w) {
+    snprintf(out, room, "\"w-%016llx-%llx\"", (unsigned long long)key, (unsigned long long)w->updated_at);
+}
+
+// ETag and Cache-Control lines of a weather answer; max-age runs out when
+// the cache entry does.
+static void weather_cache_headers(Conn *conn, const char *etag, const WeatherReport *w, char *out, size_t room) {
+    long long age = (long long)(conn->worker->clock.sec - w->updated_at);
+    long long max_age = SETTING(weather_ttl_sec) - (age > 0 ? age : 0);
+    snprintf(out, room, "ETag: %s\r\nCache-Control: public, max-age=%lld\r\n", etag, max_age > 0 ? max_age : 0);
+}
+
+// Queue the 200 OK weather JSON for one report of cell 'key'.
+static void write_weather(Conn *conn, uint64_t key, const WeatherReport *w) {
+    char etag[48], headers[128];
+    weather_etag(etag, sizeof(etag), key, w);
+    weather_cache_headers(conn, etag, w, headers, sizeof(headers));
+    char buf[21];                                   // timestamp like 2025-11-03T..Z
+    const char *updated = clock_iso8601(&conn->worker->clock, w->updated_at, buf); // when the provider answered
+    JsonWriter j;
+    json_body_begin(conn, &j);
+    json_begin_object(&j);
+    json_key(&j, "tempC");
+    json_fixed(&j, w->temp_c, 1);
+    json_key(&j, "description");
+    json_string(&j, w->description);
+    json_key(&j, "updatedAt");
+    json_string_len(&j, updated, 20);
+    json_end_object(&j);
+    write_json(conn, 200, "OK", &j, headers);      // send the weather JSON
+}
+
+static void conn_resume(Conn *conn);
+
+static Fetch **fetch_bucket(Worker *w, uint64_t key) {
+    return &w->fetches[(key * 0x9E3779B97F4A7C15ULL) >> 56];   // FETCH_BUCKETS == 256
+}
+
+static void write_forecast(Conn *conn, const ForecastSeries *s);
+
+// Forget a connection that was waiting for a fetch (it is being closed).
+static void fetch_remove_waiter(Conn *conn) {
+    for (Conn **pp = &conn->waiting->waiters; *pp; pp = &(*pp)->wait_next) {
+        if (*pp == conn) { *pp = conn->wait_next; break; }
+    }
+    conn->waiting = NULL;
+}
+
+// Interrupt every worker's ev_loop_wait() (any thread). A full pipe has a
+// wake-up pending already.
+static void wake_workers(void) {
+    for (int i = 0; i < num_workers; i++) {
+        char one = 1;
+        (void)write(WORKERS[i].wake[1], &one, 1);
+    }
+}
+
+// Store a weather answer (NULL: the fetch failed) and, if other workers
+// parked requests for it (WC_PENDING), wake them to look again.
+static void cache_put(uint64_t key, const WeatherReport *report) {
+    if (weather_cache_put(WEATHER, key, report)) wake_workers();
+}
+
+static void batch_point_done(BatchPoint *pt, int ok, const WeatherReport *w);
+
+// The answer for a fetch is there (w or series, unless !ok): answer every
+// waiting client, let it carry on with its next pipelined request, and
+// recycle the Fetch.
+static void fetch_finish(Fetch *f, int ok, const WeatherReport *w, const ForecastSeries *series) {
+    ForecastSeries slice;
+    for (Fetch **pp = fetch_bucket(f->worker, f->key); *pp; pp = &(*pp)->next) {
+        if (*pp == f) { *pp = f->next; break; }
+    }
+    if (f->remote) f->worker->remote_fetches--;
+    while (f->waiters) {
+        Conn *conn = f->waiters;
+        f->waiters = conn->wait_next;
+        conn->waiting = NULL;
+        conn->wait_next = NULL;
+        arena_reset(&conn->arena);      // the parked request's values are no longer needed
+        if (!ok) {
+            write_error(conn, 502, "Bad Gateway", "weather provider unavailable");
+        } else if (f->forecast) {
+            Clock *c = &conn->worker->clock;
+            forecast_slice(series, c->sec - c->sec % 3600, conn->forecast_hours, &slice);
+            write_forecast(conn, &slice);
+        } else {
+            write_weather(conn, f->key, w);
+        }
+        conn->state = conn->keep_alive ? CONN_READING : CONN_CLOSING;
+        conn_resume(conn);              // flush, then continue with pipelined requests
+    }
+    while (f->points) {
+        BatchPoint *pt = f->points;
+        f->points = pt->wait_next;
+        batch_point_done(pt, ok, w);    // may answer and free that batch
+    }
+    f->next = f->worker->fetch_free;    // recycle
+    f->worker->fetch_free = f;
+}
+
+// Continuation of a weather or forecast request: the upstream answered (or
+// failed). Store the result in the shared cache (or forecast store), then
+// answer the waiting clients.
+static void fetch_done(void *arg, int status, const char *body, size_t len) {
+    Fetch *f = arg;
+    metrics_upstream(f->worker->metrics, status == 200, (uint64_t)(now_ns() - f->started_ns));
+    WeatherReport w;
+    ForecastSeries series;
+    int ok;
+    if (f->forecast) {
+        ok = status == 200 && PROVIDER->parse_forecast(PROVIDER, body, len, &series) == 0;
+        forecast_store_put(FORECASTS, f->key, ok ? &series : NULL);
+    } else {
+        ok = status == 200 && PROVIDER->parse(PROVIDER, body, len, &w) == 0;
+        cache_put(f->key, ok ? &w : NULL);
+    }
+    fetch_finish(f, ok, &w, &series);
+}
+
+// Queue the upstream request of 'f'. Returns 0, or -1 if it cannot be sent.
+static int fetch_send(Worker *w, Fetch *f) {
+    char path[256];
+    int n = f->forecast ? PROVIDER->format_forecast_path(PROVIDER, f->lat, f->lon, path, sizeof(path))
+                        : PROVIDER->format_path(PROVIDER, f->lat, f->lon, path, sizeof(path));
+    if (n <= 0 || (size_t)n >= sizeof(path)) return -1;
+    if (upstream_get(w->upstream, path, fetch_done, f) < 0) return -1;
+    f->started_ns = now_ns();
+    return 0;
+}
+
+static Fetch *fetch_find(Worker *w, uint64_t key, int forecast) {
+    Fetch *f = *fetch_bucket(w, key);
+    while (f && (f->key != key || f->forecast != forecast)) f = f->next;
+    return f;
+}
+
+// A new Fetch for cell 'key', not in w->fetches yet (fetch_link()) and
+// without a request. NULL if memory runs out.
+static Fetch *fetch_new(Worker *w, uint64_t key, int forecast, double lat, double lon) {
+    Fetch *f = w->fetch_free;
+    if (f) w->fetch_free = f->next;
+    else if (!(f = malloc(sizeof(*f)))) return NULL;
+    f->key = key;
+    f->forecast = forecast;
+    f->remote = f->batched = 0;
+    f->lat = lat;
+    f->lon = lon;
+    f->waiters = NULL;
+    f->points = NULL;
+    f->worker = w;
+    return f;
+}
+
+static void fetch_link(Worker *w, Fetch *f) {
+    f->next = *fetch_bucket(w, f->key);
+    *fetch_bucket(w, f->key) = f;
+}
+
+// The worker's Fetch for cell 'key' (its forecast if 'forecast'), created
+// if there is none: with the upstream request started, or for 'remote'
+// only to wait for another worker's answer. A remote one becomes ours if
+// asked for without 'remote' (we hold the claim now). Returns NULL if the
+// request could not be started, with errno ENOMEM (out of memory) or EIO
+// (the provider's request could not be sent).
+static Fetch *fetch_start(Worker *w, uint64_t key, int forecast, double lat, double lon, int remote) {
+    Fetch *f = fetch_find(w, key, forecast);
+    if (f && f->remote && !remote) {
+        if (fetch_send(w, f) < 0) {
+            errno = EIO;
+            return NULL;
+        }
+        f->remote = 0;
+        w->remote_fetches--;
+    }
+    if (f) return f;                    // already on its way
+    if (!(f = fetch_new(w, key, forecast, lat, lon))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (remote) {
+        f->remote = 1;
+        f->deadline_ms = now_ms() + UPSTREAM_TIMEOUT_MS;
+        w->remote_fetches++;
+    } else if (fetch_send(w, f) < 0) {
+        f->next = w->fetch_free;
+        w->fetch_free = f;
+        errno = EIO;
+        return NULL;
+    }
+    fetch_link(w, f);
+    return f;
+}
+
+// Fetch cell 'key' again without anyone waiting for it (stale entries and
+// the prefetcher). Local providers answer right away.
+static void weather_refresh(Worker *w, uint64_t key, double lat, double lon) {
+    if (PROVIDER->fetch) {
+        WeatherReport r;
+        int ok = PROVIDER->fetch(PROVIDER, lat, lon, &r) == 0;
+        cache_put(key, ok ? &r : NULL);
+    } else {
+        (void)fetch_start(w, key, 0, lat, lon, 0);  // the answer lands in the cache
+    }
+}
+
+// Look the cells of remote fetches up again: answer their waiters once
+// another worker stored an answer, or with 502 after UPSTREAM_TIMEOUT_MS.
+// If the claim lapsed (that worker's fetch was lost, e.g. it drained) the
+// lookup hands it to us, and we fetch the cell ourselves.
+static void fetch_recheck(Worker *w) {
+    long long now = now_ms();
+    for (int b = 0; b < FETCH_BUCKETS && w->remote_fetches > 0; b++) {
+        for (Fetch *f = w->fetches[b], *next; f; f = next) {
+            next = f->next;             // (fetch_finish() only unlinks f; new fetches go in front)
+            if (!f->remote) continue;
+            WeatherReport r;
+            int rc = weather_cache_lookup(WEATHER, f->key, &r);
+            if (rc == WC_PENDING && now < f->deadline_ms) continue;
+            if (rc == WC_MISS) {
+                if (fetch_send(w, f) == 0) {
+                    f->remote = 0;
+                    w->remote_fetches--;
+                    continue;
+                }
+                cache_put(f->key, NULL);        // give the claim back
+            }
+            uint64_t key = f->key;      // (fetch_finish() recycles f)
+            double lat = f->lat, lon = f->lon;
+            fetch_finish(f, rc == WC_HIT || rc == WC_STALE, &r, NULL);
+            if (rc == WC_STALE) weather_refresh(w, key, lat, lon);
+        }
+    }
+}
+
+// Park the connection until the weather (or forecast) for cell 'key'
+// arrives. Only the first request for a cell goes upstream; later ones join
+// its waiter list. With 'remote' (WC_PENDING) another worker fetches it.
+static void fetch_wait(Conn *conn, uint64_t key, int forecast, double lat, double lon, int remote) {
+    Fetch *f = fetch_start(conn->worker, key, forecast, lat, lon, remote);
+    if (!f) {
+        int oom = errno == ENOMEM;
+        if (!forecast && !remote) cache_put(key, NULL);    // give the claim back
+        if (oom) write_error(conn, 500, "Internal Server Error", "out of memory");
+        else write_error(conn, 502, "Bad Gateway", "weather provider unavailable");
         return;
     }
-    double lat = atof(lat_s);                 // convert to floating point
-    double lon = atof(lon_s);
+    conn->waiting = f;
+    conn->wait_next = f->waiters;
+    f->waiters = conn;
+    conn->state = CONN_WAITING;
+}
+
+// Handle /api/v1/weather?lat=X&lon=Y — Coordinates → Weather
+// Read the coordinate 'key' from the query. Plain values are parsed where
+// they are in the request; escaped ones ("55%2E6") are decoded first.
+// Returns 0, -1 if the parameter is missing, -2 if it is not a decimal number.
+static int query_coord(Conn *conn, const HttpQuery *q, const char *key, double *out) {
+    HttpQueryParam tmp;
+    const HttpQueryParam *p = http_query_find(q, key, &tmp);
+    if (!p) return -1;
+    if (!p->escaped) return coord_parse(p->value.ptr, p->value.len, out) == 0 ? 0 : -2;
+    const char *s = http_query_get(q, &conn->arena, key);
+    return s && coord_parse(s, strlen(s), out) == 0 ? 0 : -2;
+}
+
+// Read and validate the lat/lon query parameters. Returns 0, or -1 after
+// queueing the 400 answer.
+static int query_location(Conn *conn, const HttpQuery *q, double *lat, double *lon) {
+    int lat_rc = query_coord(conn, q, "lat", lat);
+    int lon_rc = query_coord(conn, q, "lon", lon);
+    if (lat_rc == -1 || lon_rc == -1) {
+        write_error(conn, 400, "Bad Request", "missing query params: lat, lon");
+        return -1;
+    }
+    if (lat_rc < 0 || lon_rc < 0) {           // "abc", "1e5", "55,6": not the equator
+        write_error(conn, 400, "Bad Request",
+                    lat_rc < 0 ? "lat must be a decimal number" : "lon must be a decimal number");
+        return -1;
+    }
     // Basic validation: valid Earth coordinate ranges
-    if (!(lat >= -90.0 && lat <= 90.0)) {
-        write_response(client_fd, 400, "Bad Request", "application/json", json_error(400, "lat out of range (-90..90)"));
-        return;
+    if (!(*lat >= -90.0 && *lat <= 90.0)) {
+        write_error(conn, 400, "Bad Request", "lat out of range (-90..90)");
+        return -1;
+    }
+    if (!(*lon >= -180.0 && *lon <= 180.0)) {
+        write_error(conn, 400, "Bad Request", "lon out of range (-180..180)");
+        return -1;
+    }
+    return 0;
+}
+
+static void handle_weather(Conn *conn, const HttpRequest *req) {
+    HttpQuery q;
+    http_query_parse(req->query, &q);              // one pass over the query for both values
+    double lat, lon;
+    if (query_location(conn, &q, &lat, &lon) < 0) return;
+    // Cached per ~1 km cell. On a miss, local providers answer right away;
+    // HTTP providers are asked from the event loop while the client waits.
+    // A stale answer is sent at once and refreshed in the background.
+    double qlat, qlon;
+    uint64_t key = weather_cache_key(lat, lon, &qlat, &qlon);
+    WeatherReport w;
+    int rc = weather_cache_lookup(WEATHER, key, &w);
+    if ((rc == WC_MISS || rc == WC_PENDING) && PROVIDER->fetch) {   // (local: not worth waiting for)
+        rc = PROVIDER->fetch(PROVIDER, qlat, qlon, &w) == 0 ? WC_HIT : WC_FAILED;
+        cache_put(key, rc == WC_HIT ? &w : NULL);
+    }
+    if ((rc == WC_HIT || rc == WC_STALE) && req->if_none_match.ptr) {
+        char etag[48];
+        weather_etag(etag, sizeof(etag), key, &w);
+        if (http_etag_match(req->if_none_match, etag)) {
+            char headers[128];
+            weather_cache_headers(conn, etag, &w, headers, sizeof(headers));
+            write_not_modified(conn, headers);  // same answer as the client's copy: no body
+            if (rc == WC_STALE) weather_refresh(conn->worker, key, qlat, qlon);
+            return;
+        }
+    }
+    if (rc == WC_HIT || rc == WC_STALE) write_weather(conn, key, &w);
+    else if (rc == WC_FAILED) write_error(conn, 502, "Bad Gateway", "weather provider unavailable");
+    else fetch_wait(conn, key, 0, qlat, qlon, rc == WC_PENDING);
+    if (rc == WC_STALE) weather_refresh(conn->worker, key, qlat, qlon);
+}
+
+// /api/v1/weather/batch: many locations in one request. Cached cells are
+// answered at once; the missing ones are fetched from the provider in groups
+// (one upstream request per PROVIDER->batch_max cells when it supports
+// that), and the answer is sent when the last group is back.
+
+// Parse "lat,lon;lat,lon;..." (GET ?points=...).
+// Returns NULL, or a message for the 400 answer.
+static const char *batch_parse_query(const char *s, Batch *b, size_t max) {
+    static const char *bad = "invalid points (expected lat,lon;lat,lon;...)";
+    const char *end = s + strlen(s);
+    while (s < end) {
+        if (b->n == max) return "too many points";
+        BatchPoint *pt = &b->points[b->n];
+        size_t n = coord_scan(s, (size_t)(end - s), &pt->lat);
+        if (n == 0 || s[n] != ',') return bad;
+        s += n + 1;
+        n = coord_scan(s, (size_t)(end - s), &pt->lon);
+        if (n == 0 || (s[n] != ';' && s + n != end)) return bad;
+        s += s + n == end ? n : n + 1;
+        b->n++;
+    }
+    return NULL;
+}
+
+static const char *skip_ws(const char *s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+    return s;
+}
+
+// Parse a POST body: [{"lat":59.3,"lon":18.1}, ...] or [[59.3,18.1], ...].
+// 's' is NUL-terminated. Returns NULL, or a message for the 400 answer.
+static const char *batch_parse_json(const char *s, Batch *b, size_t max) {
+    static const char *bad = "invalid JSON body (expected an array of {lat, lon} objects or [lat, lon] pairs)";
+    s = skip_ws(s);
+    if (*s++ != '[') return bad;
+    s = skip_ws(s);
+    if (*s == ']') return skip_ws(s + 1)[0] ? bad : NULL;
+    while (1) {
+        if (b->n == max) return "too many points";
+        BatchPoint *pt = &b->points[b->n];
+        char *end;
+        s = skip_ws(s);
+        if (*s == '[') {                            // [lat, lon]
+            pt->lat = strtod(s + 1, &end);
+            if (end == s + 1 || *(s = skip_ws(end)) != ',') return bad;
+            pt->lon = strtod(s + 1, &end);
+            if (end == s + 1 || *(s = skip_ws(end)) != ']') return bad;
+            s++;
+        } else if (*s == '{') {                     // {"lat": .., "lon": ..} in any order
+            int have = 0;                           // bit 0: lat, bit 1: lon
+            s = skip_ws(s + 1);
+            while (*s != '}') {
+                int bit;
+                if (strncmp(s, "\"lat\"", 5) == 0) bit = 1;
+                else if (strncmp(s, "\"lon\"", 5) == 0) bit = 2;
+                else return bad;
+                s = skip_ws(s + 5);
+                if (*s++ != ':') return bad;
+                double v = strtod(s, &end);
+                if (end == s) return bad;
+                if (bit == 1) pt->lat = v; else pt->lon = v;
+                have |= bit;
+                s = skip_ws(end);
+                if (*s == ',') s = skip_ws(s + 1);
+                else if (*s != '}') return bad;
+            }
+            if (have != 3) return bad;
+            s++;
+        } else {
+            return bad;
+        }
+        b->n++;
+        s = skip_ws(s);
+        if (*s == ']') break;
+        if (*s++ != ',') return bad;
     }
-    if (!(lon >= -180.0 && lon <= 180.0)) {
-        write_response(client_fd, 400, "Bad Request", "application/json", json_error(400, "lon out of range (-180..180)"));
+    return skip_ws(s + 1)[0] ? bad : NULL;
+}
+
+// Queue the 200 OK answer: one array element per requested point, in order.
+static void batch_respond(Conn *conn, Batch *b) {
+    char *body = malloc(b->n * BATCH_ITEM_MAX + 2);
+    if (!body) { write_error(conn, 500, "Internal Server Error", "out of memory"); return; }
+    JsonWriter j;
+    json_init(&j, body, b->n * BATCH_ITEM_MAX + 2);
+    json_begin_array(&j);
+    for (size_t i = 0; i < b->n; i++) {
+        const BatchPoint *pt = &b->points[i];
+        const BatchPoint *r = &b->points[pt->rep];
+        json_begin_object(&j);
+        json_key(&j, "lat");
+        json_number(&j, pt->lat, 6);                // as requested (up to 6 decimals)
+        json_key(&j, "lon");
+        json_number(&j, pt->lon, 6);
+        if (r->rc == WC_HIT) {
+            char buf[21];
+            const char *updated = clock_iso8601(&conn->worker->clock, r->report.updated_at, buf);
+            json_key(&j, "tempC");
+            json_fixed(&j, r->report.temp_c, 1);
+            json_key(&j, "description");
+            json_string(&j, r->report.description);
+            json_key(&j, "updatedAt");
+            json_string_len(&j, updated, 20);
+        } else {
+            json_key(&j, "error");
+            json_begin_object(&j);
+            json_key(&j, "code");
+            json_int(&j, 502);
+            json_key(&j, "message");
+            json_string(&j, "weather provider unavailable");
+            json_end_object(&j);
+        }
+        json_end_object(&j);
+    }
+    json_end_array(&j);
+    if (j.failed) {
+        free(body);
+        write_error(conn, 500, "Internal Server Error", "response too large");
         return;
     }
-    const City *c = find_city_by_coords(lat, lon); // try to map to one of our demo cities
-    char updated[64];                               // timestamp like 2025-11-03T..Z
-    iso8601_utc_now(updated, sizeof(updated));      // fill with current UTC time
+    write_owned(conn, 200, "OK", "application/json", body, json_length(&j));
+}
 
-    // Very simple demo weather: change numbers based on city when we can.
-    double tempC = 7.0;                     // default value
-    const char *desc = "Cloudy";            // default description
-    if (c) {
-        if (strcmp(c->city, "Malmo") == 0) { tempC = 10.5; desc = "Sunny"; }
-        else if (strcmp(c->city, "Gothenburg") == 0) { tempC = 8.2; desc = "Windy"; }
-        else if (strcmp(c->city, "Orebro") == 0) { tempC = 6.3; desc = "Overcast"; }
+// Every cell of the batch is answered: answer the client (if it is still
+// there) and let it continue.
+static void batch_complete(Batch *b) {
+    Conn *conn = b->conn;
+    if (conn) {                                 // (else closed meanwhile: the cache still got the answers)
+        conn->batch = NULL;
+        arena_reset(&conn->arena);
+        batch_respond(conn, b);
+        conn->state = conn->keep_alive ? CONN_READING : CONN_CLOSING;
+        conn_resume(conn);                      // flush, then continue with pipelined requests
     }
+    free(b);
+}
 
-    char body[256];
-    snprintf(body, sizeof(body),
-             "{\"tempC\":%.1f,\"description\":\"%s\",\"updatedAt\":\"%s\"}",
-             tempC, desc, updated);
-    write_response(client_fd, 200, "OK", "application/json", body); // send the weather JSON
+// The Fetch a batch point waited on is done (fetch_finish()).
+static void batch_point_done(BatchPoint *pt, int ok, const WeatherReport *w) {
+    pt->rc = ok ? WC_HIT : WC_FAILED;
+    if (ok) pt->report = *w;
+    Batch *b = pt->batch;
+    if (--b->pending == 0) batch_complete(b);
 }
 
-// Route the request based on path and method.
-static void handle_request(int client_fd, char *buf) {
-    char method[16];     // will hold "GET" or "OPTIONS"
-    char path[256];      // path like "/api/v1/geo" or "/api/v1/weather?lat=..."
-    char *query = NULL;  // points inside 'path' after '?'
+// An upstream call for some batch cells is done: store them in the cache
+// and finish their Fetch entries (which answers the points waiting on them).
+static void batch_call_done(void *arg, int status, const char *body, size_t len) {
+    BatchCall *call = arg;
+    metrics_upstream(call->worker->metrics, status == 200, (uint64_t)(now_ns() - call->started_ns));
+    WeatherReport reports[call->n];             // n <= batch_max (or 1)
+    int ok = status == 200;
+    if (ok && call->n > 1) ok = PROVIDER->parse_batch(PROVIDER, body, len, reports, call->n) == 0;
+    else if (ok) ok = PROVIDER->parse(PROVIDER, body, len, &reports[0]) == 0;
+    for (size_t i = 0; i < call->n; i++) {
+        cache_put(call->cells[i]->key, ok ? &reports[i] : NULL);
+        fetch_finish(call->cells[i], ok, &reports[i], NULL);
+    }
+    free(call);
+}
+
+// Ask the provider for cells[0..n) in one upstream request (n == 1 without
+// batch support). If the request cannot even be queued, the cells fail here
+// (upstream_get never calls back from inside).
+static void batch_call_start(Worker *w, Fetch **cells, size_t n) {
+    BatchCall *call = malloc(sizeof(*call) + n * sizeof(Fetch *));
+    char path[4096];
+    int len = -1;
+    if (n == 1) {
+        len = PROVIDER->format_path(PROVIDER, cells[0]->lat, cells[0]->lon, path, sizeof(path));
+    } else {
+        double lat[n], lon[n];
+        for (size_t i = 0; i < n; i++) { lat[i] = cells[i]->lat; lon[i] = cells[i]->lon; }
+        len = PROVIDER->format_batch_path(PROVIDER, lat, lon, n, path, sizeof(path));
+    }
+    if (call && len > 0 && (size_t)len < sizeof(path)) {
+        call->worker = w;
+        call->started_ns = now_ns();
+        call->n = n;
+        memcpy(call->cells, cells, n * sizeof(Fetch *));
+        if (upstream_get(w->upstream, path, batch_call_done, call) == 0) return;
+    }
+    free(call);
+    for (size_t i = 0; i < n; i++) {
+        cache_put(cells[i]->key, NULL);         // gives the claim back, too
+        fetch_finish(cells[i], 0, NULL, NULL);
+    }
+}
 
-    if (!parse_request_line(buf, method, sizeof(method), path, sizeof(path), &query)) {
-        write_response(client_fd, 400, "Bad Request", "application/json", json_error(400, "invalid request line"));
+// Handle /api/v1/weather/batch (GET ?points=lat,lon;... or POST JSON body).
+static void handle_weather_batch(Conn *conn, const HttpRequest *req) {
+    Batch *b = malloc(sizeof(*b) + BATCH_MAX_POINTS * sizeof(BatchPoint));
+    if (!b) { write_error(conn, 500, "Internal Server Error", "out of memory"); return; }
+    b->conn = conn;
+    b->pending = 1;                             // ours until every cell is looked up
+    b->n = 0;
+    const char *err;
+    if (http_method(req->method) == METHOD_POST) {
+        char *body = arena_strndup(&conn->arena, req->body.ptr, req->body.len);
+        err = body ? batch_parse_json(body, b, BATCH_MAX_POINTS) : "request body too large";
+    } else {
+        const char *points = http_query_param(&conn->arena, req->query, "points");
+        err = points ? batch_parse_query(points, b, BATCH_MAX_POINTS) : "missing query param: points";
+    }
+    if (!err && b->n == 0) err = "no points given";
+    char msg[96];
+    for (size_t i = 0; !err && i < b->n; i++) {
+        const BatchPoint *pt = &b->points[i];
+        if (!(pt->lat >= -90.0 && pt->lat <= 90.0) || !(pt->lon >= -180.0 && pt->lon <= 180.0)) {
+            snprintf(msg, sizeof(msg), "point %zu out of range (lat -90..90, lon -180..180)", i);
+            err = msg;
+        }
+    }
+    if (err) {
+        if (strcmp(err, "too many points") == 0) {
+            snprintf(msg, sizeof(msg), "too many points (max %d)", BATCH_MAX_POINTS);
+            err = msg;
+        }
+        free(b);
+        write_error(conn, 400, "Bad Request", err);
         return;
     }
+    // One cache lookup per distinct cell: later points in the same cell only
+    // point at the first one (a few hundred points, so a linear scan is fine).
+    // A missing cell joins the worker's Fetch for it if there is one (another
+    // request, or another worker, is fetching it already); the rest are
+    // fetched here, in groups.
+    Worker *w = conn->worker;
+    Fetch *missing[BATCH_MAX_POINTS];
+    size_t nmissing = 0;
+    for (size_t i = 0; i < b->n; i++) {
+        BatchPoint *pt = &b->points[i];
+        pt->key = weather_cache_key(pt->lat, pt->lon, &pt->qlat, &pt->qlon);
+        pt->rep = i;
+        for (size_t j = 0; j < i; j++) {
+            if (b->points[j].key == pt->key) { pt->rep = j; break; }
+        }
+        if (pt->rep != i) continue;
+        pt->rc = weather_cache_lookup(WEATHER, pt->key, &pt->report);
+        if ((pt->rc == WC_MISS || pt->rc == WC_PENDING) && PROVIDER->fetch) {
+            pt->rc = PROVIDER->fetch(PROVIDER, pt->qlat, pt->qlon, &pt->report) == 0 ? WC_HIT : WC_FAILED;
+            cache_put(pt->key, pt->rc == WC_HIT ? &pt->report : NULL);
+        }
+        if (pt->rc == WC_STALE) {
+            weather_refresh(w, pt->key, pt->qlat, pt->qlon);
+            pt->rc = WC_HIT;
+        }
+        if (pt->rc != WC_MISS && pt->rc != WC_PENDING) continue;
+        Fetch *f = fetch_find(w, pt->key, 0);
+        if (f && f->remote && pt->rc == WC_MISS) {  // the other worker's claim lapsed: ours now
+            f->remote = 0;
+            w->remote_fetches--;
+            f->batched = 1;
+            missing[nmissing++] = f;
+        } else if (!f && pt->rc == WC_PENDING) {
+            f = fetch_start(w, pt->key, 0, pt->qlat, pt->qlon, 1);
+        } else if (!f && (f = fetch_new(w, pt->key, 0, pt->qlat, pt->qlon))) {
+            f->batched = 1;
+            fetch_link(w, f);
+            missing[nmissing++] = f;
+        }
+        if (!f) { pt->rc = WC_FAILED; continue; }   // out of memory
+        pt->batch = b;
+        pt->wait_next = f->points;
+        f->points = pt;
+        b->pending++;
+    }
+    size_t group = PROVIDER->format_batch_path && PROVIDER->batch_max > 1 ? PROVIDER->batch_max : 1;
+    for (size_t i = 0; i < nmissing; i += group) {
+        batch_call_start(w, missing + i, nmissing - i < group ? nmissing - i : group);
+    }
+    if (--b->pending == 0) {                    // nothing to wait for: answer with what we have
+        batch_respond(conn, b);
+        free(b);
+        return;
+    }
+    conn->batch = b;                            // batch_point_done() answers and resumes us
+    conn->state = CONN_WAITING;
+}
+
+// Handle /api/v1/forecast?lat=X&lon=Y&hours=N — the next N hours, hourly.
+// Queue the 200 OK forecast JSON for an already sliced series: one array
+// per column, each written by its own loop straight from the column.
+static void write_forecast(Conn *conn, const ForecastSeries *s) {
+    size_t room = 128 + (size_t)s->count * 48;      // per hour: "2026-10-14T06:00:00Z", + two numbers + a code
+    char *body = malloc(room);
+    if (!body) { write_error(conn, 500, "Internal Server Error", "out of memory"); return; }
+    char buf[21];
+    JsonWriter j;
+    json_init(&j, body, room);
+    json_begin_object(&j);
+    json_key(&j, "updatedAt");
+    json_string_len(&j, clock_iso8601(&conn->worker->clock, s->updated_at, buf), 20);
+    json_key(&j, "intervalSec");
+    json_int(&j, 3600);
+    json_key(&j, "time");
+    json_begin_array(&j);
+    for (uint32_t i = 0; i < s->count; i++) {
+        format_iso8601(buf, (time_t)s->time[i]);
+        json_string_len(&j, buf, 20);
+    }
+    json_end_array(&j);
+    json_key(&j, "tempC");
+    json_begin_array(&j);
+    for (uint32_t i = 0; i < s->count; i++) json_fixed(&j, s->temp_c[i], 1);
+    json_end_array(&j);
+    json_key(&j, "precipMm");
+    json_begin_array(&j);
+    for (uint32_t i = 0; i < s->count; i++) json_fixed(&j, s->precip_mm[i], 1);
+    json_end_array(&j);
+    json_key(&j, "weatherCode");
+    json_begin_array(&j);
+    for (uint32_t i = 0; i < s->count; i++) json_int(&j, s->code[i]);
+    json_end_array(&j);
+    json_end_object(&j);
+    if (j.failed) {
+        free(body);
+        write_error(conn, 500, "Internal Server Error", "response too large");
+        return;
+    }
+    write_owned(conn, 200, "OK", "application/json", body, json_length(&j));
+}
+
+static void handle_forecast(Conn *conn, const HttpRequest *req) {
+    if (!PROVIDER->fetch_forecast && !PROVIDER->parse_forecast) {
+        write_error(conn, 501, "Not Implemented", "the weather provider has no forecasts");
+        return;
+    }
+    HttpQuery q;
+    http_query_parse(req->query, &q);
+    double lat, lon;
+    if (query_location(conn, &q, &lat, &lon) < 0) return;
+    long hours = FORECAST_DEFAULT_HOURS;
+    const char *h = http_query_get(&q, &conn->arena, "hours");
+    if (h) {
+        char *end;
+        hours = strtol(h, &end, 10);
+        if (end == h || *end || hours < 1 || hours > FORECAST_MAX_HOURS) {
+            write_error(conn, 400, "Bad Request", "hours must be a whole number (1..168)");
+            return;
+        }
+    }
+    // Stored per weather cache cell, sliced from the current hour on. On a
+    // miss, local providers answer right away; HTTP providers are asked from
+    // the event loop while the client waits (like /api/v1/weather).
+    double qlat, qlon;
+    uint64_t key = weather_cache_key(lat, lon, &qlat, &qlon);
+    time_t from = conn->worker->clock.sec - conn->worker->clock.sec % 3600;
+    ForecastSeries slice;
+    int rc = forecast_store_lookup(FORECASTS, key, from, (size_t)hours, &slice);
+    if (rc == WC_MISS && PROVIDER->fetch_forecast) {
+        ForecastSeries series;
+        int ok = PROVIDER->fetch_forecast(PROVIDER, qlat, qlon, &series) == 0;
+        forecast_store_put(FORECASTS, key, ok ? &series : NULL);
+        if (ok) forecast_slice(&series, from, (size_t)hours, &slice);
+        rc = ok ? WC_HIT : WC_FAILED;
+    }
+    if (rc == WC_HIT) {
+        write_forecast(conn, &slice);
+    } else if (rc == WC_FAILED) {
+        write_error(conn, 502, "Bad Gateway", "weather provider unavailable");
+    } else {
+        conn->forecast_hours = (unsigned)hours;
+        fetch_wait(conn, key, 1, qlat, qlon, 0);
+    }
+}
 
+// Handle /metrics: every worker's counters plus the cache's, summed now.
+static void handle_metrics(Conn *conn) {
+    WeatherCacheStats cache;
+    weather_cache_stats(WEATHER, &cache);
+    size_t len;
+    char *body = metrics_render(METRICS, num_workers, &cache, &len);
+    if (!body) { write_error(conn, 500, "Internal Server Error", "out of memory"); return; }
+    write_owned(conn, 200, "OK", "text/plain; version=0.0.4; charset=utf-8", body, len);
+}
+
+// Route the request based on path and method.
+// All fields of 'req' are views into the connection's input buffer.
+static void handle_request(Conn *conn, const HttpRequest *req) {
+    HttpMethod method = conn->method;
     // Allow CORS preflight
-    if (strcmp(method, "OPTIONS") == 0) {
-        write_options_ok(client_fd);
+    if (method == METHOD_OPTIONS) {
+        write_options_ok(conn);
         return;
     }
 
-    // We only support GET for simplicity
-    if (strcmp(method, "GET") != 0) {
-        write_response(client_fd, 405, "Method Not Allowed", "application/json", json_error(405, "method not allowed"));
+    // Exact paths only: one table lookup, however many routes there are
+    conn->route = route_lookup(req->path);
+    if (conn->route == ROUTE_OTHER) {
+        write_error(conn, 404, "Not Found", "not found");
         return;
     }
+    if (!(route_methods(conn->route) & method)) {   // GET; the batch endpoint also takes POST
+        write_error(conn, 405, "Method Not Allowed", "method not allowed");
+        return;
+    }
+
+    switch (conn->route) {
+    case ROUTE_GEO: handle_geo(conn, req); break;
+    case ROUTE_BATCH: handle_weather_batch(conn, req); break;
+    case ROUTE_WEATHER: handle_weather(conn, req); break;
+    case ROUTE_FORECAST: handle_forecast(conn, req); break;
+    case ROUTE_METRICS: handle_metrics(conn); break;
+    default: write_error(conn, 404, "Not Found", "not found"); break;
+    }
+}
+
+// Switch a socket to non-blocking mode so recv/send/accept never stall the loop.
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void idle_unlink(Conn *conn) {
+    Worker *w = conn->worker;
+    if (conn->prev) conn->prev->next = conn->next; else w->idle_head = conn->next;
+    if (conn->next) conn->next->prev = conn->prev; else w->idle_tail = conn->prev;
+    conn->prev = conn->next = NULL;
+}
+
+// Mark the connection as active now: it moves to the back of the idle list.
+static void idle_touch(Conn *conn) {
+    Worker *w = conn->worker;
+    conn->last_active = now_ms();
+    if (w->idle_tail == conn) return;
+    if (conn->prev || conn->next || w->idle_head == conn) idle_unlink(conn);
+    conn->prev = w->idle_tail;
+    if (w->idle_tail) w->idle_tail->next = conn; else w->idle_head = conn;
+    w->idle_tail = conn;
+}
+
+// Close the socket now; the Conn itself is freed after the current loop
+// iteration (free_closed_conns), because a later event of the same batch, or
+// an upstream answer, may still point at it.
+static void conn_close(Conn *conn) {
+    Worker *w = conn->worker;
+    metrics_add(&w->metrics->conns_closed, 1);
+    atomic_fetch_sub_explicit(&active_conns, 1, memory_order_relaxed);
+    idle_unlink(conn);
+    if (conn->waiting) fetch_remove_waiter(conn);    // the fetch itself goes on (fills the cache)
+    if (conn->batch) conn->batch->conn = NULL;       // likewise for a batch's upstream calls
+    if (conn->io) ev_loop_cancel(w->loop, conn);     // io_uring: conn_io_done() follows soon
+    if (conn->io == CONN_IO_SEND_CLOSE) {
+        conn->io_fd = conn->fd;                      // that send may still close it: conn_io_done() knows
+    } else if (conn->fd >= 0) {                      // (-1: closed by the kernel after the last response)
+        if (!w->async) ev_loop_del(w->loop, conn->fd);  // stop watching before the fd number can be reused
+        close(conn->fd);
+    }
+    conn->fd = -1;
+    conn->next = w->closed;
+    w->closed = conn;
+}
+
+// A cleared connection object from the worker's pool. Objects are carved
+// out of CONN_SLAB-sized slabs and recycled, never given back to malloc.
+static Conn *conn_get(Worker *w) {
+    if (!w->conn_free) {
+        size_t size = (sizeof(Conn) + 2 * conn_in_size + conn_out_size + 63) & ~(size_t)63;
+        char **slabs = realloc(w->slabs, (w->slab_count + 1) * sizeof(*slabs));
+        if (!slabs) return NULL;
+        w->slabs = slabs;
+        char *slab = malloc(CONN_SLAB * size);
+        if (!slab) return NULL;
+        w->slabs[w->slab_count++] = slab;
+        for (int i = CONN_SLAB - 1; i >= 0; i--) {
+            Conn *c = (Conn *)(slab + (size_t)i * size);
+            c->in = c->buffers;
+            c->out = c->in + conn_in_size;
+            c->scratch = c->out + conn_out_size;
+            c->next = w->conn_free;
+            w->conn_free = c;
+        }
+    }
+    Conn *conn = w->conn_free;
+    w->conn_free = conn->next;
+    memset(conn, 0, offsetof(Conn, in));        // the buffers need no clearing
+    conn->worker = w;
+    arena_init(&conn->arena, conn->scratch, conn_in_size);
+    return conn;
+}
+
+static void conn_put(Worker *w, Conn *conn) {
+    free(conn->owned);                  // an unsent batch answer
+    conn->owned = NULL;
+    conn->next = w->conn_free;
+    w->conn_free = conn;
+}
+
+// A stopped worker's memory: its connection slabs and its fetches (recycled
+// ones, and any the drain deadline cut short).
+static void worker_free(Worker *w) {
+    close(w->wake[0]);
+    close(w->wake[1]);
+    for (size_t i = 0; i < w->slab_count; i++) free(w->slabs[i]);
+    free(w->slabs);
+    for (int b = 0; b <= FETCH_BUCKETS; b++) {
+        Fetch **list = b < FETCH_BUCKETS ? &w->fetches[b] : &w->fetch_free;
+        while (*list) {
+            Fetch *f = *list;
+            *list = f->next;
+            free(f);
+        }
+    }
+}
+
+// Return the connections closed during this loop iteration to the pool,
+// and those the kernel has finished with since (io_pending).
+static void free_closed_conns(Worker *w) {
+    while (w->closed) {
+        Conn *conn = w->closed;
+        w->closed = conn->next;
+        if (conn->io) {                 // its recv or send is being cancelled
+            conn->next = w->io_pending;
+            w->io_pending = conn;
+        } else {
+            conn_put(w, conn);
+        }
+    }
+    for (Conn **p = &w->io_pending; *p; ) {
+        Conn *conn = *p;
+        if (conn->io) { p = &conn->next; continue; }
+        *p = conn->next;
+        conn_put(w, conn);
+    }
+}
+
+// Close connections that made no progress for --keepalive-timeout
+// (idle keep-alive clients as well as clients stuck mid-request).
+static void close_idle_conns(Worker *w) {
+    long long deadline = now_ms() - SETTING(keepalive_ms);
+    while (w->idle_head && w->idle_head->last_active <= deadline) {
+        conn_close(w->idle_head);
+    }
+}
+
+// Read everything the kernel has for us, as long as 'in' has room.
+// Returns -1 on a socket error, 0 otherwise (EOF sets conn->peer_closed).
+static int conn_fill(Conn *conn) {
+    while (conn->readable && !conn->peer_closed) {
+        size_t room = conn_in_size - conn->in_len;
+        if (room == 0) return 0;        // buffer full: parse what we have first
+        ssize_t r = recv(conn->fd, conn->in + conn->in_len, room, 0);
+        if (r > 0) {
+            conn->in_len += (size_t)r;
+            continue;
+        }
+        if (r == 0) { conn->peer_closed = 1; break; }          // client finished sending
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) { conn->readable = 0; break; }
+        return -1;
+    }
+    return 0;
+}
+
+// Answer every complete request sitting in 'in' (HTTP pipelining), as long as
+// there is room for the responses. Consumed bytes are shifted out of 'in'.
+static void conn_process(Conn *conn) {
+    conn->deferred = 0;
+    while (conn->state == CONN_READING && conn->in_len > 0) {
+        if (conn_out_size - conn->out_len < RESPONSE_RESERVE   // flush first
+            || conn->iov_count > OUT_IOV - 3 || conn->owned) {   // a response takes up to 3 segments
+            conn->deferred = 1;
+            return;
+        }
+        HttpParseResult r = http_parser_feed(&conn->parser, conn->in, conn->in_len);
+        if (r == HTTP_PARSE_INCOMPLETE) return;                 // wait for more bytes
+        conn->route = ROUTE_OTHER;                              // until handle_request() knows better
+        conn->method = r == HTTP_PARSE_DONE ? http_method(conn->parser.req.method) : METHOD_OTHER;
+        conn->started_ns = now_ns();
+        if (r != HTTP_PARSE_DONE) {                             // malformed or oversized: answer and close
+            conn->keep_alive = 0;
+            if (r == HTTP_PARSE_TOO_LARGE) {
+                write_error(conn, 431, "Request Header Fields Too Large", "request headers too large");
+            } else {
+                write_error(conn, 400, "Bad Request", "invalid request");
+            }
+            conn->state = CONN_CLOSING;
+            return;
+        }
+        const HttpRequest *req = &conn->parser.req;
+        size_t req_len = req->header_len + req->content_length; // headers + body (req->body)
+        if (req_len > conn_in_size) {
+            conn->keep_alive = 0;
+            write_error(conn, 413, "Payload Too Large", "request body too large");
+            conn->state = CONN_CLOSING;
+            return;
+        }
+        if (conn->in_len < req_len) return;                     // body not fully here yet
+        conn->requests++;
+        conn->keep_alive = req->keep_alive && conn->requests < (unsigned long)SETTING(keepalive_requests)
+                           && !conn->worker->draining;
+        conn->accept_enc = req->accept_encoding.ptr ? compress_accepted(req->accept_encoding) : 0;
+        arena_reset(&conn->arena);      // scratch memory is per request
+        RateLimiter *rl = SETTING(RATE_LIMIT);
+        long wait_ms = rl ? rate_limiter_take(rl, conn->client, conn->started_ns / 1000000) : 0;
+        if (wait_ms) {                  // over the client's rate: tell it when to come back
+            char retry[40];
+            snprintf(retry, sizeof(retry), "Retry-After: %ld\r\n", (wait_ms + 999) / 1000);
+            write_error_with(conn, 429, "Too Many Requests", "rate limit exceeded", retry);
+        } else {
+            handle_request(conn, req);  // parse and queue the response (or park in WAITING)
+        }
+        conn->in_len -= req_len;        // drop the request, keep any pipelined bytes after it
+        memmove(conn->in, conn->in + req_len, conn->in_len);
+        http_parser_init(&conn->parser, conn_in_size);
+        if (!conn->keep_alive && conn->state == CONN_READING) {
+            conn->state = CONN_CLOSING; // ignore anything after this request
+        }
+    }
+}
 
-    if (starts_with(path, "/api/v1/geo")) {
-        handle_geo(client_fd, query);
-    } else if (starts_with(path, "/api/v1/weather")) {
-        handle_weather(client_fd, query);
+// Drop the 'n' bytes the kernel took from the queued segments (a partly
+// sent one is trimmed). Returns 1 once everything is sent: the buffers are
+// free for the next responses then.
+static int out_sent(Conn *conn, size_t n) {
+    while (n > 0) {
+        struct iovec *v = &conn->iov[conn->iov_done];
+        if (n < v->iov_len) {
+            v->iov_base = (char *)v->iov_base + n;
+            v->iov_len -= n;
+            break;
+        }
+        n -= v->iov_len;
+        conn->iov_done++;
+    }
+    if (conn->iov_done < conn->iov_count) return 0;
+    conn->out_len = 0;
+    conn->iov_count = conn->iov_done = 0;
+    free(conn->owned);                  // a batch answer is sent too
+    conn->owned = NULL;
+    return 1;
+}
+
+// Push queued response segments until done or the kernel buffer is full.
+// All pipelined responses go out in one writev(); after a partial write the
+// rest follows on EVL_WRITE.
+// Returns 1 when everything was sent, 0 if we must wait for EVL_WRITE, -1 on error.
+static int conn_flush(Conn *conn) {
+    while (conn->iov_done < conn->iov_count) {
+        ssize_t w = writev(conn->fd, conn->iov + conn->iov_done, conn->iov_count - conn->iov_done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0; // resume on EVL_WRITE
+        if (w <= 0) return -1;          // peer went away
+        out_sent(conn, (size_t)w);
+    }
+    return out_sent(conn, 0);
+}
+
+// Drive one connection after the loop reported activity on it:
+// read → answer all complete requests → flush, repeated until we would block.
+static void conn_on_event(Conn *conn, int events) {
+    if (conn->fd < 0) return;           // closed earlier in this loop iteration
+    if (events & EVL_ERROR) { conn_close(conn); return; }
+    if (events & EVL_READ) conn->readable = 1;
+    idle_touch(conn);
+    while (1) {
+        if (conn->state == CONN_READING && conn_fill(conn) < 0) { conn_close(conn); return; }
+        conn_process(conn);
+        int f = conn_flush(conn);
+        if (f < 0) { conn_close(conn); return; }
+        if (f == 0) {                   // kernel buffer full: wait for EVL_WRITE
+            if (conn->state == CONN_READING) conn->state = CONN_WRITING;
+            return;
+        }
+        if (conn->state == CONN_WAITING) return;        // fetch_done() resumes us
+        if (conn->state == CONN_CLOSING) { conn_close(conn); return; }
+        conn->state = CONN_READING;
+        // Keep going only if there is more work: a buffered pipelined request
+        // or unread socket data. Otherwise wait for the next event.
+        int more_input = conn->readable && !conn->peer_closed && conn->in_len < conn_in_size;
+        if (!conn->deferred && !more_input) {
+            if (conn->peer_closed) conn_close(conn); // nothing left to answer
+            return;
+        }
+    }
+}
+
+// Hand the queued segments to the kernel in one send; the last response
+// closes the socket right behind it, in the same submission.
+static void conn_send(Conn *conn) {
+    size_t len = 0;
+    for (int i = conn->iov_done; i < conn->iov_count; i++) len += conn->iov[i].iov_len;
+    int last = conn->state == CONN_CLOSING;
+    conn->io = last ? CONN_IO_SEND_CLOSE : CONN_IO_SEND;
+    conn->io_len = len;
+    if (ev_loop_send(conn->worker->loop, conn->fd, conn->iov + conn->iov_done, conn->iov_count - conn->iov_done,
+                     last, conn) < 0) {
+        conn->io = CONN_IO_NONE;
+        conn_close(conn);
+    }
+}
+
+// The io_uring counterpart of conn_on_event(): answer the requests in 'in',
+// then give the kernel the connection's next operation, the responses to
+// send or, once they are out, a recv for more requests. Every connection
+// of the worker gets its operation submitted by the same system call, in
+// the next ev_loop_wait().
+static void conn_drive(Conn *conn) {
+    if (conn->io) return;               // conn_io_done() comes back here
+    conn_process(conn);
+    if (conn->iov_done < conn->iov_count) { conn_send(conn); return; }
+    out_sent(conn, 0);                  // nothing queued: reset the buffers
+    if (conn->state == CONN_WAITING) return;            // fetch_done() resumes us
+    if (conn->state == CONN_CLOSING || conn->peer_closed) { conn_close(conn); return; }
+    conn->io = CONN_IO_RECV;
+    if (ev_loop_recv(conn->worker->loop, conn->fd, conn->in + conn->in_len, conn_in_size - conn->in_len, conn) < 0) {
+        conn->io = CONN_IO_NONE;
+        conn_close(conn);
+    }
+}
+
+// io_uring: the connection's recv or send finished with 'result'.
+static void conn_io_done(Conn *conn, int result) {
+    ConnIo io = conn->io;
+    conn->io = CONN_IO_NONE;
+    if (conn->fd < 0) {                 // closed meanwhile: free_closed_conns() recycles it now
+        if (io == CONN_IO_SEND_CLOSE && (result < 0 || (size_t)result != conn->io_len)) {
+            close(conn->io_fd);         // the linked close did not run
+        }
+        return;
+    }
+    if (result < 0) { conn_close(conn); return; }      // reset by the peer, or the like
+    idle_touch(conn);
+    if (io == CONN_IO_RECV) {
+        if (result == 0) conn->peer_closed = 1;
+        conn->in_len += (size_t)result;
+    } else if (io == CONN_IO_SEND_CLOSE && (size_t)result == conn->io_len) {
+        conn->fd = -1;                  // all sent, and the kernel closed the socket
+        conn_close(conn);
+        return;
     } else {
-        write_response(client_fd, 404, "Not Found", "application/json", json_error(404, "not found"));
+        out_sent(conn, (size_t)result); // (all of it, unless the peer is going away)
     }
+    conn_drive(conn);
 }
 
-int main(void) {
-    // 1) Create a TCP socket (IPv4, stream oriented)
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) { perror("socket"); return 1; } // if it fails, print reason and exit
+// Continue a connection whose parked request got its answer.
+static void conn_resume(Conn *conn) {
+    if (conn->worker->async) conn_drive(conn);
+    else conn_on_event(conn, 0);
+}
 
-    // 2) Allow quick restart during development
-    int opt = 1;
-    (void)setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)); // ignore return; best-effort
+// Accept every pending client (edge-triggered: until EAGAIN) and register it.
+// Turn a connection away because --max-conns are open: a canned 503, sent
+// with one writev() on the fresh socket (its send buffer is empty), then
+// close. The request, if it is already here, is read first: closing with
+// unread data would reset the connection before the client sees the answer.
+static void reject_busy(Worker *w, int fd) {
+#define BUSY_BODY "{\"error\":{\"code\":503,\"message\":\"too many connections\"}}"
+    static const char STATUS[] = "HTTP/1.1 503 Service Unavailable\r\n";
+    static const char REST[] =
+        "Content-Type: application/json\r\n"
+        "Content-Length: 55\r\n"
+        "Retry-After: 1\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Connection: close\r\n\r\n"
+        BUSY_BODY;
+    _Static_assert(sizeof(BUSY_BODY) - 1 == 55, "Content-Length of BUSY_BODY");
+#undef BUSY_BODY
+    char request[CONFIG_READ_BUFFER], date[DATE_LINE_LEN];
+    (void)recv(fd, request, sizeof(request), MSG_DONTWAIT);
+    memcpy(date, w->clock.date, DATE_LINE_LEN);    // a copy, like every other response's
+    struct iovec iov[3] = {
+        { (void *)STATUS, sizeof(STATUS) - 1 },
+        { date, DATE_LINE_LEN },
+        { (void *)REST, sizeof(REST) - 1 },
+    };
+    (void)writev(fd, iov, 3);           // best effort: the client may be gone already
+    close(fd);
+    metrics_add(&w->metrics->conns_rejected, 1);
+}
+
+// Remember the peer address for the access log and derive its rate limiter
+// key. IPv4 clients of the dual-stack listener (::ffff:a.b.c.d) count as
+// their IPv4 address; other IPv6 clients are keyed by their /64 network,
+// the block a single host usually gets.
+static void conn_set_peer(Conn *conn, const struct sockaddr_storage *addr) {
+    const unsigned char *v4 = NULL;
+    if (addr->ss_family == AF_INET) {
+        v4 = (const unsigned char *)&((const struct sockaddr_in *)addr)->sin_addr;
+    } else {
+        const struct in6_addr *a = &((const struct sockaddr_in6 *)addr)->sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(a)) {
+            v4 = a->s6_addr + 12;
+        } else {
+            uint64_t net = 0;
+            for (int i = 0; i < 8; i++) net = net << 8 | a->s6_addr[i];
+            conn->client = 1ULL << 63 | net;                // top bit: never 0, never an IPv4 key
+            conn->peer_family = AF_INET6;
+            memcpy(conn->peer, a->s6_addr, 16);
+            return;
+        }
+    }
+    conn->client = 1ULL << 32 | (uint64_t)v4[0] << 24 | (uint64_t)v4[1] << 16 | (uint64_t)v4[2] << 8 | v4[3];
+    conn->peer_family = AF_INET;
+    memcpy(conn->peer, v4, 4);
+}
+
+// Take on a new client socket (non-blocking already), or turn it away.
+static void conn_open(Worker *w, int client_fd, const struct sockaddr_storage *client_addr) {
+    // One shared counter for all workers; conn_close() gives the place back.
+    if (atomic_fetch_add_explicit(&active_conns, 1, memory_order_relaxed) >= SETTING(max_conns)) {
+        atomic_fetch_sub_explicit(&active_conns, 1, memory_order_relaxed);
+        reject_busy(w, client_fd);
+        return;
+    }
+    Conn *conn = conn_get(w);           // recycled object: no malloc per connection
+    if (!conn) {
+        close(client_fd);
+        atomic_fetch_sub_explicit(&active_conns, 1, memory_order_relaxed);
+        return;
+    }
+    if (SETTING(tcp_nodelay)) {         // responses are already batched: no Nagle delay
+        int one = 1;
+        (void)setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    conn->fd = client_fd;
+    conn_set_peer(conn, client_addr);
+    conn->state = CONN_READING;
+    http_parser_init(&conn->parser, conn_in_size);
+    if (!w->async && ev_loop_add(w->loop, client_fd, EVL_READ | EVL_WRITE, conn) < 0) {
+        close(client_fd);
+        conn_put(w, conn);
+        atomic_fetch_sub_explicit(&active_conns, 1, memory_order_relaxed);
+        return;
+    }
+    idle_touch(conn);                   // starts the idle timer
+    metrics_add(&w->metrics->conns_accepted, 1);
+    if (w->async) conn_drive(conn);     // its first recv
+}
+
+static void accept_from(Worker *w, int listen_fd) {
+    while (1) {
+        struct sockaddr_storage client_addr;
+        socklen_t len = sizeof(client_addr);
+        int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &len);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept"); // e.g. EMFILE
+            return;
+        }
+        if (set_nonblocking(client_fd) < 0) { close(client_fd); continue; }
+        conn_open(w, client_fd, &client_addr);
+    }
+}
+
+// A listening socket is readable (the event does not say which one, and
+// there is rarely more than one).
+static void accept_clients(Worker *w) {
+    for (int i = 0; i < w->listen_count; i++) {
+        if (w->listeners[i].fd >= 0) accept_from(w, w->listeners[i].fd);
+    }
+}
 
-    // 3) Bind to 0.0.0.0:PORT
-    struct sockaddr_in addr;
+// io_uring: the multishot accept on 'l' produced a client (or ended).
+// Multishot accept has nowhere to put each client's address, so it is
+// asked for afterwards.
+static void accept_done(Worker *w, Listener *l, int result, int more) {
+    if (result >= 0) {
+        struct sockaddr_storage client_addr;
+        socklen_t len = sizeof(client_addr);
+        if (getpeername(result, (struct sockaddr *)&client_addr, &len) < 0) close(result);  // already gone
+        else conn_open(w, result, &client_addr);
+    }
+    if (more) return;
+    l->accepting = 0;                   // arm_accepts() starts the next one
+    if (result < 0 && result != -ECANCELED) {
+        errno = -result;
+        perror("accept");               // e.g. EMFILE: give closing connections a moment
+        l->retry_ms = now_ms() + ACCEPT_RETRY_MS;
+    }
+}
+
+// io_uring: keep a multishot accept running on every listening socket.
+// Returns 1 if one waits for its retry time.
+static int arm_accepts(Worker *w) {
+    int waiting = 0;
+    for (int i = 0; i < w->listen_count; i++) {
+        Listener *l = &w->listeners[i];
+        if (l->fd < 0 || l->accepting) continue;
+        if (l->retry_ms && now_ms() < l->retry_ms) { waiting = 1; continue; }
+        l->retry_ms = 0;
+        if (ev_loop_accept(w->loop, l->fd, l) == 0) l->accepting = 1;
+        else { l->retry_ms = now_ms() + ACCEPT_RETRY_MS; waiting = 1; }  // submission queue full
+    }
+    return waiting;
+}
+
+// Draining (SIGTERM, or a successor took our sockets): stop accepting,
+// close keep-alive connections once they are quiet for DRAIN_QUIET_MS and
+// let the others finish their request, answered with "Connection: close".
+// (A client that just got an answer is likely sending the next request:
+// closing under it would fail that request.) At the deadline the rest are
+// closed. Returns 1 once the worker has no connections left.
+static int worker_drain(Worker *w, long long deadline) {
+    if (!w->draining) {
+        w->draining = 1;
+        w->prefetch = 0;
+        if (!w->async) accept_clients(w);   // what the kernel already queued still gets an answer
+        for (int i = 0; i < w->listen_count; i++) {
+            Listener *l = &w->listeners[i];
+            if (l->accepting) ev_loop_cancel(w->loop, l);   // ends with -ECANCELED
+            else if (!w->async) ev_loop_del(w->loop, l->fd);
+            close(l->fd);               // a successor holding the same socket keeps it open
+            l->fd = -1;
+        }
+    }
+    long long now = now_ms(), quiet = now - DRAIN_QUIET_MS;
+    for (Conn *conn = w->idle_head, *next; conn; conn = next) {
+        next = conn->next;
+        if (now >= deadline) { conn_close(conn); continue; }
+        if (conn->last_active > quiet) break;       // the list is ordered by last activity
+        if (conn->state == CONN_READING && conn->in_len == 0 && conn->iov_count == 0) conn_close(conn);
+    }
+    free_closed_conns(w);
+    for (int i = 0; i < w->listen_count; i++) {
+        if (w->listeners[i].accepting) return 0;    // its -ECANCELED still has to come
+    }
+    return w->idle_head == NULL && w->io_pending == NULL;
+}
+
+// Listening socket options that may change while the server runs
+// (set by open_listener(), again on SIGHUP).
+static void tune_listener(int fd, const Config *c) {
+#ifdef TCP_DEFER_ACCEPT
+    int defer = (int)c->tcp_defer_accept;   // the kernel holds the connection until data arrives
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer));
+#endif
+#ifdef TCP_FASTOPEN
+    int qlen = (int)c->tcp_fastopen;        // the request may come with the SYN
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen));
+#endif
+    (void)fd; (void)c;
+}
+
+// Create a non-blocking listening socket on --bind and --port. The default
+// "::" is dual stack (IPv4 clients arrive as ::ffff:a.b.c.d); on a host
+// without IPv6 it falls back to 0.0.0.0.
+// SO_REUSEPORT lets every worker bind its own socket to the same port; the
+// kernel then load-balances incoming connections between them.
+// Returns the fd, or -1 after printing the reason.
+static int open_listener(const Config *c) {
+    // 1) Parse the address and create a TCP socket of its family
+    struct sockaddr_storage addr;
+    struct sockaddr_in *a4 = (struct sockaddr_in *)&addr;
+    struct sockaddr_in6 *a6 = (struct sockaddr_in6 *)&addr;
+    socklen_t addr_len;
     memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(PORT);
-    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    if (inet_pton(AF_INET6, c->bind, &a6->sin6_addr) == 1) {
+        a6->sin6_family = AF_INET6;
+        a6->sin6_port = htons((uint16_t)c->port);
+        addr_len = sizeof(*a6);
+    } else if (inet_pton(AF_INET, c->bind, &a4->sin_addr) == 1) {
+        a4->sin_family = AF_INET;
+        a4->sin_port = htons((uint16_t)c->port);
+        addr_len = sizeof(*a4);
+    } else {
+        fprintf(stderr, "--bind %s: not an IPv4 or IPv6 address\n", c->bind);
+        return -1;
+    }
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0 && errno == EAFNOSUPPORT && IN6_IS_ADDR_UNSPECIFIED(&a6->sin6_addr)) {
+        memset(&addr, 0, sizeof(addr));         // no IPv6 here: "::" means 0.0.0.0
+        a4->sin_family = AF_INET;
+        a4->sin_addr.s_addr = htonl(INADDR_ANY);
+        a4->sin_port = htons((uint16_t)c->port);
+        addr_len = sizeof(*a4);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if (fd < 0) { perror("socket"); return -1; }
+
+    // 2) Allow quick restart during development, and sharing the port between workers
+    int opt = 1;
+    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)); // ignore return; best-effort
+#ifdef SO_REUSEPORT
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(fd);
+        return -1;
+    }
+#endif
+    if (addr.ss_family == AF_INET6) {           // "::" takes IPv4 too (some systems default to v6 only)
+        int v6only = 0;
+        (void)setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+    }
+    tune_listener(fd, c);
+
+    // 3) Bind to the address
+    if (bind(fd, (struct sockaddr *)&addr, addr_len) < 0) {
         perror("bind");
-        close(server_fd);
-        return 1;
+        close(fd);
+        return -1;
     }
 
-    // 4) Start listening
-    if (listen(server_fd, BACKLOG) < 0) {
+    // 4) Start listening (non-blocking, so accept() never waits inside the loop)
+    if (listen(fd, (int)c->backlog) < 0 || set_nonblocking(fd) < 0) {
         perror("listen");
-        close(server_fd);
-        return 1;
+        close(fd);
+        return -1;
     }
+    return fd;
+}
 
-    printf("Weather API server running on http://localhost:%d\n", PORT);
+// Refresh the next PREFETCH cities that are due. Each city comes up once per
+// pass; a pass takes about half the cache TTL, so prefetched entries are
+// replaced before they expire (the short first pass warms the cache quickly).
+// Returns the milliseconds until the next city is due.
+static int prefetch_run(Worker *w) {
+    long long now = now_us();
+    if (w->prefetch_due < now - 1000000) w->prefetch_due = now;   // fell behind: no catch-up burst
+    for (int burst = 0; burst < PREFETCH_BURST && w->prefetch_due <= now; burst++) {
+        const CityRecord *c = &CITIES.records[PREFETCH[w->prefetch_next]];
+        double qlat, qlon;
+        uint64_t key = weather_cache_key(c->lat, c->lon, &qlat, &qlon);
+        weather_refresh(w, key, qlat, qlon);
+        if (++w->prefetch_next == prefetch_count) {
+            w->prefetch_next = 0;
+            w->prefetch_warm = 1;       // first pass done: from now on at the steady pace
+        }
+        w->prefetch_due += w->prefetch_warm ? SETTING(prefetch_step_us) : 1000000 / PREFETCH_MAX_PER_SEC;
+    }
+    long long wait = w->prefetch_due - now;
+    return wait <= 0 ? 0 : (int)((wait + 999) / 1000);
+}
 
-    // 5) Main loop: accept, read one request, respond, close
+// Worker thread body: wait for ready sockets, then accept / read / write
+// without blocking. Waking up at least once per second lets us close idle
+// keep-alive clients; upstream deadlines may wake us sooner.
+static void *worker_run(void *arg) {
+    Worker *w = arg;
+    EvEvent events[MAX_EVENTS];
+    clock_tick(&w->clock);
     while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t len = sizeof(client_addr);
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &len); // wait for a client
-        if (client_fd < 0) {
+        int timeout = 1000;
+        if (w->upstream) {
+            int t = upstream_pool_timeout(w->upstream);
+            if (t >= 0 && t < timeout) timeout = t;
+        }
+        if (w->prefetch) {
+            int t = prefetch_run(w);
+            if (t < timeout) timeout = t;
+        }
+        long long deadline = SETTING(drain_deadline);
+        if (deadline) {
+            if (worker_drain(w, deadline)) break;
+            if (timeout > 100) timeout = 100;   // check on the stragglers often
+        } else if (w->async && arm_accepts(w) && timeout > ACCEPT_RETRY_MS) {
+            timeout = ACCEPT_RETRY_MS;
+        }
+        int n = ev_loop_wait(w->loop, events, MAX_EVENTS, timeout);
+        if (n < 0) {
             if (errno == EINTR) continue;
-            perror("accept");
+            perror("event loop wait");
             break;
         }
+        clock_tick(&w->clock);          // responses of this iteration share one Date
+        for (int i = 0; i < n; i++) {
+            void *data = events[i].data;
+            if (events[i].events & EVL_DONE) {           // io_uring: an operation finished
+                Listener *l = data;
+                if (l >= w->listeners && l < w->listeners + w->listen_count) {
+                    accept_done(w, l, events[i].result, events[i].events & EVL_MORE);
+                } else conn_io_done(data, events[i].result);
+            } else if (data == w->wake) {
+                char buf[64];
+                while (read(w->wake[0], buf, sizeof(buf)) > 0) {}  // (drain_deadline is read at the top)
+                w->woken = 1;
+            } else if (data == NULL) accept_clients(w);
+            else if (w->upstream && upstream_pool_owns(w->upstream, data)) {
+                upstream_on_event(w->upstream, data, events[i].events);
+            } else conn_on_event(data, events[i].events);
+        }
+        if (w->upstream) upstream_pool_tick(w->upstream);   // deadlines, queued fetches
+        if (w->remote_fetches && (w->woken || now_ms() >= w->recheck_ms)) {
+            fetch_recheck(w);
+            w->recheck_ms = now_ms() + RECHECK_MS;
+        }
+        w->woken = 0;
+        close_idle_conns(w);
+        free_closed_conns(w);
+    }
+    atomic_fetch_sub(&running_workers, 1);
+    return NULL;
+}
 
-        char buf[BUF_SIZE];
-        ssize_t r = recv(client_fd, buf, sizeof(buf) - 1, 0); // read raw HTTP request bytes
-        if (r > 0) {
-            buf[r] = '\0';               // turn bytes into a C string for simple parsing
-            handle_request(client_fd, buf); // parse and send response
+// Sort helper for --prefetch: most populous cities first.
+static int by_population_desc(const void *a, const void *b) {
+    uint32_t pa = CITIES.records[*(const uint32_t *)a].population;
+    uint32_t pb = CITIES.records[*(const uint32_t *)b].population;
+    return pa < pb ? 1 : pa > pb ? -1 : 0;
+}
+
+// Choose the cities the prefetcher keeps warm (its pace follows the TTL:
+// prefetch_pace()). Returns -1 if memory runs out.
+static int build_prefetch_list(long n) {
+    if (n < 0 || (size_t)n > CITIES.count) n = (long)CITIES.count;
+    if (n == 0) return 0;
+    PREFETCH = malloc(CITIES.count * sizeof(*PREFETCH));
+    if (!PREFETCH) return -1;
+    for (size_t i = 0; i < CITIES.count; i++) PREFETCH[i] = (uint32_t)i;
+    qsort(PREFETCH, CITIES.count, sizeof(*PREFETCH), by_population_desc);
+    prefetch_count = (size_t)n;
+    return 0;
+}
+
+// Prefetch every city once per half TTL, but never faster than
+// PREFETCH_MAX_PER_SEC.
+static void prefetch_pace(long ttl_sec) {
+    if (prefetch_count == 0) return;
+    long long step = ttl_sec * 1000000LL / 2 / (long long)prefetch_count;
+    if (step < 1000000 / PREFETCH_MAX_PER_SEC) {
+        step = 1000000 / PREFETCH_MAX_PER_SEC;
+        fprintf(stderr, "warning: --prefetch %zu is more than %d requests/s can refresh every %lds\n",
+                prefetch_count, PREFETCH_MAX_PER_SEC, ttl_sec / 2);
+    }
+    atomic_store_explicit(&prefetch_step_us, step, memory_order_relaxed);
+}
+
+// Apply the settings that may change while the server runs: once before the
+// workers start (pool == NULL), then on every SIGHUP. Open connections keep
+// going; new values apply from their next request (or new connection).
+// Returns -1 if the rate limiter cannot be created.
+static int apply_settings(const Config *c, Worker *pool, int workers) {
+    static RateLimiter *limiter;        // kept when --rate-limit goes to 0, reused if it comes back
+    atomic_store_explicit(&keepalive_ms, c->keepalive_timeout, memory_order_relaxed);
+    atomic_store_explicit(&keepalive_requests, c->keepalive_requests, memory_order_relaxed);
+    atomic_store_explicit(&tcp_nodelay, (int)c->tcp_nodelay, memory_order_relaxed);
+
+    // Admission control: without --max-conns, stay below the fd limit so
+    // accept() never fails with EMFILE
+    long conns = c->max_conns;
+    if (conns == 0) {
+        struct rlimit rl;
+        conns = getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+            ? (long)rl.rlim_cur - RESERVED_FDS : 1000000;
+        if (conns < 16) conns = 16;
+    }
+    atomic_store_explicit(&max_conns, conns, memory_order_relaxed);
+    if (c->rate_limit > 0) {
+        unsigned rate = (unsigned)(c->rate_limit < 1000000 ? c->rate_limit : 1000000);
+        long burst = c->rate_burst ? c->rate_burst
+            : c->rate_limit * 2 < RATE_LIMIT_MAX_BURST ? c->rate_limit * 2 : RATE_LIMIT_MAX_BURST;
+        if (limiter) rate_limiter_set(limiter, rate, (unsigned)burst);
+        else if (!(limiter = rate_limiter_create(rate, (unsigned)burst, RATE_LIMIT_SLOTS))) return -1;
+        atomic_store_explicit(&RATE_LIMIT, limiter, memory_order_release);
+    } else {
+        atomic_store_explicit(&RATE_LIMIT, NULL, memory_order_release);
+    }
+
+    // Weather freshness
+    weather_cache_set_ttl(WEATHER, (int)c->cache_ttl, (int)c->cache_stale);
+    atomic_store_explicit(&weather_ttl_sec, (int)c->cache_ttl, memory_order_relaxed);
+    prefetch_pace(c->cache_ttl);
+
+    // Listening sockets: listen() again only resizes the queue
+    drain_timeout_ms = c->drain_timeout;
+    for (int i = 0; pool && i < workers; i++) {
+        for (int j = 0; j < pool[i].listen_count; j++) {
+            tune_listener(pool[i].listeners[j].fd, c);
+            if (listen(pool[i].listeners[j].fd, (int)c->backlog) < 0) perror("listen");
         }
-        close(client_fd);                  // done with this client (one request per connection)
     }
+    return 0;
+}
+
+static void on_sighup(int sig) {
+    (void)sig;
+    reload_requested = 1;
+}
+
+static void on_stop(int sig) {
+    (void)sig;
+    stop_requested++;
+}
+
+// A handoff to a new process, run on a thread of its own: handoff_give()
+// waits up to half a minute for the new workers, and meanwhile the main
+// thread must still react to signals.
+typedef struct {
+    int ctl;
+    int fds[HANDOFF_MAX_FDS];           // each worker's listening sockets, in worker order
+    int n;
+    const char *err;
+    atomic_int state;                   // 0 running, 1 taken over, -1 failed ('err')
+    pthread_t thread;
+} HandoffJob;
+
+static void *handoff_run(void *arg) {
+    HandoffJob *job = arg;
+    int rc = handoff_give(job->ctl, job->fds, job->n, WEATHER, &job->err);
+    atomic_store(&job->state, rc == 0 ? 1 : -1);
+    return NULL;
+}
+
+// Every worker: stop accepting, then finish within 'ms' (0: close all now).
+static void start_drain(long ms) {
+    atomic_store_explicit(&drain_deadline, now_ms() + ms, memory_order_relaxed);
+    wake_workers();                     // at once, not after their next timeout
+}
+
+// SIGHUP: read the configuration again (file, environment, command line),
+// apply what can change without a restart and reopen the access log (after
+// log rotation). Connections are not touched.
+static void reload_config(const Config *running, int argc, char **argv, Worker *pool, int workers) {
+    access_log_reopen(ACCESS_LOG);
+    Config next;
+    char err[512];
+    if (config_load(&next, argc, argv, err, sizeof(err)) != CONFIG_OK) {
+        fprintf(stderr, "SIGHUP: %s; keeping the current settings\n", err);
+        return;
+    }
+    config_report_restart(running, &next, stderr);
+    if (apply_settings(&next, pool, workers) < 0) perror("SIGHUP: rate_limiter_create");
+    config_free(&next);
+    fprintf(stderr, "SIGHUP: settings reloaded\n");
+}
+
+int main(int argc, char **argv) {
+    // A client that disconnects mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // Only this thread takes SIGHUP, SIGTERM and SIGINT: block them before
+    // any thread starts (workers and the access log writer inherit the
+    // mask), unblock them below.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sighup;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+    sa.sa_handler = on_stop;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGHUP);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    // 1) Configuration: defaults < --config file < WEATHER_* environment < command line
+    Config cfg;
+    char err[512];
+    int rc = config_load(&cfg, argc, argv, err, sizeof(err));
+    if (rc == CONFIG_HELP) { config_usage(argv[0], stdout); return 0; }
+    if (rc != CONFIG_OK) {
+        fprintf(stderr, "%s: %s (see --help)\n", argv[0], err);
+        return 1;
+    }
+    int workers = (int)cfg.workers;
+    if (workers == 0) {                     // one worker per online CPU
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)(cpus < CONFIG_MAX_WORKERS ? cpus : CONFIG_MAX_WORKERS) : 1;
+    }
+    conn_in_size = (size_t)cfg.read_buffer;
+    conn_out_size = (size_t)cfg.write_buffer;
+
+    // 2) Load the city database, then format the responses that never change
+    if (cfg.cities) {
+        const char *cerr;
+        if (city_db_open(&CITIES, cfg.cities, &cerr) < 0) {
+            fprintf(stderr, "%s: %s\n", cfg.cities, cerr);
+            return 1;
+        }
+    } else if (city_db_build(&CITIES, DEMO_CITIES, NUM_DEMO_CITIES) < 0) {
+        perror("city_db_build");
+        return 1;
+    }
+    if (build_geo_responses() < 0) { perror("build_geo_responses"); return 1; }
+
+    // 3) Weather provider behind the shared cache
+    PROVIDER = strcmp(cfg.provider, "open-meteo") == 0
+        ? provider_open_meteo(cfg.upstream)
+        : provider_demo(&CITIES, cfg.radius_km);
+    WEATHER = weather_cache_create((size_t)cfg.cache_size, (int)cfg.cache_ttl, (int)cfg.cache_stale);
+    if (!WEATHER) { perror("weather_cache_create"); return 1; }
+    FORECASTS = forecast_store_create(FORECAST_STORE_SIZE, FORECAST_TTL_SEC);
+    if (!FORECASTS) { perror("forecast_store_create"); return 1; }
+    if (build_prefetch_list(cfg.prefetch) < 0) { perror("build_prefetch_list"); return 1; }
+    if (apply_settings(&cfg, NULL, 0) < 0) { perror("rate_limiter_create"); return 1; }
 
-    close(server_fd);                      // close the listening socket
+    // 4) Restart: take the listening sockets (and the cached answers) over
+    //    from the process serving on --handoff-socket, if there is one
+    int taken[HANDOFF_MAX_FDS], ntaken = 0, handoff = -1;
+    if (cfg.handoff_socket) {
+        const char *herr;
+        size_t entries;
+        handoff = handoff_take(cfg.handoff_socket, taken, HANDOFF_MAX_FDS, &ntaken, WEATHER, &entries, &herr);
+        if (handoff < 0 && herr) {
+            fprintf(stderr, "%s: %s\n", cfg.handoff_socket, herr);
+            return 1;
+        }
+        if (handoff >= 0) {
+            printf("Took over %d listening socket%s and %zu cached answer%s from %s\n", ntaken,
+                   ntaken == 1 ? "" : "s", entries, entries == 1 ? "" : "s", cfg.handoff_socket);
+        }
+    }
+
+    // 5) Every worker gets its own listening socket and event loop. Sockets
+    //    taken over are dealt out in turn; with more workers than sockets the
+    //    rest open new ones, with fewer some workers get several.
+    //    Listeners are registered with data == NULL; clients carry their Conn.
+    Worker *pool = calloc((size_t)workers, sizeof(*pool));
+    METRICS = metrics_create(workers);
+    if (!pool || !METRICS) { perror("calloc"); return 1; }
+    for (int i = 0; i < workers; i++) {
+        int mine = ntaken > i ? (ntaken - i + workers - 1) / workers : 1;
+        pool[i].listeners = calloc((size_t)mine, sizeof(Listener));
+        if (!pool[i].listeners) { perror("calloc"); return 1; }
+    }
+    for (int j = 0; j < ntaken; j++) {
+        Worker *w = &pool[j % workers];
+        if (set_nonblocking(taken[j]) < 0) { perror("fcntl"); return 1; }
+        tune_listener(taken[j], &cfg);
+        if (listen(taken[j], (int)cfg.backlog) < 0) perror("listen");
+        w->listeners[w->listen_count++].fd = taken[j];
+    }
+    WORKERS = pool;
+    num_workers = workers;
+    if (cfg.access_log) {                   // one ring per worker, one writer thread for all
+        const char *lerr;
+        ACCESS_LOG = access_log_open(cfg.access_log, workers, &lerr);
+        if (!ACCESS_LOG) { fprintf(stderr, "%s: %s\n", cfg.access_log, lerr); return 1; }
+    }
+    for (int i = 0; i < workers; i++) {
+        Worker *w = &pool[i];
+        w->id = i;
+        w->metrics = &METRICS[i];
+        w->log = ACCESS_LOG ? access_log_ring(ACCESS_LOG, i) : NULL;
+        w->compressor = compressor_create();
+        if (!w->compressor) { perror("compressor_create"); return 1; }
+        w->prefetch = i == 0 && prefetch_count > 0;   // one prefetcher is enough: the cache is shared
+        w->prefetch_due = now_us();
+        if (w->listen_count == 0) {
+            w->listeners[0].fd = open_listener(&cfg);
+            if (w->listeners[0].fd < 0) return 1;
+            w->listen_count = 1;
+        }
+        w->loop = ev_loop_create(cfg.event_loop);
+        if (!w->loop) {
+            if (errno == ENOSYS) fprintf(stderr, "event loop %s: not available here (io_uring needs Linux 5.19+)\n", cfg.event_loop);
+            else perror("event loop");
+            return 1;
+        }
+        w->async = ev_loop_async(w->loop);  // io_uring: accepts run in the kernel (arm_accepts())
+        if (pipe(w->wake) < 0 || set_nonblocking(w->wake[0]) < 0 || set_nonblocking(w->wake[1]) < 0
+            || ev_loop_add(w->loop, w->wake[0], EVL_READ, w->wake) < 0) {
+            perror("wake pipe");
+            return 1;
+        }
+        for (int j = 0; !w->async && j < w->listen_count; j++) {
+            if (ev_loop_add(w->loop, w->listeners[j].fd, EVL_READ, NULL) < 0) {
+                perror("event loop");
+                return 1;
+            }
+        }
+        if (PROVIDER->upstream) {           // HTTP provider: requests go out from this loop
+            const char *uerr;
+            w->upstream = upstream_pool_create(w->loop, PROVIDER->upstream, UPSTREAM_CONNS,
+                                               UPSTREAM_TIMEOUT_MS, &uerr);
+            if (!w->upstream) {
+                fprintf(stderr, "%s: %s\n", PROVIDER->upstream, uerr);
+                return 1;
+            }
+        }
+    }
+
+    printf("Weather API server running on http://localhost:%ld (%s, %s scan, %s compression, %d worker%s, %zu cities, %s weather)\n",
+           cfg.port, ev_loop_backend(pool[0].loop), scan_backend(), compress_support(), workers, workers == 1 ? "" : "s", CITIES.count, PROVIDER->name);
+    fflush(stdout);
+
+    // 6) Start the workers (they return once drained, or on fatal errors),
+    //    then let the old process go and wait for the next restart
+    atomic_store(&running_workers, workers);
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&pool[i].thread, NULL, worker_run, &pool[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+    }
+    if (handoff >= 0) handoff_done(handoff);
+    int ctl = -1;
+    if (cfg.handoff_socket) {
+        ctl = handoff_listen(cfg.handoff_socket);
+        if (ctl < 0) perror(cfg.handoff_socket);    // serve anyway, just without handoff
+    }
+
+    // 7) Meanwhile this thread handles signals and handoff requests (each
+    //    handoff runs on a thread of its own: see HandoffJob). A signal
+    //    cuts the poll short; one arriving just before it is picked up a
+    //    second later.
+    //      SIGHUP            reload the configuration
+    //      SIGTERM, SIGINT   drain for --drain-timeout, then exit; a second one exits now
+    pthread_sigmask(SIG_UNBLOCK, &sigs, NULL);
+    int draining = 0, handed_over = 0, stops = 0, handing = 0;
+    HandoffJob job;
+    while (atomic_load(&running_workers) > 0) {
+        struct pollfd p = { ctl, POLLIN, 0 };
+        int ready = poll(&p, ctl >= 0 && !draining && !handing ? 1 : 0, draining || handing ? 100 : 1000);
+        if (reload_requested) {
+            reload_requested = 0;
+            reload_config(&cfg, argc, argv, draining ? NULL : pool, workers);
+        }
+        if (stop_requested != stops) {
+            stops = stop_requested;
+            start_drain(draining ? 0 : drain_timeout_ms);
+            draining = 1;
+        }
+        if (handing && atomic_load(&job.state) != 0) {
+            pthread_join(job.thread, NULL);
+            handing = 0;
+            if (atomic_load(&job.state) > 0) {
+                fprintf(stderr, "Handed over to the new process; draining\n");
+                if (!draining) start_drain(drain_timeout_ms);
+                draining = 1;
+                handed_over = 1;
+            } else {
+                fprintf(stderr, "handoff failed (%s); %s\n", job.err, draining ? "draining" : "still serving");
+            }
+        }
+        if (ready > 0 && (p.revents & POLLIN) && !draining && !handing) {
+            // A new process asks for the sockets: each worker's, in worker order
+            job.ctl = ctl;
+            job.n = 0;
+            for (int i = 0; i < workers; i++) {
+                for (int j = 0; j < pool[i].listen_count && job.n < HANDOFF_MAX_FDS; j++) {
+                    job.fds[job.n++] = pool[i].listeners[j].fd;
+                }
+            }
+            atomic_init(&job.state, 0);
+            if (pthread_create(&job.thread, NULL, handoff_run, &job) == 0) handing = 1;
+            else fprintf(stderr, "handoff failed (pthread_create); still serving\n");
+        }
+    }
+    // Drained while a handoff was still running: the new process may be
+    // about to serve, so leave it the socket path (and do not wait for it)
+    if (handing) handed_over = 1;
+    if (ctl >= 0) {
+        if (!handing) close(ctl);
+        if (!handed_over) unlink(cfg.handoff_socket);   // else it is the successor's now
+    }
+    for (int i = 0; i < workers; i++) {
+        pthread_join(pool[i].thread, NULL);
+        ev_loop_destroy(pool[i].loop);
+        compressor_destroy(pool[i].compressor);
+        for (int j = 0; j < pool[i].listen_count; j++) {
+            if (pool[i].listeners[j].fd >= 0) close(pool[i].listeners[j].fd);
+        }
+        free(pool[i].listeners);
+        worker_free(&pool[i]);
+    }
+    access_log_close(ACCESS_LOG);           // writes out what is still queued
+    free(pool);
+    config_free(&cfg);
     return 0;
 }
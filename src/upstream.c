@@ -0,0 +1,431 @@
+// Non-blocking upstream HTTP client. Each connection slot moves through
+// FREE → CONNECTING → BUSY (request sent, reading the answer) → IDLE
+// (keep-alive, ready for the next request) → ... → CLOSED → FREE.
+// A slot closed while the worker handles a batch of events stays CLOSED until
+// the next upstream_pool_tick(), so a stale event later in the same batch can
+// never be mistaken for activity on a new connection in that slot.
+#include "upstream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UPSTREAM_RESPONSE_MAX 65536   // larger upstream answers are treated as errors
+
+typedef enum {
+    UC_FREE,        // no socket
+    UC_CLOSED,      // socket closed during this batch; becomes FREE in the next tick
+    UC_CONNECTING,  // non-blocking connect() in progress, 'req' waits to be sent
+    UC_BUSY,        // sending 'req' and reading its response
+    UC_IDLE         // keep-alive connection with nothing to do
+} UpstreamConnState;
+
+typedef struct UpstreamReq {
+    UpstreamCallback cb;
+    void *arg;
+    long long deadline;         // monotonic ms
+    int retried;                // already resent once after a stale keep-alive connection
+    struct UpstreamReq *next;   // queue / failed list
+    size_t len;
+    char data[];                // complete request bytes
+} UpstreamReq;
+
+typedef struct {
+    int fd;
+    UpstreamConnState state;
+    int reused;                 // has served a response before (the server may have dropped it)
+    UpstreamReq *req;           // request in flight (CONNECTING / BUSY)
+    size_t sent;                // bytes of req->data already sent
+    char *buf;                  // response bytes (allocated on first connect, then kept)
+    size_t len;
+} UpstreamConn;
+
+struct UpstreamPool {
+    EventLoop *loop;
+    struct sockaddr_storage addr;   // resolved once in upstream_pool_create()
+    socklen_t addr_len;
+    char host_header[272];
+    int timeout_ms;
+    UpstreamReq *queue_head;        // waiting for a connection, oldest first
+    UpstreamReq *queue_tail;
+    UpstreamReq *failed;            // failed inside upstream_get(): reported from the next tick
+    int closed;                     // number of CLOSED slots
+    int max_conns;
+    UpstreamConn conns[];
+};
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+UpstreamPool *upstream_pool_create(EventLoop *loop, const char *hostport, int max_conns,
+                                   int timeout_ms, const char **err) {
+    char host[256], port[8] = "80";
+    const char *colon = strrchr(hostport, ':');
+    size_t hlen = colon ? (size_t)(colon - hostport) : strlen(hostport);
+    if (hlen == 0 || hlen >= sizeof(host) || (colon && strlen(colon + 1) >= sizeof(port))) {
+        *err = "invalid upstream address";
+        return NULL;
+    }
+    memcpy(host, hostport, hlen);
+    host[hlen] = '\0';
+    if (colon) strcpy(port, colon + 1);
+
+    struct addrinfo hints = {0}, *res = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(host, port, &hints, &res);
+    if (rc != 0) { *err = gai_strerror(rc); return NULL; }
+
+    UpstreamPool *p = calloc(1, sizeof(*p) + (size_t)max_conns * sizeof(UpstreamConn));
+    if (!p) { freeaddrinfo(res); *err = "out of memory"; return NULL; }
+    memcpy(&p->addr, res->ai_addr, res->ai_addrlen);   // first address only: no failover
+    p->addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    p->loop = loop;
+    snprintf(p->host_header, sizeof(p->host_header), "%s", hostport);
+    p->timeout_ms = timeout_ms;
+    p->max_conns = max_conns;
+    for (int i = 0; i < max_conns; i++) p->conns[i].fd = -1;
+    return p;
+}
+
+int upstream_pool_owns(const UpstreamPool *p, const void *data) {
+    uintptr_t d = (uintptr_t)data;
+    return d >= (uintptr_t)p->conns && d < (uintptr_t)(p->conns + p->max_conns);
+}
+
+static void slot_close(UpstreamPool *p, UpstreamConn *uc) {
+    ev_loop_del(p->loop, uc->fd);
+    close(uc->fd);
+    uc->fd = -1;
+    uc->state = UC_CLOSED;
+    uc->reused = 0;
+    uc->req = NULL;
+    uc->sent = uc->len = 0;
+    p->closed++;
+}
+
+static void req_finish(UpstreamReq *req, int status, const char *body, size_t len) {
+    req->cb(req->arg, status, body, len);
+    free(req);
+}
+
+static void queue_push_front(UpstreamPool *p, UpstreamReq *req) {
+    req->next = p->queue_head;
+    p->queue_head = req;
+    if (!p->queue_tail) p->queue_tail = req;
+}
+
+// Open a non-blocking connection for 'req'. Returns 0, or -1 (slot untouched).
+static int slot_connect(UpstreamPool *p, UpstreamConn *uc, UpstreamReq *req) {
+    if (!uc->buf && !(uc->buf = malloc(UPSTREAM_RESPONSE_MAX))) return -1;
+    int fd = socket(p->addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0
+        || (connect(fd, (struct sockaddr *)&p->addr, p->addr_len) < 0 && errno != EINPROGRESS)
+        || ev_loop_add(p->loop, fd, EVL_READ | EVL_WRITE, uc) < 0) {   // EVL_WRITE fires once connected
+        close(fd);
+        return -1;
+    }
+    uc->fd = fd;
+    uc->state = UC_CONNECTING;
+    uc->req = req;
+    uc->sent = uc->len = 0;
+    return 0;
+}
+
+// Send what is left of the request. Returns 1 when all sent, 0 if the socket
+// buffer is full (wait for EVL_WRITE), -1 on error.
+static int slot_send(UpstreamConn *uc) {
+    while (uc->sent < uc->req->len) {
+        ssize_t w = send(uc->fd, uc->req->data + uc->sent, uc->req->len - uc->sent, 0);
+        if (w > 0) { uc->sent += (size_t)w; continue; }
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;
+    }
+    return 1;
+}
+
+// Hand queued requests to idle connections, opening new ones while slots are
+// free. Never calls a callback: failures go to p->failed.
+static void pump(UpstreamPool *p) {
+    while (p->queue_head) {
+        UpstreamConn *idle = NULL, *free_slot = NULL;
+        for (int i = 0; i < p->max_conns && !idle; i++) {
+            UpstreamConn *uc = &p->conns[i];
+            if (uc->state == UC_IDLE) idle = uc;
+            else if (uc->state == UC_FREE && !free_slot) free_slot = uc;
+        }
+        if (!idle && !free_slot) return;            // all busy: stay queued
+        UpstreamReq *req = p->queue_head;
+        p->queue_head = req->next;
+        if (!p->queue_head) p->queue_tail = NULL;
+        req->next = NULL;
+        if (idle) {                                 // reuse a keep-alive connection
+            idle->state = UC_BUSY;
+            idle->req = req;
+            idle->sent = idle->len = 0;
+            if (slot_send(idle) >= 0) continue;     // the rest is sent on EVL_WRITE
+            slot_close(p, idle);                    // stale connection: try again elsewhere
+            if (!req->retried) { req->retried = 1; queue_push_front(p, req); continue; }
+        } else if (slot_connect(p, free_slot, req) == 0) {
+            continue;
+        }
+        req->next = p->failed;
+        p->failed = req;
+    }
+}
+
+int upstream_get(UpstreamPool *p, const char *path, UpstreamCallback cb, void *arg) {
+    static const char fmt[] = "GET %s HTTP/1.1\r\n"
+                              "Host: %s\r\n"
+                              "Accept: application/json\r\n"
+                              "User-Agent: weather-api\r\n\r\n";
+    int len = snprintf(NULL, 0, fmt, path, p->host_header);
+    UpstreamReq *req = malloc(sizeof(*req) + (size_t)len + 1);
+    if (!req) return -1;
+    snprintf(req->data, (size_t)len + 1, fmt, path, p->host_header);
+    req->len = (size_t)len;
+    req->cb = cb;
+    req->arg = arg;
+    req->deadline = now_ms() + p->timeout_ms;
+    req->retried = 0;
+    req->next = NULL;
+    if (p->queue_tail) p->queue_tail->next = req; else p->queue_head = req;
+    p->queue_tail = req;
+    pump(p);
+    return 0;
+}
+
+// Check a "Transfer-Encoding: chunked" body in body[0..len) and, when
+// 'decode' is set, strip the framing in place. Returns 1 if complete (total
+// framed size in *used, decoded size in *out_len), 0 if more bytes are
+// needed, -1 if the framing is broken.
+static int chunked_body(char *body, size_t len, int decode, size_t *used, size_t *out_len) {
+    size_t i = 0, out = 0;
+    while (1) {
+        char *nl = memchr(body + i, '\n', len - i);
+        if (!nl) return 0;
+        char *end;
+        unsigned long n = strtoul(body + i, &end, 16);  // chunk size in hex, stops before '\n'
+        if (end == body + i || n > UPSTREAM_RESPONSE_MAX) return -1;
+        i = (size_t)(nl - body) + 1;
+        if (n == 0) break;                              // last chunk
+        if (len - i < n + 2) return 0;
+        if (decode) memmove(body + out, body + i, n);
+        out += n;
+        i += n;
+        if (body[i] == '\r') i++;
+        if (body[i] != '\n') return -1;
+        i++;
+    }
+    while (1) {                                         // optional trailers, then an empty line
+        char *nl = memchr(body + i, '\n', len - i);
+        if (!nl) return 0;
+        size_t line = (size_t)(nl - (body + i));
+        i += line + 1;
+        if (line == 0 || (line == 1 && body[i - 2] == '\r')) break;
+    }
+    *used = i;
+    *out_len = out;
+    return 1;
+}
+
+// Is the response in buf[0..len) complete? Returns 1 and fills status, body
+// and keep_alive; 0 if more bytes are needed; -1 if it cannot be parsed.
+// 'eof' says the server closed the connection after these bytes.
+static int parse_response(char *buf, size_t len, int eof, int *status,
+                          char **body, size_t *body_len, int *keep_alive) {
+    char *hend = NULL;
+    for (size_t i = 0; i + 3 < len; i++) {
+        if (memcmp(buf + i, "\r\n\r\n", 4) == 0) { hend = buf + i + 4; break; }
+    }
+    if (!hend) return eof || len == UPSTREAM_RESPONSE_MAX ? -1 : 0;
+    int minor;
+    if (sscanf(buf, "HTTP/1.%d %d", &minor, status) != 2) return -1;
+    *keep_alive = minor >= 1;                           // HTTP/1.1 default
+    long content_length = -1;
+    int chunked = 0;
+    for (char *p = buf; p < hend; ) {                   // the few headers we care about
+        char *eol = memchr(p, '\n', (size_t)(hend - p));
+        if (!eol) break;
+        if (strncasecmp(p, "Content-Length:", 15) == 0) {
+            char *v = p + 15, *end;
+            while (*v == ' ' || *v == '\t') v++;
+            if (*v < '0' || *v > '9') return -1;         // empty, negative or not a number
+            errno = 0;
+            long n = strtol(v, &end, 10);
+            while (end < eol && (*end == ' ' || *end == '\t' || *end == '\r')) end++;
+            if (errno == ERANGE || end != eol) return -1;   // overflow or trailing junk
+            if (content_length >= 0 && n != content_length) return -1;  // conflicting repeats
+            content_length = n;
+        } else if (strncasecmp(p, "Transfer-Encoding:", 18) == 0) {
+            for (char *q = p + 18; q + 7 <= eol; q++) {
+                if (strncasecmp(q, "chunked", 7) == 0) chunked = 1;
+            }
+        } else if (strncasecmp(p, "Connection:", 11) == 0) {
+            for (char *q = p + 11; q + 5 <= eol; q++) {
+                if (strncasecmp(q, "close", 5) == 0) *keep_alive = 0;
+            }
+        }
+        p = eol + 1;
+    }
+    *body = hend;
+    size_t avail = len - (size_t)(hend - buf);
+    if (chunked) {
+        size_t used, decoded;
+        int rc = chunked_body(hend, avail, 0, &used, &decoded);
+        if (rc <= 0) return rc < 0 || eof ? -1 : 0;
+        chunked_body(hend, avail, 1, &used, &decoded);  // complete: now strip the framing
+        if (used != avail) *keep_alive = 0;             // unexpected extra bytes
+        *body_len = decoded;
+    } else if (content_length >= 0) {
+        if (avail < (size_t)content_length) return eof ? -1 : 0;
+        if (avail != (size_t)content_length) *keep_alive = 0;
+        *body_len = (size_t)content_length;
+    } else {                                            // body ends when the server closes
+        if (!eof) return 0;
+        *keep_alive = 0;
+        *body_len = avail;
+    }
+    return 1;
+}
+
+// The connection broke while 'req' was in flight. A request that got no
+// answer at all on a reused keep-alive connection is sent once more (the
+// server probably closed it while idle); otherwise the request fails.
+static void slot_fail(UpstreamPool *p, UpstreamConn *uc) {
+    UpstreamReq *req = uc->req;
+    int retry = uc->reused && uc->len == 0 && !req->retried;
+    slot_close(p, uc);
+    if (retry) {
+        req->retried = 1;
+        queue_push_front(p, req);
+    } else {
+        req_finish(req, -1, NULL, 0);
+    }
+    pump(p);
+}
+
+void upstream_on_event(UpstreamPool *p, void *data, int events) {
+    UpstreamConn *uc = data;
+    if (uc->state == UC_FREE || uc->state == UC_CLOSED) return;   // stale event from this batch
+    if (uc->state == UC_IDLE) {         // the server closed the connection (or sent junk)
+        slot_close(p, uc);
+        return;
+    }
+    if (uc->state == UC_CONNECTING) {
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        if (getsockopt(uc->fd, SOL_SOCKET, SO_ERROR, &err, &elen) < 0 || err) {
+            slot_fail(p, uc);
+            return;
+        }
+        if (!(events & (EVL_WRITE | EVL_ERROR))) return;         // not connected yet
+        uc->state = UC_BUSY;
+    }
+
+    // BUSY: finish sending, then read whatever the server has for us
+    int s = slot_send(uc);
+    if (s < 0) { slot_fail(p, uc); return; }
+    if (s == 0) return;                 // resume on EVL_WRITE
+    int eof = 0;
+    while (uc->len < UPSTREAM_RESPONSE_MAX) {
+        ssize_t r = recv(uc->fd, uc->buf + uc->len, UPSTREAM_RESPONSE_MAX - uc->len, 0);
+        if (r > 0) { uc->len += (size_t)r; continue; }
+        if (r == 0) { eof = 1; break; }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        slot_fail(p, uc);
+        return;
+    }
+    int status, keep_alive;
+    char *body;
+    size_t body_len;
+    int done = parse_response(uc->buf, uc->len, eof, &status, &body, &body_len, &keep_alive);
+    if (done == 0) {
+        if (eof || uc->len == UPSTREAM_RESPONSE_MAX) slot_fail(p, uc);
+        return;                         // wait for more bytes
+    }
+    UpstreamReq *req = uc->req;
+    uc->req = NULL;
+    if (done < 0) {
+        slot_close(p, uc);
+        req_finish(req, -1, NULL, 0);
+        pump(p);
+        return;
+    }
+    // The body lives in uc->buf: keep the slot out of pump()'s reach until
+    // the callback has returned (it may queue new requests).
+    if (!keep_alive || eof) slot_close(p, uc);
+    req_finish(req, status, body, body_len);
+    if (uc->state == UC_BUSY) {
+        uc->state = UC_IDLE;
+        uc->reused = 1;
+        uc->len = 0;
+    }
+    pump(p);
+}
+
+void upstream_pool_tick(UpstreamPool *p) {
+    long long now = now_ms();
+    UpstreamReq *done = p->failed;      // everything to fail in this tick
+    p->failed = NULL;
+    for (UpstreamReq **pp = &p->queue_head; *pp; ) {
+        UpstreamReq *req = *pp;
+        if (req->deadline > now) { pp = &req->next; continue; }
+        *pp = req->next;                // expired while waiting for a connection
+        req->next = done;
+        done = req;
+    }
+    p->queue_tail = NULL;
+    for (UpstreamReq *req = p->queue_head; req; req = req->next) p->queue_tail = req;
+    for (int i = 0; i < p->max_conns; i++) {
+        UpstreamConn *uc = &p->conns[i];
+        if ((uc->state == UC_CONNECTING || uc->state == UC_BUSY) && uc->req && uc->req->deadline <= now) {
+            UpstreamReq *req = uc->req; // too slow: drop the connection
+            slot_close(p, uc);
+            req->next = done;
+            done = req;
+        }
+        if (uc->state == UC_CLOSED) {   // outside of any event batch now: reusable
+            uc->state = UC_FREE;
+            p->closed--;
+        }
+    }
+    while (done) {
+        UpstreamReq *req = done;
+        done = req->next;
+        req_finish(req, -1, NULL, 0);
+    }
+    pump(p);
+}
+
+int upstream_pool_timeout(const UpstreamPool *p) {
+    if (p->failed || (p->queue_head && p->closed)) return 0;
+    long long next = -1;
+    for (const UpstreamReq *req = p->queue_head; req; req = req->next) {
+        if (next < 0 || req->deadline < next) next = req->deadline;
+    }
+    for (int i = 0; i < p->max_conns; i++) {
+        const UpstreamConn *uc = &p->conns[i];
+        if ((uc->state == UC_CONNECTING || uc->state == UC_BUSY) && uc->req
+            && (next < 0 || uc->req->deadline < next)) next = uc->req->deadline;
+    }
+    if (next < 0) return -1;
+    long long wait = next - now_ms();
+    return wait < 0 ? 0 : (int)wait;
+}
@@ -0,0 +1,45 @@
+// Non-blocking HTTP/1.1 client for one upstream server, driven by a worker's
+// event loop. Requests are queued and sent over a small pool of keep-alive
+// connections; a request that has not been answered by its deadline fails.
+// A pool belongs to one worker thread and is not thread-safe.
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <stddef.h>
+
+#include "event_loop.h"
+
+typedef struct UpstreamPool UpstreamPool;
+
+// Called exactly once per request with the HTTP status and the body (already
+// de-chunked), or with status -1 if the request failed (connect error,
+// timeout, malformed response). 'body' is only valid during the call.
+// Callbacks run from upstream_on_event() and upstream_pool_tick(), never from
+// inside upstream_get(), so callers may queue new requests from a callback.
+typedef void (*UpstreamCallback)(void *arg, int status, const char *body, size_t len);
+
+// hostport: "host" or "host:port" (default port 80). The name is resolved
+// once, here. max_conns: connections kept open at most; timeout_ms: time
+// from upstream_get() until the response must be complete.
+// Returns NULL (with a message in *err) on failure.
+UpstreamPool *upstream_pool_create(EventLoop *loop, const char *hostport, int max_conns,
+                                   int timeout_ms, const char **err);
+
+// Queue "GET path". Returns 0, or -1 if out of memory (cb is then never called).
+int upstream_get(UpstreamPool *p, const char *path, UpstreamCallback cb, void *arg);
+
+// 1 if 'data' (from an EvEvent) is one of this pool's connections.
+int upstream_pool_owns(const UpstreamPool *p, const void *data);
+
+// Drive the connection behind 'data' after the event loop reported activity.
+void upstream_on_event(UpstreamPool *p, void *data, int events);
+
+// Housekeeping, called once after every event loop iteration: fail expired
+// requests, recycle connection slots closed during the iteration, start
+// queued requests.
+void upstream_pool_tick(UpstreamPool *p);
+
+// Milliseconds until upstream_pool_tick() has work to do (-1 = nothing pending).
+int upstream_pool_timeout(const UpstreamPool *p);
+
+#endif
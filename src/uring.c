@@ -0,0 +1,361 @@
+// io_uring backend of the event loop (see uring.h, event_loop.h).
+// Talks to the kernel directly, without liburing: the submission and
+// completion rings are mapped once, entries are filled in user space, and
+// the one io_uring_enter() in uring_wait() both submits all of them and
+// waits. A worker iteration with hundreds of sends and recvs costs one
+// system call.
+//
+// What a completion's user_data says:
+//   0                          our own housekeeping (cancel, close, poll removal): dropped
+//   gen << 33 | fd << 1 | 1    readiness of fd from ev_loop_add() (multishot poll);
+//                              a stale generation (the fd was removed meanwhile) is dropped
+//   anything else              the 'data' pointer of an accept, recv or send (always even)
+#include "uring.h"
+
+#include <errno.h>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#endif
+
+#if defined(IORING_ACCEPT_MULTISHOT) && defined(IORING_ASYNC_CANCEL_ALL)
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_ENTRIES 1024              // submission queue slots (the completion queue gets 4x)
+
+// One fd registered with uring_add()
+typedef struct {
+    void *data;                         // NULL: not registered
+    uint32_t gen;                       // bumped by every add and del
+    int armed;                          // its multishot poll is in the kernel
+} Reg;
+
+struct Uring {
+    int fd;
+    int disabled;                       // created disabled: the first uring_wait() enables it
+    unsigned *sq_head, *sq_tail, sq_mask, sq_entries;
+    unsigned sq_next;                   // our tail: entries up to here are filled in
+    struct io_uring_sqe *sqes;
+    struct msghdr *msgs;                // per submission slot: the header of its sendmsg
+    unsigned *cq_head, *cq_tail, cq_mask;
+    struct io_uring_cqe *cqes;
+    void *ring;                         // the mapped rings (one mapping for both)
+    size_t ring_size;
+    Reg *regs;                          // by fd
+    int nregs;
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned n) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+// Does the kernel know IORING_OP_SOCKET? It came with 5.19, like multishot
+// accept and cancelling by user_data with IORING_ASYNC_CANCEL_ALL, which
+// cannot be probed for themselves.
+static int new_enough(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (!probe) return 0;
+    int ok = sys_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0 && probe->last_op >= IORING_OP_SOCKET
+             && (probe->ops[IORING_OP_SOCKET].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+// Set up a ring with the best flags this kernel takes. Defer completion
+// work to our own io_uring_enter() calls where possible (6.1): the kernel
+// then never interrupts the worker to post completions.
+static int setup(struct io_uring_params *p) {
+    static const unsigned FLAGS[] = {
+#if defined(IORING_SETUP_DEFER_TASKRUN) && defined(IORING_SETUP_SINGLE_ISSUER)
+        // single issuer: the worker thread, which IORING_REGISTER_ENABLE_RINGS makes it
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED,
+#endif
+        IORING_SETUP_COOP_TASKRUN,
+        0,
+    };
+    for (size_t i = 0; i < sizeof(FLAGS) / sizeof(FLAGS[0]); i++) {
+        memset(p, 0, sizeof(*p));
+        p->flags = FLAGS[i] | IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+        p->cq_entries = 4 * URING_ENTRIES;
+        int fd = sys_setup(URING_ENTRIES, p);
+        if (fd >= 0 || errno != EINVAL) return fd;
+    }
+    return -1;
+}
+
+Uring *uring_create(void) {
+    struct io_uring_params p;
+    int fd = setup(&p);
+    if (fd < 0) {
+        if (errno == EINVAL || errno == EPERM) errno = ENOSYS;  // too old, or disabled (kernel.io_uring_disabled)
+        return NULL;
+    }
+    const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_FAST_POLL;
+    if ((p.features & needed) != needed || !new_enough(fd)) {
+        close(fd);
+        errno = ENOSYS;
+        return NULL;
+    }
+    Uring *u = calloc(1, sizeof(*u));
+    if (!u) { close(fd); errno = ENOMEM; return NULL; }
+    u->fd = fd;
+    u->disabled = (p.flags & IORING_SETUP_R_DISABLED) != 0;
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    u->msgs = calloc(p.sq_entries, sizeof(*u->msgs));
+    if (u->ring == MAP_FAILED || u->sqes == MAP_FAILED || !u->msgs) {
+        int e = u->msgs ? errno : ENOMEM;
+        if (u->ring == MAP_FAILED) u->ring = NULL;
+        if (u->sqes == MAP_FAILED) u->sqes = NULL;
+        u->sq_entries = p.sq_entries;
+        uring_destroy(u);
+        errno = e;
+        return NULL;
+    }
+    char *r = u->ring;
+    u->sq_head = (unsigned *)(r + p.sq_off.head);
+    u->sq_tail = (unsigned *)(r + p.sq_off.tail);
+    u->sq_mask = *(unsigned *)(r + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    unsigned *array = (unsigned *)(r + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;    // slot i is always entry i
+    u->sq_next = *u->sq_tail;
+    u->cq_head = (unsigned *)(r + p.cq_off.head);
+    u->cq_tail = (unsigned *)(r + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(r + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(r + p.cq_off.cqes);
+    return u;
+}
+
+void uring_destroy(Uring *u) {
+    if (!u) return;
+    close(u->fd);                       // the kernel cancels whatever is still in flight
+    if (u->sqes) munmap(u->sqes, u->sq_entries * sizeof(struct io_uring_sqe));
+    if (u->ring) munmap(u->ring, u->ring_size);
+    free(u->msgs);
+    free(u->regs);
+    free(u);
+}
+
+// Hand the kernel every entry filled in so far, without waiting.
+static int submit(Uring *u) {
+    __atomic_store_n(u->sq_tail, u->sq_next, __ATOMIC_RELEASE);
+    unsigned pending = u->sq_next - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (pending == 0 || u->disabled) return 0;     // (a disabled ring takes them once enabled)
+    int r;
+    do r = sys_enter(u->fd, pending, 0, 0, NULL, 0); while (r < 0 && errno == EINTR);
+    return r < 0 && errno != EBUSY ? -1 : 0;       // EBUSY: completions to reap first
+}
+
+// Room for 'n' more entries, submitting the queued ones if the ring is full.
+static int reserve(Uring *u, unsigned n) {
+    if (u->sq_next - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) + n <= u->sq_entries) return 0;
+    if (submit(u) < 0) return -1;
+    if (u->sq_next - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) + n <= u->sq_entries) return 0;
+    errno = EBUSY;
+    return -1;
+}
+
+// The next free entry, cleared. Call reserve() first.
+static struct io_uring_sqe *next_sqe(Uring *u, uint8_t opcode, int fd, uint64_t user_data) {
+    struct io_uring_sqe *s = &u->sqes[u->sq_next++ & u->sq_mask];
+    memset(s, 0, sizeof(*s));
+    s->opcode = opcode;
+    s->fd = fd;
+    s->user_data = user_data;
+    return s;
+}
+
+static uint64_t poll_key(const Reg *r, int fd) {
+    return (uint64_t)r->gen << 33 | (uint64_t)(uint32_t)fd << 1 | 1;
+}
+
+// Watch fd's readiness again (edge-triggered: a completion per wakeup).
+static int poll_arm(Uring *u, int fd) {
+    Reg *r = &u->regs[fd];
+    if (reserve(u, 1) < 0) return -1;
+    struct io_uring_sqe *s = next_sqe(u, IORING_OP_POLL_ADD, fd, poll_key(r, fd));
+    s->len = IORING_POLL_ADD_MULTI;
+    uint32_t mask = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    mask = mask << 16 | mask >> 16;     // the kernel swaps the halves back (liburing does the same)
+#endif
+    s->poll32_events = mask;
+    r->armed = 1;
+    return 0;
+}
+
+int uring_add(Uring *u, int fd, int events, void *data) {
+    (void)events;                       // like the epoll backend: both directions are reported
+    if (fd < 0 || !data) { errno = EINVAL; return -1; }
+    if (fd >= u->nregs) {
+        int n = u->nregs ? u->nregs : 64;
+        while (n <= fd) n *= 2;
+        Reg *regs = realloc(u->regs, (size_t)n * sizeof(*regs));
+        if (!regs) return -1;
+        memset(regs + u->nregs, 0, (size_t)(n - u->nregs) * sizeof(*regs));
+        u->regs = regs;
+        u->nregs = n;
+    }
+    Reg *r = &u->regs[fd];
+    r->gen++;
+    r->data = data;
+    return poll_arm(u, fd);
+}
+
+int uring_del(Uring *u, int fd) {
+    if (fd < 0 || fd >= u->nregs || !u->regs[fd].data) { errno = ENOENT; return -1; }
+    Reg *r = &u->regs[fd];
+    if (r->armed && reserve(u, 1) == 0) {
+        struct io_uring_sqe *s = next_sqe(u, IORING_OP_POLL_REMOVE, -1, 0);
+        s->addr = poll_key(r, fd);
+        s->flags = IOSQE_CQE_SKIP_SUCCESS;
+    }
+    r->data = NULL;
+    r->gen++;                           // whatever the old poll still reports is dropped
+    r->armed = 0;
+    return 0;
+}
+
+int uring_accept(Uring *u, int fd, void *data) {
+    if (reserve(u, 1) < 0) return -1;
+    struct io_uring_sqe *s = next_sqe(u, IORING_OP_ACCEPT, fd, (uintptr_t)data);
+    s->ioprio = IORING_ACCEPT_MULTISHOT;
+    s->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    return 0;
+}
+
+int uring_recv(Uring *u, int fd, void *buf, size_t len, void *data) {
+    if (reserve(u, 1) < 0) return -1;
+    struct io_uring_sqe *s = next_sqe(u, IORING_OP_RECV, fd, (uintptr_t)data);
+    s->addr = (uintptr_t)buf;
+    s->len = (uint32_t)len;
+    return 0;
+}
+
+int uring_send(Uring *u, int fd, const struct iovec *iov, int iovcnt, int close_after, void *data) {
+    if (reserve(u, close_after ? 2 : 1) < 0) return -1;   // a link must not be split across submissions
+    struct msghdr *m = &u->msgs[u->sq_next & u->sq_mask];
+    memset(m, 0, sizeof(*m));
+    m->msg_iov = (struct iovec *)iov;
+    m->msg_iovlen = (size_t)iovcnt;
+    struct io_uring_sqe *s = next_sqe(u, IORING_OP_SENDMSG, fd, (uintptr_t)data);
+    s->addr = (uintptr_t)m;
+    s->len = 1;
+    s->msg_flags = MSG_WAITALL | MSG_NOSIGNAL; // the kernel retries short sends itself
+    if (close_after) {
+        s->flags = IOSQE_IO_LINK;       // the close only runs if everything was sent
+        struct io_uring_sqe *c = next_sqe(u, IORING_OP_CLOSE, fd, 0);
+        c->flags = IOSQE_CQE_SKIP_SUCCESS;
+    }
+    return 0;
+}
+
+int uring_cancel(Uring *u, void *data) {
+    if (reserve(u, 1) < 0) return -1;
+    struct io_uring_sqe *s = next_sqe(u, IORING_OP_ASYNC_CANCEL, -1, 0);
+    s->addr = (uintptr_t)data;
+    s->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    s->flags = IOSQE_CQE_SKIP_SUCCESS;
+    return 0;
+}
+
+// A readiness completion: 1 if it becomes an event in 'out', 0 if dropped.
+static int poll_event(Uring *u, uint64_t key, int res, unsigned flags, EvEvent *out) {
+    int fd = (int)(uint32_t)(key >> 1);
+    if (fd >= u->nregs) return 0;
+    Reg *r = &u->regs[fd];
+    if (!r->data || r->gen != (uint32_t)(key >> 33)) return 0;     // removed since
+    int e = 0;
+    if (res < 0) {
+        r->armed = 0;                   // the fd itself is bad: report, do not retry
+        e = EVL_ERROR;
+    } else {
+        if (!(flags & IORING_CQE_F_MORE)) {
+            r->armed = 0;
+            (void)poll_arm(u, fd);      // the kernel stopped it (e.g. a full completion queue)
+        }
+        if (res & (EPOLLIN | EPOLLRDHUP)) e |= EVL_READ;
+        if (res & EPOLLOUT) e |= EVL_WRITE;
+        if (res & (EPOLLERR | EPOLLHUP)) e |= EVL_ERROR;
+    }
+    if (!e) return 0;
+    out->data = r->data;
+    out->events = e;
+    out->result = 0;
+    return 1;
+}
+
+int uring_wait(Uring *u, EvEvent *out, int max, int timeout_ms) {
+    if (u->disabled) {                  // first call, on the worker thread: it becomes the issuer
+        if (sys_register(u->fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) < 0) return -1;
+        u->disabled = 0;
+    }
+    __atomic_store_n(u->sq_tail, u->sq_next, __ATOMIC_RELEASE);
+    unsigned pending = u->sq_next - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    int ready = *u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    if (pending || !ready) {            // (completions left over from last time: no call at all)
+        struct __kernel_timespec ts = { timeout_ms / 1000, (long long)(timeout_ms % 1000) * 1000000 };
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeout_ms >= 0) arg.ts = (uint64_t)(uintptr_t)&ts;
+        unsigned wait = ready || timeout_ms == 0 ? 0 : 1;
+        if (sys_enter(u->fd, pending, wait, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0
+            && errno != ETIME && errno != EBUSY) {
+            return -1;                  // EINTR included, like epoll_wait()
+        }
+    }
+    unsigned head = *u->cq_head, tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    for (; head != tail && n < max; head++) {
+        const struct io_uring_cqe *c = &u->cqes[head & u->cq_mask];
+        if (c->user_data == 0) continue;
+        if (c->user_data & 1) {
+            n += poll_event(u, c->user_data, c->res, c->flags, &out[n]);
+            continue;
+        }
+        out[n].data = (void *)(uintptr_t)c->user_data;
+        out[n].events = EVL_DONE | (c->flags & IORING_CQE_F_MORE ? EVL_MORE : 0);
+        out[n].result = c->res;
+        n++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+#else   // no io_uring (or headers older than 5.19): the backend reports itself missing
+
+Uring *uring_create(void) { errno = ENOSYS; return NULL; }
+void uring_destroy(Uring *u) { (void)u; }
+int uring_add(Uring *u, int fd, int events, void *data) { (void)u; (void)fd; (void)events; (void)data; errno = ENOSYS; return -1; }
+int uring_del(Uring *u, int fd) { (void)u; (void)fd; errno = ENOSYS; return -1; }
+int uring_wait(Uring *u, EvEvent *out, int max, int timeout_ms) { (void)u; (void)out; (void)max; (void)timeout_ms; errno = ENOSYS; return -1; }
+int uring_accept(Uring *u, int fd, void *data) { (void)u; (void)fd; (void)data; errno = ENOSYS; return -1; }
+int uring_recv(Uring *u, int fd, void *buf, size_t len, void *data) { (void)u; (void)fd; (void)buf; (void)len; (void)data; errno = ENOSYS; return -1; }
+int uring_send(Uring *u, int fd, const struct iovec *iov, int iovcnt, int close_after, void *data) { (void)u; (void)fd; (void)iov; (void)iovcnt; (void)close_after; (void)data; errno = ENOSYS; return -1; }
+int uring_cancel(Uring *u, void *data) { (void)u; (void)data; errno = ENOSYS; return -1; }
+
+#endif
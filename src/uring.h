@@ -0,0 +1,27 @@
+// io_uring backend of the event loop (Linux 5.19+, --event-loop io_uring).
+// Only event_loop.c calls these; the meaning of every function is that of
+// its ev_loop_* counterpart in event_loop.h.
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "event_loop.h"
+
+typedef struct Uring Uring;
+
+// NULL with errno ENOSYS if this kernel (or build) lacks what we need.
+Uring *uring_create(void);
+void uring_destroy(Uring *u);
+
+int uring_add(Uring *u, int fd, int events, void *data);
+int uring_del(Uring *u, int fd);
+int uring_wait(Uring *u, EvEvent *out, int max, int timeout_ms);
+
+int uring_accept(Uring *u, int fd, void *data);
+int uring_recv(Uring *u, int fd, void *buf, size_t len, void *data);
+int uring_send(Uring *u, int fd, const struct iovec *iov, int iovcnt, int close_after, void *data);
+int uring_cancel(Uring *u, void *data);
+
+#endif
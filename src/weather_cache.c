@@ -0,0 +1,285 @@
+// Sharded TTL + LRU weather cache.
+// The key space is split over WC_SHARDS independent shards (each with its
+// own mutex), so workers rarely contend. All entries are allocated up front
+// and recycled through a free list: no malloc after startup.
+#include "weather_cache.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WC_SHARDS 16
+#define WC_ERROR_TTL_SEC 5      // how long a failed fetch is remembered
+#define WC_REFRESH_SEC 5        // a claimed refresh that has not landed by then may be retried
+
+typedef struct Entry {
+    uint64_t key;
+    int ok;                     // 0 = the last fetch failed (negative cache entry)
+    long long expires;          // monotonic seconds; 'report' (or the failure) is fresh until then
+    long long stale_until;      // ... and may be served stale until then
+    long long refresh_after;    // no new refresh (or fetch, without an answer) is handed out before this time
+    int waited;                 // a WC_PENDING was handed out since the last put
+    WeatherReport report;
+    struct Entry *hnext;        // hash bucket chain
+    struct Entry *prev, *next;  // LRU list, most recent first
+} Entry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Entry **buckets;            // power-of-two hash table
+    size_t mask;
+    Entry *lru_head, *lru_tail;
+    Entry *free_list;
+    WeatherCacheStats stats;
+} Shard;
+
+struct WeatherCache {
+    int ttl_sec;                // read and written with __atomic builtins (SIGHUP may change them)
+    int stale_sec;
+    Entry *entries;             // all entries, handed out to the shards' free lists
+    Shard shards[WC_SHARDS];
+};
+
+static long long mono_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec;
+}
+
+// Round to the grid and pack both coordinates into one 64-bit key.
+uint64_t weather_cache_key(double lat, double lon, double *qlat, double *qlon) {
+    long ilat = lround(lat / WEATHER_GRID_DEG);
+    long ilon = lround(lon / WEATHER_GRID_DEG);
+    *qlat = ilat * WEATHER_GRID_DEG;              // fetch the cell centre, not the raw point
+    *qlon = ilon * WEATHER_GRID_DEG;
+    return ((uint64_t)(uint32_t)(int32_t)ilat << 32) | (uint32_t)(int32_t)ilon;
+}
+
+// 64-bit mix (splitmix64 finalizer): spreads neighbouring cells over shards
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+WeatherCache *weather_cache_create(size_t capacity, int ttl_sec, int stale_sec) {
+    if (capacity < WC_SHARDS) capacity = WC_SHARDS;
+    WeatherCache *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->ttl_sec = ttl_sec;
+    c->stale_sec = stale_sec;
+    c->entries = calloc(capacity, sizeof(Entry));
+    if (!c->entries) { free(c); return NULL; }
+    size_t per_shard = capacity / WC_SHARDS;
+    size_t buckets = 16;
+    while (buckets < per_shard) buckets <<= 1;
+    for (int i = 0; i < WC_SHARDS; i++) {
+        Shard *s = &c->shards[i];
+        pthread_mutex_init(&s->lock, NULL);
+        s->buckets = calloc(buckets, sizeof(Entry *));
+        if (!s->buckets) return NULL;             // startup only: the process exits anyway
+        s->mask = buckets - 1;
+        for (size_t j = 0; j < per_shard; j++) {  // hand this shard its share of entries
+            Entry *e = &c->entries[i * per_shard + j];
+            e->hnext = s->free_list;
+            s->free_list = e;
+        }
+    }
+    return c;
+}
+
+void weather_cache_set_ttl(WeatherCache *c, int ttl_sec, int stale_sec) {
+    __atomic_store_n(&c->ttl_sec, ttl_sec, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->stale_sec, stale_sec, __ATOMIC_RELAXED);
+}
+
+static Entry **bucket_of(Shard *s, uint64_t key) {
+    return &s->buckets[(mix(key) >> 4) & s->mask];
+}
+
+static Entry *lookup(Shard *s, uint64_t key) {
+    for (Entry *e = *bucket_of(s, key); e; e = e->hnext) {
+        if (e->key == key) return e;
+    }
+    return NULL;
+}
+
+static void hash_remove(Shard *s, Entry *e) {
+    for (Entry **pp = bucket_of(s, e->key); *pp; pp = &(*pp)->hnext) {
+        if (*pp == e) { *pp = e->hnext; return; }
+    }
+}
+
+static void lru_unlink(Shard *s, Entry *e) {
+    if (e->prev) e->prev->next = e->next; else s->lru_head = e->next;
+    if (e->next) e->next->prev = e->prev; else s->lru_tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(Shard *s, Entry *e) {
+    e->prev = NULL;
+    e->next = s->lru_head;
+    if (s->lru_head) s->lru_head->prev = e; else s->lru_tail = e;
+    s->lru_head = e;
+}
+
+// Get an unused entry: from the free list, or by evicting the least
+// recently used one.
+static Entry *alloc_entry(Shard *s, long long now) {
+    Entry *e = s->free_list;
+    if (e) { s->free_list = e->hnext; return e; }
+    e = s->lru_tail;                              // never NULL: every shard owns entries
+    if (e->stale_until > now) s->stats.evictions++; // dead entries are not counted
+    lru_unlink(s, e);
+    hash_remove(s, e);
+    return e;
+}
+
+static Shard *shard_of(WeatherCache *c, uint64_t key) {
+    return &c->shards[mix(key) % WC_SHARDS];
+}
+
+int weather_cache_lookup(WeatherCache *c, uint64_t key, WeatherReport *out) {
+    Shard *s = shard_of(c, key);
+    pthread_mutex_lock(&s->lock);
+    Entry *e = lookup(s, key);
+    long long now = mono_sec();
+    int rc = WC_MISS;
+    if (e && e->expires > now) {                  // fresh hit (or a remembered failure)
+        rc = e->ok ? WC_HIT : WC_FAILED;
+    } else if (e && e->ok && e->stale_until > now) {
+        rc = WC_HIT;                              // stale, but good enough to answer now
+        if (e->refresh_after <= now) {            // nobody is refreshing it: this caller will
+            e->refresh_after = now + WC_REFRESH_SEC;
+            rc = WC_STALE;
+        }
+        s->stats.stale++;
+    } else if (e && e->refresh_after > now) {    // nothing to serve, but a fetch is on its way
+        rc = WC_PENDING;
+        e->waited = 1;
+    }
+    if (rc == WC_MISS || rc == WC_PENDING) {
+        s->stats.misses++;
+        if (rc == WC_MISS) {                      // claim the cell: this caller fetches it
+            if (!e) {
+                e = alloc_entry(s, now);
+                e->key = key;
+                e->ok = 0;
+                e->expires = e->stale_until = 0;  // no answer yet (an eviction is not counted)
+                e->waited = 0;
+                e->hnext = *bucket_of(s, key);
+                *bucket_of(s, key) = e;
+            } else {
+                lru_unlink(s, e);
+            }
+            e->refresh_after = now + WC_REFRESH_SEC;
+            lru_push_front(s, e);
+        }
+    } else {
+        if (e->ok) *out = e->report;
+        lru_unlink(s, e);
+        lru_push_front(s, e);
+        s->stats.hits++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return rc;
+}
+
+int weather_cache_put(WeatherCache *c, uint64_t key, const WeatherReport *report) {
+    Shard *s = shard_of(c, key);
+    pthread_mutex_lock(&s->lock);
+    long long now = mono_sec();
+    Entry *e = lookup(s, key);
+    if (e) {                                      // refresh in place
+        lru_unlink(s, e);
+    } else {
+        e = alloc_entry(s, now);
+        e->key = key;
+        e->ok = 0;                                // recycled entry: forget its old answer
+        e->waited = 0;
+        e->hnext = *bucket_of(s, key);
+        *bucket_of(s, key) = e;
+    }
+    if (report) {
+        e->ok = 1;
+        e->report = *report;
+        e->expires = e->refresh_after = now + __atomic_load_n(&c->ttl_sec, __ATOMIC_RELAXED);
+        e->stale_until = e->expires + __atomic_load_n(&c->stale_sec, __ATOMIC_RELAXED);
+    } else if (e->ok && e->stale_until > now) {   // failed refresh: keep serving the old answer
+        s->stats.errors++;
+        e->refresh_after = now + WC_ERROR_TTL_SEC;
+    } else {
+        s->stats.errors++;
+        e->ok = 0;
+        e->expires = e->stale_until = e->refresh_after = now + WC_ERROR_TTL_SEC;
+    }
+    int waited = e->waited;
+    e->waited = 0;
+    lru_push_front(s, e);
+    pthread_mutex_unlock(&s->lock);
+    return waited;
+}
+
+WeatherCacheItem *weather_cache_export(WeatherCache *c, size_t *n) {
+    size_t cap = 0, count = 0;
+    WeatherCacheItem *items = NULL;
+    for (int i = 0; i < WC_SHARDS; i++) {
+        Shard *s = &c->shards[i];
+        pthread_mutex_lock(&s->lock);
+        long long now = mono_sec();
+        for (Entry *e = s->lru_tail; e; e = e->prev) {      // oldest first: import keeps the order
+            if (!e->ok || e->stale_until <= now) continue;
+            if (count == cap) {
+                size_t ncap = cap ? cap * 2 : 1024;
+                WeatherCacheItem *p = realloc(items, ncap * sizeof(*items));
+                if (!p) { pthread_mutex_unlock(&s->lock); free(items); return NULL; }
+                items = p;
+                cap = ncap;
+            }
+            items[count++] = (WeatherCacheItem){ e->key, (int32_t)(e->expires - now),
+                                                 (int32_t)(e->stale_until - now), e->report };
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    *n = count;
+    if (!count) { free(items); return NULL; }
+    return items;
+}
+
+void weather_cache_import(WeatherCache *c, const WeatherCacheItem *item) {
+    if (item->stale_sec <= 0) return;
+    Shard *s = shard_of(c, item->key);
+    pthread_mutex_lock(&s->lock);
+    long long now = mono_sec();
+    Entry *e = lookup(s, item->key);
+    if (e) {
+        lru_unlink(s, e);
+    } else {
+        e = alloc_entry(s, now);
+        e->key = item->key;
+        e->waited = 0;
+        e->hnext = *bucket_of(s, item->key);
+        *bucket_of(s, item->key) = e;
+    }
+    e->ok = 1;
+    e->report = item->report;
+    e->expires = e->refresh_after = now + item->fresh_sec;
+    e->stale_until = now + item->stale_sec;
+    lru_push_front(s, e);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void weather_cache_stats(WeatherCache *c, WeatherCacheStats *out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < WC_SHARDS; i++) {
+        Shard *s = &c->shards[i];
+        pthread_mutex_lock(&s->lock);
+        out->hits += s->stats.hits;
+        out->stale += s->stats.stale;
+        out->misses += s->stats.misses;
+        out->evictions += s->stats.evictions;
+        out->errors += s->stats.errors;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
@@ -0,0 +1,78 @@
+// In-memory weather cache shared by all worker threads.
+// Keys are lat/lon rounded to a grid (WEATHER_GRID_DEG), so nearby requests
+// share one upstream answer. Entries expire after a TTL; when the cache is
+// full the least recently used entry is evicted. An expired answer is still
+// served for a while (stale-while-revalidate) while one caller refreshes it.
+// The cache does not fetch, but it decides who does: the first caller to
+// miss a cell claims it (WC_MISS), and until its answer is stored, callers
+// from any thread get WC_PENDING instead of a second fetch.
+#ifndef WEATHER_CACHE_H
+#define WEATHER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "provider.h"
+
+#define WEATHER_GRID_DEG 0.01   // ~1.1 km cells
+
+typedef struct WeatherCache WeatherCache;
+
+// Counters since startup (read with weather_cache_stats).
+typedef struct {
+    uint64_t hits;
+    uint64_t stale;             // hits served after the TTL while a refresh runs
+    uint64_t misses;
+    uint64_t evictions;         // LRU evictions of live entries
+    uint64_t errors;            // failed upstream fetches
+} WeatherCacheStats;
+
+// capacity: max cached locations; ttl_sec: how long an answer stays fresh;
+// stale_sec: how much longer it may be served while it is being refreshed.
+WeatherCache *weather_cache_create(size_t capacity, int ttl_sec, int stale_sec);
+
+// Change both for answers stored from now on (any thread).
+void weather_cache_set_ttl(WeatherCache *c, int ttl_sec, int stale_sec);
+
+// Cache key of the grid cell containing lat/lon; *qlat / *qlon receive the
+// cell centre (the coordinates to fetch).
+uint64_t weather_cache_key(double lat, double lon, double *qlat, double *qlon);
+
+// Results of weather_cache_lookup()
+#define WC_FAILED -1    // the last fetch for this cell failed recently
+#define WC_MISS 0       // nothing usable: fetch and wait
+#define WC_HIT 1        // 'out' filled (fresh, or stale with a refresh already running)
+#define WC_STALE 2      // 'out' filled with a stale answer: the caller should refresh it
+#define WC_PENDING 3    // nothing usable, another caller is fetching it: wait for its put
+
+// Look up a cell. Only one caller per refresh attempt gets WC_STALE; the
+// others keep getting the stale answer as WC_HIT until the refresh lands.
+// Likewise only one caller gets WC_MISS. A claim (WC_MISS or WC_STALE)
+// that has not been answered after a few seconds is handed out again.
+int weather_cache_lookup(WeatherCache *c, uint64_t key, WeatherReport *out);
+
+// Store the answer for a cell, or NULL if the fetch failed. Failures are
+// remembered for a few seconds so an outage is not hammered; a failed
+// refresh keeps the stale answer until its stale window is over.
+// Returns 1 if a caller got WC_PENDING for it meanwhile (look again now).
+int weather_cache_put(WeatherCache *c, uint64_t key, const WeatherReport *report);
+
+void weather_cache_stats(WeatherCache *c, WeatherCacheStats *out);
+
+// One cached answer with its remaining lifetime, for handing the cache to
+// another process (see handoff.h). Plain data: it goes over a socket as is.
+typedef struct {
+    uint64_t key;
+    int32_t fresh_sec;          // seconds it is still fresh (<= 0: already stale)
+    int32_t stale_sec;          // seconds it may still be served (> 0)
+    WeatherReport report;
+} WeatherCacheItem;
+
+// Copy out every servable answer, least recently used first. Returns a
+// malloc'd array (count in *n), or NULL if the cache is empty or memory runs out.
+WeatherCacheItem *weather_cache_export(WeatherCache *c, size_t *n);
+
+// Store an exported answer with its remaining lifetime.
+void weather_cache_import(WeatherCache *c, const WeatherCacheItem *item);
+
+#endif
@@ -0,0 +1,60 @@
+// Log-linear histogram (see histogram.h).
+#include "histogram.h"
+
+#include <string.h>
+
+// Bucket of 'v': exact below HIST_SUB; above, the power of two plus the
+// next HIST_SUB_BITS-1 bits after the leading one.
+static int hist_index(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v) - (HIST_SUB_BITS - 1);   // v >> e is in [HIST_HALF, HIST_SUB)
+    return HIST_SUB + (e - 1) * HIST_HALF + (int)((v >> e) - HIST_HALF);
+}
+
+// Highest value that falls into bucket i.
+static uint64_t hist_upper(int i) {
+    if (i < HIST_SUB) return (uint64_t)i;
+    int e = (i - HIST_SUB) / HIST_HALF + 1;
+    uint64_t sub = (uint64_t)((i - HIST_SUB) % HIST_HALF + HIST_HALF);
+    return ((sub + 1) << e) - 1;
+}
+
+void hist_init(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_record(Histogram *h, uint64_t value) {
+    h->counts[hist_index(value)]++;
+    h->total++;
+    h->sum += (double)value;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+void hist_merge(Histogram *into, const Histogram *from) {
+    for (int i = 0; i < HIST_BUCKETS; i++) into->counts[i] += from->counts[i];
+    into->total += from->total;
+    into->sum += from->sum;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+uint64_t hist_percentile(const Histogram *h, double percent) {
+    if (h->total == 0) return 0;
+    uint64_t want = (uint64_t)(percent / 100.0 * (double)h->total + 0.5);
+    if (want < 1) want = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= want) {
+            uint64_t v = hist_upper(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const Histogram *h) {
+    return h->total ? h->sum / (double)h->total : 0.0;
+}
@@ -0,0 +1,35 @@
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// HIST_SUB are counted exactly, larger ones in buckets whose width is ~1.5%
+// of their value (6 bits of precision per power of two). Recording is a
+// couple of shifts, the table is fixed-size and histograms from several
+// threads can be merged.
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1 << HIST_SUB_BITS)          // exact values 0..HIST_SUB-1
+#define HIST_HALF (HIST_SUB / 2)               // buckets per power of two above that
+#define HIST_BUCKETS (HIST_SUB + (64 - HIST_SUB_BITS) * HIST_HALF)   // any uint64_t
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;             // values recorded
+    uint64_t min, max;          // exact extremes
+    double sum;                 // for the mean
+} Histogram;
+
+void hist_init(Histogram *h);
+void hist_record(Histogram *h, uint64_t value);
+
+// Add all of 'from' to 'into'.
+void hist_merge(Histogram *into, const Histogram *from);
+
+// Smallest recorded value v such that 'percent' % of the values are <= v
+// (bucket upper bound, never above max). 0 when empty.
+uint64_t hist_percentile(const Histogram *h, double percent);
+
+double hist_mean(const Histogram *h);
+
+#endif
@@ -0,0 +1,376 @@
+// loadgen: HTTP load generator for measuring the server.
+//
+// Keeps a fixed number of connections busy, each with one request in flight
+// at a time (closed loop), and reports throughput and the latency
+// distribution (p50/p90/p99/p99.9) from a log-linear histogram. Requests are
+// a mix of /api/v1/geo and /api/v1/weather, or the request targets of a
+// replay file sent in a loop.
+//
+// Example:
+//   ./loadgen -c 128 -t 4 -d 10 --geo-pct 20
+//   ./loadgen --no-keepalive --replay requests.txt
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event_loop.h"
+#include "histogram.h"
+
+#define MAX_THREADS 64
+#define MAX_EVENTS 256
+#define REQ_SIZE 2048           // one request (line + headers)
+#define RESP_SIZE 65536         // largest response we are prepared to read
+
+// One client connection with at most one request in flight.
+typedef struct {
+    int fd;                     // -1 while not connected
+    int connecting;             // non-blocking connect() still in progress
+    char req[REQ_SIZE];
+    size_t req_len, req_sent;
+    char in[RESP_SIZE];
+    size_t in_len;
+    long long started_ns;       // when the current request was started
+    unsigned rng;               // per-connection random state for the request mix
+} Client;
+
+typedef struct {
+    int id;
+    EventLoop *loop;
+    Client *clients;
+    int nclients;
+    int inflight;               // clients with a request on its way
+    size_t replay_next;         // next line of the replay file
+    Histogram latency;          // µs from first byte sent to response complete
+    uint64_t ok, non2xx, errors, bytes, connects;
+    pthread_t thread;
+} Thread;
+
+// Settings (read-only while the threads run).
+static struct addrinfo *ADDR;
+static const char *host_header = "127.0.0.1:8080";
+static int keep_alive = 1;
+static int geo_pct = 50;        // share of /api/v1/geo in the generated mix
+static char **REPLAY;           // request targets ("/api/v1/...") from --replay
+static size_t replay_count;
+static atomic_int stopping;
+static long long request_limit = -1;    // -n (-1 = run until the deadline)
+static _Atomic long long requests_started;
+
+static const char *GEO_CITIES[] = { "Stockholm", "Orebro", "Malmo", "Gothenburg", "Uppsala", "Atlantis" };
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned next_rand(unsigned *s) {   // xorshift32
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+// The next request target: from the replay file, or the geo/weather mix
+// (weather points are random ~1 km cells in Sweden, so most are cache misses
+// at first and hits later, like real traffic).
+static void next_target(Thread *t, Client *c, char *out, size_t room) {
+    if (REPLAY) {
+        snprintf(out, room, "%s", REPLAY[t->replay_next++ % replay_count]);
+        return;
+    }
+    unsigned r = next_rand(&c->rng);
+    if ((int)(r % 100) < geo_pct) {
+        snprintf(out, room, "/api/v1/geo?city=%s",
+                 GEO_CITIES[(r >> 8) % (sizeof(GEO_CITIES) / sizeof(GEO_CITIES[0]))]);
+    } else {
+        double lat = 55.0 + (next_rand(&c->rng) % 1400) / 100.0;
+        double lon = 11.0 + (next_rand(&c->rng) % 1300) / 100.0;
+        snprintf(out, room, "/api/v1/weather?lat=%.2f&lon=%.2f", lat, lon);
+    }
+}
+
+static void client_close(Thread *t, Client *c) {
+    if (c->fd < 0) return;
+    ev_loop_del(t->loop, c->fd);
+    close(c->fd);
+    c->fd = -1;
+}
+
+static int client_connect(Thread *t, Client *c) {
+    int fd = socket(ADDR->ai_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(fd, ADDR->ai_addr, ADDR->ai_addrlen) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    if (ev_loop_add(t->loop, fd, EVL_READ | EVL_WRITE, c) < 0) { close(fd); return -1; }
+    c->fd = fd;
+    c->connecting = 1;
+    t->connects++;
+    return 0;
+}
+
+// Send what is left of the request. Returns -1 on error.
+static int client_send(Client *c) {
+    while (c->req_sent < c->req_len) {
+        ssize_t n = send(c->fd, c->req + c->req_sent, c->req_len - c->req_sent, MSG_NOSIGNAL);
+        if (n > 0) { c->req_sent += (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;   // rest on EVL_WRITE
+        return -1;
+    }
+    return 0;
+}
+
+// Start the next request on this client (connecting first if needed).
+// Returns 0, or -1 if there is nothing more to do (the client is closed).
+static int client_start(Thread *t, Client *c) {
+    if (atomic_load(&stopping)) return -1;
+    if (request_limit >= 0 && atomic_fetch_add(&requests_started, 1) >= request_limit) return -1;
+    char target[REQ_SIZE / 2];
+    next_target(t, c, target, sizeof(target));
+    int n = snprintf(c->req, sizeof(c->req),
+                     "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: loadgen\r\n%s\r\n",
+                     target, host_header, keep_alive ? "" : "Connection: close\r\n");
+    c->req_len = n > 0 && (size_t)n < sizeof(c->req) ? (size_t)n : 0;
+    c->req_sent = 0;
+    c->in_len = 0;
+    c->started_ns = now_ns();
+    if (c->fd < 0 && client_connect(t, c) < 0) { t->errors++; return -1; }
+    if (!c->connecting && client_send(c) < 0) { t->errors++; client_close(t, c); return -1; }
+    return 0;
+}
+
+// Length of the complete response at the start of 'in', 0 if more bytes are
+// needed, -1 if it cannot be parsed. *status and *close_after are filled.
+static long response_length(const Client *c, int *status, int *close_after) {
+    const char *end = NULL;
+    for (size_t i = 3; i < c->in_len; i++) {
+        if (memcmp(c->in + i - 3, "\r\n\r\n", 4) == 0) { end = c->in + i + 1; break; }
+    }
+    if (!end) return c->in_len == sizeof(c->in) ? -1 : 0;
+    if (c->in_len < 12 || memcmp(c->in, "HTTP/1.", 7) != 0) return -1;
+    *status = atoi(c->in + 9);
+    *close_after = 0;
+    long body = -1;
+    for (const char *p = c->in; p < end; p++) {      // header names are matched case-insensitively
+        const char *line = p;
+        p = memchr(p, '\n', (size_t)(end - p));
+        if (!p) break;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) body = atol(line + 15);
+        else if (strncasecmp(line, "Connection:", 11) == 0 && strncasecmp(line + 11, " close", 6) == 0) *close_after = 1;
+    }
+    if (body < 0) return -1;                          // the server always sends Content-Length
+    size_t total = (size_t)(end - c->in) + (size_t)body;
+    if (total > sizeof(c->in)) return -1;
+    return c->in_len >= total ? (long)total : 0;
+}
+
+// The request failed: count it and carry on with a new connection.
+static void client_failed(Thread *t, Client *c) {
+    t->errors++;
+    client_close(t, c);
+    if (client_start(t, c) < 0) t->inflight--;
+}
+
+static void client_on_event(Thread *t, Client *c, int events) {
+    if (c->fd < 0) return;
+    if (c->connecting) {
+        if (!(events & (EVL_WRITE | EVL_ERROR))) return;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if ((events & EVL_ERROR) || getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+            client_failed(t, c);
+            return;
+        }
+        c->connecting = 0;
+    }
+    if (client_send(c) < 0) { client_failed(t, c); return; }
+    while (1) {
+        ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+        if (n > 0) c->in_len += (size_t)n;
+        else if (n < 0 && errno == EINTR) continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (events & EVL_ERROR) { client_failed(t, c); return; }
+            break;
+        } else {                                      // EOF or error before the response was complete
+            client_failed(t, c);
+            return;
+        }
+        int status, close_after;
+        long total = response_length(c, &status, &close_after);
+        if (total < 0) { client_failed(t, c); return; }
+        if (total == 0) continue;
+        hist_record(&t->latency, (uint64_t)(now_ns() - c->started_ns) / 1000);
+        if (status >= 200 && status < 300) t->ok++; else t->non2xx++;
+        t->bytes += (uint64_t)total;
+        if (close_after || !keep_alive) client_close(t, c);
+        if (client_start(t, c) < 0) { client_close(t, c); t->inflight--; return; }
+        if (c->fd < 0 || c->connecting) return;       // new connection: wait for its events
+    }
+}
+
+static void *thread_run(void *arg) {
+    Thread *t = arg;
+    EvEvent events[MAX_EVENTS];
+    for (int i = 0; i < t->nclients; i++) {
+        Client *c = &t->clients[i];
+        c->fd = -1;
+        c->rng = 2463534242u + (unsigned)(t->id * 1000 + i) * 2654435761u;
+        if (client_start(t, c) == 0) t->inflight++;
+    }
+    // Timed runs stop at the deadline (requests still in flight are not
+    // counted); with -n every started request is waited for.
+    while (t->inflight > 0 && !atomic_load(&stopping)) {
+        int n = ev_loop_wait(t->loop, events, MAX_EVENTS, 100);
+        for (int i = 0; i < n; i++) client_on_event(t, events[i].data, events[i].events);
+    }
+    for (int i = 0; i < t->nclients; i++) client_close(t, &t->clients[i]);
+    return NULL;
+}
+
+// Read request targets, one per line. A line may also be a JSON object with
+// a "path" member (e.g. a JSON-lines access log); empty lines and lines
+// starting with '#' are skipped.
+static int load_replay(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return -1; }
+    char *line = NULL;
+    size_t cap = 0, room = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, f)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        char *target = line;
+        if (line[0] == '{') {
+            char *p = strstr(line, "\"path\"");
+            if (!p || !(p = strchr(p + 6, '"'))) continue;
+            target = p + 1;
+            char *end = strchr(target, '"');
+            if (!end) continue;
+            *end = '\0';
+        }
+        if (target[0] != '/') continue;
+        if (replay_count == room) {
+            room = room ? room * 2 : 256;
+            char **grown = realloc(REPLAY, room * sizeof(char *));
+            if (!grown) { fclose(f); return -1; }
+            REPLAY = grown;
+        }
+        if (!(REPLAY[replay_count++] = strdup(target))) { fclose(f); return -1; }
+    }
+    free(line);
+    fclose(f);
+    if (replay_count == 0) { fprintf(stderr, "%s: no request targets (lines starting with '/')\n", path); return -1; }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--host HOST] [--port N] [-c N] [-t N] [-d SEC | -n N]\n"
+            "          [--no-keepalive] [--geo-pct P] [--replay FILE]\n"
+            "  --host HOST     server address (default 127.0.0.1)\n"
+            "  --port N        server port (default 8080)\n"
+            "  -c N            concurrent connections (default 64)\n"
+            "  -t N            threads, connections are spread over them (default 2)\n"
+            "  -d SEC          run for SEC seconds (default 10)\n"
+            "  -n N            send N requests instead\n"
+            "  --no-keepalive  one request per connection (Connection: close)\n"
+            "  --geo-pct P     percent of /api/v1/geo requests, rest /api/v1/weather (default 50)\n"
+            "  --replay FILE   send the request targets in FILE in a loop instead\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    const char *port = "8080";
+    int conns = 64, threads = 2;
+    double duration = 10;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(a, "--no-keepalive") == 0) { keep_alive = 0; continue; }
+        if (!v) { usage(argv[0]); return 2; }
+        i++;
+        if (strcmp(a, "--host") == 0) host = v;
+        else if (strcmp(a, "--port") == 0) port = v;
+        else if (strcmp(a, "-c") == 0) conns = atoi(v);
+        else if (strcmp(a, "-t") == 0) threads = atoi(v);
+        else if (strcmp(a, "-d") == 0) duration = atof(v);
+        else if (strcmp(a, "-n") == 0) request_limit = atoll(v);
+        else if (strcmp(a, "--geo-pct") == 0) geo_pct = atoi(v);
+        else if (strcmp(a, "--replay") == 0) { if (load_replay(v) < 0) return 1; }
+        else { usage(argv[0]); return 2; }
+    }
+    if (conns < 1 || threads < 1 || threads > MAX_THREADS || duration <= 0 || geo_pct < 0 || geo_pct > 100) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (threads > conns) threads = conns;
+
+    struct addrinfo hints = { .ai_socktype = SOCK_STREAM };
+    int rc = getaddrinfo(host, port, &hints, &ADDR);
+    if (rc != 0) { fprintf(stderr, "%s: %s\n", host, gai_strerror(rc)); return 1; }
+    static char hh[300];
+    snprintf(hh, sizeof(hh), "%s:%s", host, port);
+    host_header = hh;
+
+    static Thread T[MAX_THREADS];
+    for (int i = 0; i < threads; i++) {
+        Thread *t = &T[i];
+        t->id = i;
+        t->nclients = conns / threads + (i < conns % threads);
+        t->clients = calloc((size_t)t->nclients, sizeof(Client));
+        t->loop = ev_loop_create(NULL);
+        if (!t->clients || !t->loop) { perror("loadgen"); return 1; }
+        hist_init(&t->latency);
+    }
+    printf("loadgen: %s, %d connections on %d threads, %s, %s\n", hh, conns, threads,
+           keep_alive ? "keep-alive" : "no keep-alive",
+           REPLAY ? "replay" : request_limit >= 0 ? "fixed request count" : "timed");
+    long long t0 = now_ns();
+    for (int i = 0; i < threads; i++) pthread_create(&T[i].thread, NULL, thread_run, &T[i]);
+    if (request_limit < 0) {
+        struct timespec d = { (time_t)duration, (long)((duration - (time_t)duration) * 1e9) };
+        while (nanosleep(&d, &d) < 0 && errno == EINTR) {}
+        atomic_store(&stopping, 1);
+    }
+    for (int i = 0; i < threads; i++) pthread_join(T[i].thread, NULL);
+    double secs = (double)(now_ns() - t0) / 1e9;
+
+    Histogram all;
+    hist_init(&all);
+    uint64_t ok = 0, non2xx = 0, errors = 0, bytes = 0, connects = 0;
+    for (int i = 0; i < threads; i++) {
+        hist_merge(&all, &T[i].latency);
+        ok += T[i].ok; non2xx += T[i].non2xx; errors += T[i].errors;
+        bytes += T[i].bytes; connects += T[i].connects;
+    }
+    uint64_t done = ok + non2xx;
+    printf("requests:   %llu in %.2f s (%llu non-2xx, %llu errors, %llu connections)\n",
+           (unsigned long long)done, secs, (unsigned long long)non2xx,
+           (unsigned long long)errors, (unsigned long long)connects);
+    printf("throughput: %.0f req/s, %.2f MB/s\n", done / secs, bytes / secs / 1e6);
+    printf("latency:    mean %.3f ms, p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f ms\n",
+           hist_mean(&all) / 1000.0,
+           hist_percentile(&all, 50) / 1000.0, hist_percentile(&all, 90) / 1000.0,
+           hist_percentile(&all, 99) / 1000.0, hist_percentile(&all, 99.9) / 1000.0,
+           all.max / 1000.0 * (all.total > 0));
+    freeaddrinfo(ADDR);
+    return errors > 0 && done == 0;
+}
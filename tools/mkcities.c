@@ -0,0 +1,123 @@
+// mkcities: convert a city list into the binary city file used by
+// `./server --cities FILE`.
+//
+// Input formats (detected per line):
+// - CSV:  name,country,lat,lon[,population]   (fields may be "quoted")
+// - GeoNames dump (tab-separated, e.g. cities15000.txt): columns
+//         name(2) lat(5) lon(6) country(9) population(15)
+// Lines starting with '#' and lines whose lat/lon are not numbers (such as a
+// CSV header) are skipped.
+//
+// Example:
+//   ./mkcities data/demo_cities.csv cities.bin
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cities.h"
+
+#define MAX_FIELDS 20
+
+// Split one line into fields in place. Handles "quoted, fields" and ""
+// escapes for CSV; TSV fields are taken literally. Returns the field count.
+static int split_fields(char *line, char sep, char **fields, int max) {
+    int n = 0;
+    char *p = line;
+    while (n < max) {
+        if (sep == ',' && *p == '"') {                // quoted CSV field
+            char *out = ++p;
+            fields[n++] = out;
+            while (*p) {
+                if (*p == '"' && p[1] == '"') { *out++ = '"'; p += 2; continue; }
+                if (*p == '"') { p++; break; }
+                *out++ = *p++;
+            }
+            while (*p && *p != sep) p++;              // ignore junk after the closing quote
+            int more = *p == sep;
+            *out = '\0';
+            if (!more) break;
+            p++;
+        } else {
+            fields[n++] = p;
+            char *e = strchr(p, sep);
+            if (!e) break;
+            *e = '\0';
+            p = e + 1;
+        }
+    }
+    return n;
+}
+
+// Strictly parse a decimal number; returns 0 for anything else.
+static int parse_double(const char *s, double *out) {
+    char *end;
+    errno = 0;
+    *out = strtod(s, &end);
+    return end != s && *end == '\0' && errno == 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s INPUT.csv|INPUT.txt OUTPUT.bin\n", argv[0]);
+        return 2;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) { perror(argv[1]); return 1; }
+
+    size_t cap = 1024, n = 0, skipped = 0;
+    City *cities = malloc(cap * sizeof(City));
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    while (cities && (len = getline(&line, &line_cap, in)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+        char sep = strchr(line, '\t') ? '\t' : ',';
+        char *f[MAX_FIELDS];
+        int nf = split_fields(line, sep, f, MAX_FIELDS);
+        const char *name, *country, *lat_s, *lon_s, *pop_s = NULL;
+        if (sep == '\t') {                            // GeoNames column layout
+            if (nf < 15) { skipped++; continue; }
+            name = f[1]; lat_s = f[4]; lon_s = f[5]; country = f[8]; pop_s = f[14];
+        } else {
+            if (nf < 4) { skipped++; continue; }
+            name = f[0]; country = f[1]; lat_s = f[2]; lon_s = f[3];
+            if (nf > 4) pop_s = f[4];
+        }
+        double lat, lon, pop = 0;
+        if (!parse_double(lat_s, &lat) || !parse_double(lon_s, &lon)
+            || lat < -90 || lat > 90 || lon < -180 || lon > 180 || !*name) {
+            skipped++;                                // header line or bad row
+            continue;
+        }
+        if (pop_s && *pop_s && (!parse_double(pop_s, &pop) || pop < 0)) pop = 0;
+        if (n == cap) {
+            cap *= 2;
+            City *grown = realloc(cities, cap * sizeof(City));
+            if (!grown) { free(cities); cities = NULL; break; }
+            cities = grown;
+        }
+        City *c = &cities[n++];
+        c->city = strdup(name);
+        c->country = strdup(country);
+        c->lat = lat;
+        c->lon = lon;
+        c->population = pop > 4294967295.0 ? 4294967295u : (uint32_t)pop;
+        if (!c->city || !c->country) { free(cities); cities = NULL; }
+    }
+    free(line);
+    fclose(in);
+    if (!cities) { fprintf(stderr, "out of memory\n"); return 1; }
+    if (n == 0) {                       // the server would refuse the file
+        fprintf(stderr, "%s: no cities in input (%zu lines skipped)\n", argv[1], skipped);
+        return 1;
+    }
+
+    CityDb db;
+    if (city_db_build(&db, cities, n) < 0) { fprintf(stderr, "out of memory\n"); return 1; }
+    if (city_db_write(&db, argv[2]) < 0) { perror(argv[2]); return 1; }
+    printf("%s: %zu cities (%zu lines skipped), %zu bytes of names\n",
+           argv[2], db.count, skipped, db.pool_len);
+    return 0;
+}
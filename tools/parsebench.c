@@ -0,0 +1,327 @@
+// parsebench: microbenchmarks for the per-request parsing path.
+//
+// Times http_parser_feed() (whole request at once and byte by byte, the way
+// slow clients deliver it), the query helpers, http_url_decode() and the
+// coordinate parser (against the atof() it replaced) on
+// realistic and adversarial inputs, and the JSON writer used for response
+// bodies (against the snprintf() formatting it replaced), and prints ns per
+// call. Each case is run
+// in several rounds and the fastest round is reported, which filters out
+// scheduler noise; run it before and after a change.
+//
+// Example:
+//   ./parsebench            all cases
+//   ./parsebench query      only cases whose name contains "query"
+//   ./parsebench --scan scalar   use the portable scanner instead of SIMD
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "coord.h"
+#include "http_parser.h"
+#include "json_writer.h"
+#include "scan.h"
+
+#define ROUNDS 7
+#define TARGET_NS 50000000LL    // aim for ~50 ms per round
+#define BUF_SIZE 8192           // the server's request buffer size
+
+static volatile size_t sink;    // results go here so the work is not optimized away
+
+// Inputs, built in main()
+static char REQ_GEO[256];
+static char REQ_BROWSER[2048];
+static char REQ_MANY_HEADERS[BUF_SIZE];
+static char LONG_QUERY[6000];
+static char ESCAPED[3 * 1500 + 1];
+static char PLAIN[1500 + 1];
+static char QUOTED[1500 + 1];
+static double TEMPS[168];       // a week of hourly temperatures
+static volatile double LAT = 55.6050, LON = 13.0038, TEMP = 10.5;  // volatile: no constant folding
+
+typedef struct {
+    const char *name;
+    const char *input;          // the request, query or string the case works on
+    void (*run)(const char *input, size_t len, Arena *a);
+} Case;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void run_feed(const char *in, size_t len, Arena *a) {
+    (void)a;
+    HttpParser p;
+    http_parser_init(&p, BUF_SIZE);
+    sink += (size_t)http_parser_feed(&p, in, len) + p.req.header_len;
+}
+
+static void run_feed_bytewise(const char *in, size_t len, Arena *a) {
+    (void)a;
+    HttpParser p;
+    http_parser_init(&p, BUF_SIZE);
+    for (size_t i = 1; i <= len; i++) {
+        if (http_parser_feed(&p, in, i) != HTTP_PARSE_INCOMPLETE) break;
+    }
+    sink += p.req.header_len;
+}
+
+// Look up every parameter of the weather endpoint, like handle_weather()
+static void run_query_weather(const char *in, size_t len, Arena *a) {
+    StrView q = { in, len };
+    arena_reset(a);
+    char *lat = http_query_param(a, q, "lat");
+    char *lon = http_query_param(a, q, "lon");
+    sink += (lat ? strlen(lat) : 0) + (lon ? strlen(lon) : 0);
+}
+
+// The same with one tokenizer pass (what handle_weather() does)
+static void run_query_split_weather(const char *in, size_t len, Arena *a) {
+    StrView qv = { in, len };
+    HttpQuery q;
+    arena_reset(a);
+    http_query_parse(qv, &q);
+    char *lat = http_query_get(&q, a, "lat");
+    char *lon = http_query_get(&q, a, "lon");
+    sink += (lat ? strlen(lat) : 0) + (lon ? strlen(lon) : 0);
+}
+
+static void run_query_split_long(const char *in, size_t len, Arena *a) {
+    StrView qv = { in, len };
+    HttpQuery q;
+    arena_reset(a);
+    http_query_parse(qv, &q);
+    char *v = http_query_get(&q, a, "wanted");
+    sink += v ? strlen(v) : 0;
+}
+
+static void run_query_last(const char *in, size_t len, Arena *a) {
+    StrView q = { in, len };
+    arena_reset(a);
+    char *v = http_query_param(a, q, "wanted");
+    sink += v ? strlen(v) : 0;
+}
+
+static void run_query_missing(const char *in, size_t len, Arena *a) {
+    StrView q = { in, len };
+    arena_reset(a);
+    sink += http_query_param(a, q, "missing") != NULL;
+}
+
+// Coordinates: the old way (NUL-terminated copy + atof) vs coord_parse()
+static void run_coord_atof(const char *in, size_t len, Arena *a) {
+    arena_reset(a);
+    char *s = arena_strndup(a, in, len);
+    sink += (size_t)atof(s);
+}
+
+static void run_coord_fixed(const char *in, size_t len, Arena *a) {
+    (void)a;
+    double d = 0;
+    sink += (size_t)(coord_parse(in, len, &d) == 0) + (size_t)d;
+}
+
+static void run_decode(const char *in, size_t len, Arena *a) {
+    arena_reset(a);
+    char *s = arena_strndup(a, in, len);    // decoding works in place: start from a fresh copy
+    http_url_decode(s);
+    sink += (size_t)s[0];
+}
+
+// JSON bodies: 'in' is the string field (description, city name).
+static void run_json_snprintf_weather(const char *in, size_t len, Arena *a) {
+    (void)len; (void)a;
+    char out[256];
+    sink += (size_t)snprintf(out, sizeof(out), "{\"tempC\":%.1f,\"description\":\"%s\",\"updatedAt\":\"%s\"}",
+                             TEMP, in, "2025-11-03T12:34:56Z");
+}
+
+static void run_json_writer_weather(const char *in, size_t len, Arena *a) {
+    (void)a;
+    char out[256];
+    JsonWriter j;
+    json_init(&j, out, sizeof(out));
+    json_begin_object(&j);
+    json_key(&j, "tempC");
+    json_fixed(&j, TEMP, 1);
+    json_key(&j, "description");
+    json_string_len(&j, in, len);
+    json_key(&j, "updatedAt");
+    json_string_len(&j, "2025-11-03T12:34:56Z", 20);
+    json_end_object(&j);
+    sink += json_length(&j);
+}
+
+static void run_json_snprintf_geo(const char *in, size_t len, Arena *a) {
+    (void)len; (void)a;
+    char out[256];
+    sink += (size_t)snprintf(out, sizeof(out), "{\"city\":\"%s\",\"country\":\"%s\",\"lat\":%.4f,\"lon\":%.4f}",
+                             in, "SE", LAT, LON);
+}
+
+static void run_json_writer_geo(const char *in, size_t len, Arena *a) {
+    (void)a;
+    char out[256];
+    JsonWriter j;
+    json_init(&j, out, sizeof(out));
+    json_begin_object(&j);
+    json_key(&j, "city");
+    json_string_len(&j, in, len);
+    json_key(&j, "country");
+    json_string_len(&j, "SE", 2);
+    json_key(&j, "lat");
+    json_fixed(&j, LAT, 4);
+    json_key(&j, "lon");
+    json_fixed(&j, LON, 4);
+    json_end_object(&j);
+    sink += json_length(&j);
+}
+
+// One forecast column: 168 numbers with one decimal
+static void run_json_snprintf_column(const char *in, size_t len, Arena *a) {
+    (void)in; (void)len; (void)a;
+    char out[2048];
+    size_t n = 0;
+    out[n++] = '[';
+    for (int i = 0; i < 168; i++) n += (size_t)snprintf(out + n, sizeof(out) - n, i ? ",%.1f" : "%.1f", TEMPS[i]);
+    out[n++] = ']';
+    sink += n;
+}
+
+static void run_json_writer_column(const char *in, size_t len, Arena *a) {
+    (void)in; (void)len; (void)a;
+    char out[2048];
+    JsonWriter j;
+    json_init(&j, out, sizeof(out));
+    json_begin_array(&j);
+    for (int i = 0; i < 168; i++) json_fixed(&j, TEMPS[i], 1);
+    json_end_array(&j);
+    sink += json_length(&j);
+}
+
+static void run_json_writer_string(const char *in, size_t len, Arena *a) {
+    (void)a;
+    char out[4 * 1500];
+    JsonWriter j;
+    json_init(&j, out, sizeof(out));
+    json_string_len(&j, in, len);
+    sink += json_length(&j);
+}
+
+static void build_inputs(void) {
+    snprintf(REQ_GEO, sizeof(REQ_GEO), "GET /api/v1/geo?city=Malmo HTTP/1.1\r\nHost: localhost:8080\r\n\r\n");
+    snprintf(REQ_BROWSER, sizeof(REQ_BROWSER),
+             "GET /api/v1/weather?lat=55.6050&lon=13.0038 HTTP/1.1\r\n"
+             "Host: localhost:8080\r\n"
+             "Connection: keep-alive\r\n"
+             "sec-ch-ua: \"Chromium\";v=\"130\", \"Google Chrome\";v=\"130\", \"Not?A_Brand\";v=\"99\"\r\n"
+             "sec-ch-ua-mobile: ?0\r\n"
+             "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+             "Chrome/130.0.0.0 Safari/537.36\r\n"
+             "sec-ch-ua-platform: \"Linux\"\r\n"
+             "Accept: */*\r\n"
+             "Origin: http://localhost:5173\r\n"
+             "Sec-Fetch-Site: same-site\r\n"
+             "Sec-Fetch-Mode: cors\r\n"
+             "Sec-Fetch-Dest: empty\r\n"
+             "Referer: http://localhost:5173/\r\n"
+             "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+             "Accept-Language: en-US,en;q=0.9,sv;q=0.8\r\n"
+             "\r\n");
+    // ~7 KB of short headers: per-line overhead dominates
+    size_t n = (size_t)snprintf(REQ_MANY_HEADERS, sizeof(REQ_MANY_HEADERS), "GET /api/v1/geo?city=Malmo HTTP/1.1\r\n");
+    for (int i = 0; n + 64 < 7000; i++) {
+        n += (size_t)snprintf(REQ_MANY_HEADERS + n, sizeof(REQ_MANY_HEADERS) - n, "X-Header-%d: value-%d\r\n", i, i);
+    }
+    snprintf(REQ_MANY_HEADERS + n, sizeof(REQ_MANY_HEADERS) - n, "\r\n");
+    // ~5 KB query: 400 parameters, the one we want last
+    n = 0;
+    for (int i = 0; i < 400; i++) {
+        n += (size_t)snprintf(LONG_QUERY + n, sizeof(LONG_QUERY) - n, "p%d=v%d&", i, i);
+    }
+    snprintf(LONG_QUERY + n, sizeof(LONG_QUERY) - n, "wanted=%%4D%%61lm%%C3%%B6+City");
+    // 1500 bytes: all escapes vs. nothing to decode
+    for (int i = 0; i < 1500; i++) memcpy(ESCAPED + 3 * i, "%4D", 3);
+    ESCAPED[3 * 1500] = '\0';
+    memset(PLAIN, 'a', 1500);
+    PLAIN[1500] = '\0';
+    for (int i = 0; i < 1500; i++) QUOTED[i] = i % 10 == 9 ? '"' : 'a';   // an escape every 10 bytes
+    QUOTED[1500] = '\0';
+    for (int i = 0; i < 168; i++) TEMPS[i] = 8.0 + 4.0 * ((i % 24) - 12) / 12.0 + (i % 7) * 0.13;
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scan") == 0 && i + 1 < argc) {
+            if (scan_use(argv[++i]) < 0) { fprintf(stderr, "scanner %s not available\n", argv[i]); return 2; }
+        } else {
+            filter = argv[i];
+        }
+    }
+    build_inputs();
+    static const char WEATHER_QUERY[] = "lat=55.6050&lon=13.0038";
+    static const char ESCAPED_QUERY[] = "lat=%35%35%2E%36%30%35%30&lon=%31%33%2E%30%30%33%38";
+    const Case cases[] = {
+        { "feed/geo",                REQ_GEO,          run_feed },
+        { "feed/browser",            REQ_BROWSER,      run_feed },
+        { "feed/many-headers",       REQ_MANY_HEADERS, run_feed },
+        { "feed-bytewise/browser",   REQ_BROWSER,      run_feed_bytewise },
+        { "feed-bytewise/many-headers", REQ_MANY_HEADERS, run_feed_bytewise },
+        { "query/weather",           WEATHER_QUERY,    run_query_weather },
+        { "query/weather-escaped",   ESCAPED_QUERY,    run_query_weather },
+        { "query-split/weather",     WEATHER_QUERY,    run_query_split_weather },
+        { "query-split/weather-escaped", ESCAPED_QUERY, run_query_split_weather },
+        { "query-split/long-last",   LONG_QUERY,       run_query_split_long },
+        { "query/long-last",         LONG_QUERY,       run_query_last },
+        { "query/long-missing",      LONG_QUERY,       run_query_missing },
+        { "coord-atof/short",        "55.6050",        run_coord_atof },
+        { "coord-atof/long",         "-123.456789012", run_coord_atof },
+        { "coord-fixed/short",       "55.6050",        run_coord_fixed },
+        { "coord-fixed/long",        "-123.456789012", run_coord_fixed },
+        { "decode/plain-1500",       PLAIN,            run_decode },
+        { "decode/escaped-1500",     ESCAPED,          run_decode },
+        { "json-snprintf/weather",   "Partly cloudy",  run_json_snprintf_weather },
+        { "json-writer/weather",     "Partly cloudy",  run_json_writer_weather },
+        { "json-snprintf/geo",       "Gothenburg",     run_json_snprintf_geo },
+        { "json-writer/geo",         "Gothenburg",     run_json_writer_geo },
+        { "json-snprintf/column-168", "",              run_json_snprintf_column },
+        { "json-writer/column-168",  "",               run_json_writer_column },
+        { "json-writer/plain-1500",  PLAIN,            run_json_writer_string },
+        { "json-writer/quoted-1500", QUOTED,           run_json_writer_string },
+    };
+    char scratch[16384];
+    Arena arena;
+    arena_init(&arena, scratch, sizeof(scratch));
+
+    printf("scanner: %s\n", scan_backend());
+    printf("%-28s %8s %12s %10s\n", "case", "bytes", "ns/call", "MB/s");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const Case *k = &cases[c];
+        if (filter && !strstr(k->name, filter)) continue;
+        size_t len = strlen(k->input);
+        // Calibrate: double the iteration count until one round takes long enough.
+        long long iters = 1;
+        while (1) {
+            long long t0 = now_ns();
+            for (long long i = 0; i < iters; i++) k->run(k->input, len, &arena);
+            if (now_ns() - t0 >= TARGET_NS / 10 || iters >= (1LL << 30)) break;
+            iters *= 2;
+        }
+        iters *= 10;
+        double best = 1e300;
+        for (int r = 0; r < ROUNDS; r++) {
+            long long t0 = now_ns();
+            for (long long i = 0; i < iters; i++) k->run(k->input, len, &arena);
+            double ns = (double)(now_ns() - t0) / (double)iters;
+            if (ns < best) best = ns;
+        }
+        printf("%-28s %8zu %12.1f %10.1f\n", k->name, len, best, (double)len / best * 1000.0);
+    }
+    return 0;
+}